@@ -0,0 +1,224 @@
+/*
+ * Assembly benchmark
+ *
+ * Assembles generated programs (see program_gen.h) of growing sizes, the whole way the assembler does:
+ *   read   - opening the source file, which is memory mapped where it can be
+ *   pass 1 - firstPass(), formatting the source and recording the labels
+ *   pass 2 - secondPass(), encoding the formatted code
+ *   emit   - emitImages(), formatting the hex and binary images, which are not written anywhere
+ * and reports the time of each phase (best of the runs), the throughput of the whole, and the peak memory,
+ * as a table, CSV or JSON, so how the assembler scales can be followed from one release to the next.
+ *
+ * Usage: ./bin/assemble_bench [--sizes 1e3,1e4,1e5,1e6] [--runs 3] [--jobs <n>] [--csv | --json] [shape options]
+ */
+
+#include "assembler.h"
+#include "emit.h"
+#include "program_gen.h"
+#include "source.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// The phases of stats.h up to emitting, as nothing is written
+#define MEASURED_PHASES (PHASE_EMIT + 1)
+
+static const char *PHASE_NAMES[MEASURED_PHASES] = {"read", "first_pass", "second_pass", "emit"};
+
+struct Result {
+    ProgramTally tally;
+    double phases[MEASURED_PHASES];     // Seconds, best of the runs
+    double total;               // Seconds, of the best run
+    size_t peak;                // Bytes, 0 if it can't be told
+    size_t diagnostics;
+};
+
+// Starts the peak memory over, so each size gets its own. Only Linux can, the peak is of the whole run elsewhere.
+static void resetPeakMemory(){
+    ofstream("/proc/self/clear_refs") << "5";
+}
+
+static size_t currentPeakMemory(){
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line))
+        if (line.compare(0, 6, "VmHWM:") == 0) return strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+    return peakMemory();
+}
+
+static bool writeProgram(const string &path, const ProgramShape &shape, ProgramTally &tally){
+    FILE *out = fopen(path.c_str(), "wb");
+    if (!out) return false;
+
+    ProgramGenerator generator(shape);
+    string buffer;
+    bool more = true;
+    while (more){
+        buffer.clear();
+        while (buffer.size() < (1 << 20) && (more = generator.next(buffer)));
+        if (fwrite(buffer.data(), 1, buffer.size(), out) != buffer.size()) more = false;
+    }
+    tally = generator.tally();
+    return !ferror(out) & !fclose(out);
+}
+
+static bool measure(const string &path, int runs, size_t jobs, Result &result){
+    using clock = chrono::steady_clock;
+    AssemblerContext ctx;
+    Images images;
+    unique_ptr<ThreadPool> pool;
+
+    fill(begin(result.phases), end(result.phases), 1e300);
+    result.total = 1e300;
+    resetPeakMemory();
+
+    for (int r = 0; r < runs; r++){
+        double phases[MEASURED_PHASES];
+        auto start = clock::now();
+        SourceFile source;
+        if (!source.open(path)) return false;
+        auto read = clock::now();
+
+        // As the assembler does, only a source of two chunks or more is worth the threads
+        if (!pool && jobs != 1 && source.text().size() >= 2 * CHUNK_MIN_BYTES) pool.reset(new ThreadPool(jobs));
+        ctx.clear();
+        firstPass(ctx, source.text(), pool.get());
+        auto labelled = clock::now();
+        if (!ctx.error) secondPass(ctx, pool.get());
+        auto encoded = clock::now();
+        emitImages(ctx, IMAGE_BIT(IMAGE_HEX) | IMAGE_BIT(IMAGE_BINARY), true, images);
+        auto emitted = clock::now();
+
+        phases[PHASE_READ] = chrono::duration<double>(read - start).count();
+        phases[PHASE_FIRST_PASS] = chrono::duration<double>(labelled - read).count();
+        phases[PHASE_SECOND_PASS] = chrono::duration<double>(encoded - labelled).count();
+        phases[PHASE_EMIT] = chrono::duration<double>(emitted - encoded).count();
+        for (int p = 0; p < MEASURED_PHASES; p++) result.phases[p] = min(result.phases[p], phases[p]);
+        result.total = min(result.total, chrono::duration<double>(emitted - start).count());
+        result.diagnostics = ctx.diagnostics.size();
+    }
+    result.peak = currentPeakMemory();
+    return true;
+}
+
+static vector<uint64_t> parseSizes(const char *list){
+    vector<uint64_t> sizes;
+    for (const char *p = list; *p; ){
+        char *end;
+        sizes.push_back(uint64_t(strtod(p, &end)));
+        if (end == p) return {};
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return sizes;
+}
+
+static void printTable(const vector<Result> &results){
+    cout << right << fixed;
+    cout << setw(11) << "lines" << setw(12) << "MB" << setw(9) << "errors";
+    for (int p = 0; p < MEASURED_PHASES; p++) cout << setw(16) << string(PHASE_NAMES[p]) + " ms";
+    cout << setw(12) << "total ms" << setw(14) << "lines/s" << setw(10) << "MB/s" << setw(11) << "peak MiB" << '\n';
+
+    for (const Result &r: results){
+        cout << setw(11) << r.tally.lines << setw(12) << setprecision(2) << r.tally.bytes / 1e6 << setw(9) << r.diagnostics;
+        for (int p = 0; p < MEASURED_PHASES; p++) cout << setw(16) << setprecision(3) << r.phases[p] * 1e3;
+        cout << setw(12) << r.total * 1e3 << setw(14) << setprecision(0) << r.tally.lines / r.total
+             << setw(10) << setprecision(1) << r.tally.bytes / r.total / 1e6 << setw(11) << r.peak / double(1 << 20) << '\n';
+    }
+}
+
+static void printCsv(const vector<Result> &results){
+    cout << "lines,bytes,labels,forward,backward,errors,diagnostics";
+    for (int p = 0; p < MEASURED_PHASES; p++) cout << ',' << PHASE_NAMES[p] << "_s";
+    cout << ",total_s,lines_per_s,mb_per_s,peak_rss_bytes\n";
+
+    cout << setprecision(9);
+    for (const Result &r: results){
+        cout << r.tally.lines << ',' << r.tally.bytes << ',' << r.tally.labels << ',' << r.tally.forward << ','
+             << r.tally.backward << ',' << r.tally.errors << ',' << r.diagnostics;
+        for (int p = 0; p < MEASURED_PHASES; p++) cout << ',' << r.phases[p];
+        cout << ',' << r.total << ',' << r.tally.lines / r.total << ',' << r.tally.bytes / r.total / 1e6 << ',' << r.peak << '\n';
+    }
+}
+
+static void printJson(const vector<Result> &results, const ProgramShape &shape, int runs, size_t jobs){
+    cout << setprecision(9);
+    cout << "{\"shape\":{\"labels\":" << shape.labels << ",\"references\":" << shape.references << ",\"forward\":" << shape.forward
+         << ",\"comments\":" << shape.comments << ",\"noise\":" << shape.noise << ",\"errors\":" << shape.errors << ",\"seed\":" << shape.seed
+         << "},\"runs\":" << runs << ",\"jobs\":" << jobs << ",\"results\":[";
+    for (size_t i = 0; i < results.size(); i++){
+        const Result &r = results[i];
+        cout << (i ? "," : "") << "{\"lines\":" << r.tally.lines << ",\"bytes\":" << r.tally.bytes << ",\"labels\":" << r.tally.labels
+             << ",\"forward\":" << r.tally.forward << ",\"backward\":" << r.tally.backward << ",\"errors\":" << r.tally.errors
+             << ",\"diagnostics\":" << r.diagnostics << ",\"phases\":{";
+        for (int p = 0; p < MEASURED_PHASES; p++) cout << (p ? "," : "") << '"' << PHASE_NAMES[p] << "\":" << r.phases[p];
+        cout << "},\"total\":" << r.total << ",\"lines_per_s\":" << r.tally.lines / r.total << ",\"mb_per_s\":"
+             << r.tally.bytes / r.total / 1e6 << ",\"peak_rss\":" << r.peak << "}";
+    }
+    cout << "]}" << endl;
+}
+
+int main(int argc, char **argv){
+    ProgramShape shape;
+    vector<uint64_t> sizes = {1000, 10000, 100000, 1000000};
+    int runs = 3;
+    size_t jobs = 0;
+    bool csv = false, json = false;
+
+    for (int i = 1; i < argc; i++){
+        if (!strcmp(argv[i], "--sizes") && i + 1 < argc) sizes = parseSizes(argv[++i]);
+        else if (!strcmp(argv[i], "--runs") && i + 1 < argc) runs = max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--jobs") && i + 1 < argc) jobs = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--csv")) csv = true;
+        else if (!strcmp(argv[i], "--json")) json = true;
+        else if (!parseShapeOption(argc, argv, i, shape) || sizes.empty()){
+            cerr << "Usage: " << argv[0] << " [--sizes 1e3,1e4,...] [--runs <n>] [--jobs <n>] [--csv | --json] [options]\n" << SHAPE_USAGE;
+            return 1;
+        }
+    }
+    if (sizes.empty()){
+        cerr << "Error: --sizes takes a list of line counts, e.g. 1e3,1e4,1e5" << endl;
+        return 1;
+    }
+
+    string path = (filesystem::temp_directory_path() / ("assemble_bench_" + to_string(shape.seed) + ".txt")).string();
+    vector<Result> results;
+    bool failed = false;
+
+    for (uint64_t lines: sizes){
+        Result result;
+        shape.lines = lines;
+        if (!writeProgram(path, shape, result.tally) || !measure(path, runs, jobs, result)){
+            cerr << "Error: Unable to write or read " << path << endl;
+            failed = true;
+            break;
+        }
+        // The generator only makes encoding errors, one per statement it made wrong
+        if (result.diagnostics != result.tally.errors){
+            cerr << "Error: The program of " << lines << " lines has " << result.diagnostics << " errors, " << result.tally.errors << " were made" << endl;
+            failed = true;
+        }
+        results.push_back(result);
+        if (!csv && !json) cerr << "Assembled " << lines << " lines" << endl;
+    }
+    filesystem::remove(path);
+
+    if (csv) printCsv(results);
+    else if (json) printJson(results, shape, runs, jobs);
+    else {
+        cout << "Best of " << runs << " runs, " << (jobs ? to_string(jobs) : "all") << " threads\n";
+        printTable(results);
+    }
+    return failed;
+}
@@ -0,0 +1,55 @@
+/*
+ * Synthetic program generator
+ *
+ * Writes a program of the given shape (see program_gen.h), the same for the same options on every machine,
+ * to feed the assembler with workloads of any size.
+ *
+ * Usage: ./bin/gen_program [-o <file>] [shape options] > program.txt
+ */
+
+#include "program_gen.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+int main(int argc, char **argv){
+    ProgramShape shape;
+    const char *path = nullptr;
+
+    for (int i = 1; i < argc; i++){
+        if (!strcmp(argv[i], "-o") && i + 1 < argc) path = argv[++i];
+        else if (!parseShapeOption(argc, argv, i, shape)){
+            cerr << "Usage: " << argv[0] << " [-o <file>] [options]\n" << SHAPE_USAGE;
+            return 1;
+        }
+    }
+
+    FILE *out = path ? fopen(path, "wb") : stdout;
+    if (!out){
+        cerr << "Error: Unable to write " << path << endl;
+        return 1;
+    }
+
+    ProgramGenerator generator(shape);
+    string buffer;
+    bool more = true;
+    while (more){
+        buffer.clear();
+        while (buffer.size() < (1 << 20) && (more = generator.next(buffer)));
+        if (fwrite(buffer.data(), 1, buffer.size(), out) != buffer.size()) more = false;
+    }
+    bool written = !ferror(out);
+    if (path) written = !fclose(out) && written;
+
+    const ProgramTally &tally = generator.tally();
+    cerr << tally.lines << " lines, " << tally.bytes << " bytes: " << tally.labels << " labels, " << tally.forward << " forward and "
+         << tally.backward << " backward jumps, " << tally.errors << " errors" << endl;
+    if (!written){
+        cerr << "Error: Unable to write " << (path ? path : "the standard output") << endl;
+        return 1;
+    }
+    return 0;
+}
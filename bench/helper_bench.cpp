@@ -0,0 +1,245 @@
+/*
+ * Helper microbenchmark
+ *
+ * Times each of the helpers the passes spend their time in, on its own, against typical inputs and
+ * against inputs made to be their worst case:
+ *   sanitizeLine, strip, isValidLabel, findOpcode, instructionCheck and parse, and the hexBinConversion
+ *   the binary file used to be written with
+ * Each case reports the time, the heap allocations (counted by replacing operator new) and, on Linux where
+ * the kernel lets perf_event_open() count them, the instructions it takes per call.
+ *
+ * Usage: ./bin/helper_bench [name filter, e.g. parse] [milliseconds per case, default 100]
+ */
+
+#include "assembler.h"
+#include "opcodes.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Every allocation of the program goes through here, the benchmarks being single threaded
+static size_t allocations = 0;
+
+void *operator new(size_t size){
+    allocations++;
+    if (void *p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+// Instructions retired in user space, if the kernel lets them be counted
+class InstructionCounter {
+public:
+    InstructionCounter(){
+#ifdef __linux__
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+    }
+    ~InstructionCounter(){
+#ifdef __linux__
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    bool available() const { return fd >= 0; }
+
+    void start(){
+#ifdef __linux__
+        if (fd < 0) return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    uint64_t stop(){
+        uint64_t count = 0;
+#ifdef __linux__
+        if (fd < 0) return 0;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &count, sizeof(count)) != sizeof(count)) count = 0;
+#endif
+        return count;
+    }
+
+private:
+    int fd = -1;
+};
+
+// Keeps the results of the helpers alive, so the calls can't be optimized away
+static volatile size_t sink;
+
+struct Case {
+    string name;
+    function<void()> call;
+};
+
+static AssemblerContext labelled;           // Knows the labels the statements jump to
+static EncodedRun run;
+
+static Case sanitizeCase(const string &name, string text){
+    return {"sanitizeLine/" + name, [text]{ sink = sink + sanitizeLine(text).size(); }};
+}
+
+static Case stripCase(const string &name, string text){
+    return {"strip/" + name, [text]{ sink = sink + strip(text).size(); }};
+}
+
+static Case labelCase(const string &name, string text){
+    return {"isValidLabel/" + name, [text]{ sink = sink + isValidLabel(text); }};
+}
+
+static Case opcodeCase(const string &name, string text){
+    return {"findOpcode/" + name, [text]{ sink = sink + (findOpcode(text) != nullptr); }};
+}
+
+// `statement` is split the way parse() does, then checked again on every call
+static Case checkCase(const string &name, string statement){
+    auto text = make_shared<string>(statement);
+    Instruction instr;
+    string_view rest = *text;
+    size_t comma = rest.find(',');
+    instr.opcode = findOpcode(rest.substr(0, comma));
+    instr.reg_num = 0;
+    while (comma != string_view::npos){
+        rest = rest.substr(comma + 1);
+        comma = rest.find(',');
+        string_view operand = rest.substr(0, comma);
+        if (operand.size() > 1 && (operand[0] == 'R') && operand[1] >= '0' && operand[1] <= '9' && instr.reg_num < 3) instr.registers[instr.reg_num++] = operand;
+        else instr.dataline = operand;
+    }
+    return {"instructionCheck/" + name, [text, instr]{
+        Instruction copy = instr;
+        sink = sink + instructionCheck(copy, labelled);
+    }};
+}
+
+static Case parseCase(const string &name, string statement){
+    auto text = make_shared<string>(statement);
+    return {"parse/" + name, [text]{
+        SourceLine line = {*text, LINE_STATEMENT, 1, 0};
+        Word word = 0;
+        run.diagnostics.clear();
+        sink = sink + parse(labelled, run, 1, line, "LOOP", word) + word;
+    }};
+}
+
+// The conversion of a hex digit the binary file was written with before the words were emitted whole (see emit.h)
+static string hexBinConversion(char c){
+    if (c >= '0' && c <= '9') return BIN_NIBBLES[c - '0'];
+    if (c >= 'A' && c <= 'F') return BIN_NIBBLES[c - 'A' + 10];
+    return "xxxx";
+}
+
+static Case hexCase(const string &name, char c){
+    return {"hexBinConversion/" + name, [c]{ sink = sink + hexBinConversion(c).size(); }};
+}
+
+static vector<Case> makeCases(){
+    string spaces(4096, ' ');
+    string tabs;
+    for (int i = 0; i < 2048; i++) tabs += " \t";
+    string slashes;
+    for (int i = 0; i < 1024; i++) slashes += "/ ";
+    string long_name(1024, 'A');
+    string long_register = "R" + string(1000, '0') + "1";
+    string many_operands = "ADD";
+    for (int i = 0; i < 200; i++) many_operands += ",R1";
+
+    labelled.labels.insert("LOOP", 12);
+    labelled.labels.insert("FAR", 300);
+
+    return {
+        sanitizeCase("statement", "    ADD,R1,R2,R3;"),
+        sanitizeCase("comment", "\tload, r2, 1F;   // load the counter"),
+        sanitizeCase("4k spaces", spaces),
+        sanitizeCase("4k slashes", slashes),
+        stripCase("statement", "  \tMOVI,R4,FF ;  "),
+        stripCase("4k tabs", tabs),
+        labelCase("label", "LOOP_12:"),
+        labelCase("spaced", "LOOP   :"),
+        labelCase("reserved", "JMPPCRNZ:"),
+        labelCase("semicolon", "LOOP:;"),
+        labelCase("1k name", long_name + ":"),
+        opcodeCase("ADD", "ADD"),
+        opcodeCase("jmppcrnz", "jmppcrnz"),
+        opcodeCase("miss", "START"),
+        opcodeCase("1k miss", long_name),
+        checkCase("registers", "ADD,R1,R2,R3"),
+        checkCase("hex", "MOVI,R4,FF"),
+        checkCase("label", "JMP,LOOP"),
+        checkCase("out of range", "JMP,FAR"),
+        checkCase("1k register", "MOV," + long_register + ",R2"),
+        parseCase("registers", "ADD,R1,R2,R3"),
+        parseCase("spaced", "add , r1 , R2 , R3 "),
+        parseCase("label", "JMP,LOOP"),
+        parseCase("bad opcode", "ADDX,R1,R2,R3"),
+        parseCase("200 operands", many_operands),
+        hexCase("digit", '7'),
+        hexCase("letter", 'F'),
+        hexCase("bad", 'x'),
+    };
+}
+
+int main(int argc, char **argv){
+    string filter = (argc > 1) ? argv[1] : "";
+    double budget = ((argc > 2) ? atof(argv[2]) : 100) / 1e3;
+    InstructionCounter counter;
+    vector<Case> cases = makeCases();
+
+    cout << left << fixed;
+    cout << setw(32) << "case" << right << setw(12) << "ns/op" << setw(12) << "allocs/op" << setw(14) << "instr/op" << '\n';
+
+    for (const Case &c: cases){
+        if (c.name.find(filter) == string::npos) continue;
+
+        // Doubles the calls until they take long enough to be timed
+        size_t calls = 1;
+        double seconds = 0;
+        size_t allocated = 0;
+        uint64_t instructions = 0;
+        for (c.call(); ; calls *= 2){
+            allocated = allocations;
+            counter.start();
+            auto start = chrono::steady_clock::now();
+            for (size_t i = 0; i < calls; i++) c.call();
+            seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            instructions = counter.stop();
+            allocated = allocations - allocated;
+            if (seconds >= budget) break;
+        }
+
+        cout << left << setw(32) << c.name << right << setprecision(1) << setw(12) << seconds * 1e9 / calls
+             << setprecision(2) << setw(12) << double(allocated) / calls;
+        if (counter.available()) cout << setprecision(0) << setw(14) << double(instructions) / calls << '\n';
+        else cout << setw(14) << "-" << '\n';
+    }
+    if (!counter.available()) cout << "Instructions can't be counted here (no perf_event_open)." << endl;
+    return 0;
+}
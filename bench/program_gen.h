@@ -0,0 +1,249 @@
+#ifndef PROGRAM_GEN_H
+#define PROGRAM_GEN_H
+
+/*
+ * Synthetic program generator, for the benchmarks
+ *
+ * Makes a program of any number of lines, one line at a time, so even 1e8 lines never sit in memory.
+ * The same shape and seed always give the same program, on every machine: the generator only draws
+ * from its own splitmix64 stream, never from the distributions of <random>.
+ *
+ * The shape sets the share of the lines that define a label, of the statements that jump to one and
+ * of those jumps that go to a label further on, of the lines that are comments or blank, of the lines
+ * with extra whitespace and lower case, and of the statements with an error. Errors are all ones of
+ * encoding (bad opcode, register out of range, missing semicolon, too few parameters), so the second
+ * pass still runs.
+ *
+ * A jump can only reach the labels at addresses 0 - 255, its dataline being 8 bits. The labels in that
+ * window are planned ahead, so a statement in it can jump forward to one of them; further on, every
+ * jump goes back to one of them. The labels past the window are defined but never jumped to.
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define JUMP_WINDOW 256         // Addresses a label can be jumped to from
+
+struct ProgramShape {
+    uint64_t lines = 100000;    // Of source, comment and blank lines included
+    double labels = 0.05;       // Share of the lines of code that define a label
+    double references = 0.2;    // Share of the statements that jump to a label
+    double forward = 0.5;       // Share of those jumps that go to a label defined further on, where there is one
+    double comments = 0.1;      // Share of the lines that are a comment or blank, and of the lines of code with a comment after them
+    double noise = 0.1;         // Share of the lines of code with extra whitespace and lower case
+    double errors = 0.0;        // Share of the statements with an error
+    uint64_t seed = 1;
+};
+
+// What a generated program is made of
+struct ProgramTally {
+    uint64_t bytes = 0;
+    uint64_t lines = 0;                 // Of source
+    uint64_t code = 0;                  // Lines of code, i.e, lines of the formatted code
+    uint64_t labels = 0;
+    uint64_t forward = 0;               // Jumps to a label further on
+    uint64_t backward = 0;              // Jumps to a label before
+    uint64_t errors = 0;                // Statements with an error
+};
+
+class ProgramGenerator {
+public:
+    explicit ProgramGenerator(const ProgramShape &shape) : shape(shape), state(shape.seed), layout(~shape.seed){
+        // Which lines are code is drawn on a stream of its own, so the lines of code the window ends up
+        // with are known before any is made: a short program may not reach the end of the window
+        uint64_t saved = layout, code = 0;
+        for (uint64_t line = 0; line < shape.lines && code < JUMP_WINDOW; line++) code += !chance(layout, shape.comments);
+        layout = saved;
+
+        // The labels of the jump window, drawn first so the statements before them can jump to them
+        for (size_t address = 0; address < code; address++)
+            if (chance(shape.labels)) window.push_back(address);
+    }
+
+    // Appends the next line, with its newline, to `out`. Returns false once all the lines were made.
+    bool next(std::string &out){
+        if (counts.lines == shape.lines) return false;
+        size_t start = out.size();
+        counts.lines++;
+
+        if (chance(layout, shape.comments)){
+            if (chance(0.5)) out += "// ---- " + std::to_string(counts.lines) + " ----";
+            out += '\n';
+            counts.bytes += out.size() - start;
+            return true;
+        }
+
+        bool noisy = chance(shape.noise);
+        bool label = isLabel(counts.code);
+        if (noisy) out += chance(0.5) ? "\t" : "      ";
+        else if (!label) out += "    ";
+
+        if (label){
+            out += 'L' + std::to_string(counts.labels++);
+            out += noisy ? "  :" : ":";
+        }
+        else if (chance(shape.errors)){
+            appendError(out, noisy);
+            counts.errors++;
+        }
+        else if (!chance(shape.references) || !appendJump(out)) appendStatement(out, noisy);
+
+        if (noisy) out += " \t ";
+        if (chance(shape.comments)) out += "    // note";
+        out += '\n';
+        counts.code++;
+        counts.bytes += out.size() - start;
+        return true;
+    }
+
+    const ProgramTally &tally() const { return counts; }
+
+private:
+    static uint64_t draw(uint64_t &state){
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+    static bool chance(uint64_t &state, double share){ return share > 0 && double(draw(state) >> 11) * 0x1.0p-53 < share; }
+    bool chance(double share){ return chance(state, share); }
+    unsigned pick(unsigned n){ return unsigned(draw(state) % n); }
+
+    bool isLabel(uint64_t address){
+        if (address >= JUMP_WINDOW) return chance(shape.labels);
+        return windowAt < window.size() && window[windowAt] == address && ++windowAt;
+    }
+
+    void appendRegister(std::string &out){ out += 'R' + std::to_string(pick(16)); }
+    void appendHex(std::string &out){
+        static const char DIGITS[] = "0123456789ABCDEF";
+        unsigned byte = pick(256);
+        out += DIGITS[byte >> 4];
+        out += DIGITS[byte & 15];
+    }
+
+    void appendMnemonic(std::string &out, std::string_view name, bool noisy){
+        size_t start = out.size();
+        out += name;
+        if (noisy) for (size_t i = start; i < out.size(); i++) out[i] = char(out[i] | 0x20);
+    }
+
+    // A valid statement of one of the operand layouts of the instruction set
+    void appendStatement(std::string &out, bool noisy){
+        static const char *THREE[] = {"ADD", "SUB", "AND", "OR", "EXOR", "SHIFTR", "SHIFTL"};
+        static const char *IMMEDIATE[] = {"ADDI", "ANDI", "ORI", "EXORI"};
+        static const char *TWO[] = {"MOV", "LOADI", "STOREI"};
+        static const char *DATA[] = {"MOVI", "LOAD"};
+        static const char *JUMP[] = {"JMP", "JMPZ", "JMPNZ", "JMPC", "JMPNC", "JMPPCRZ", "JMPPCRNZ"};
+        const char *comma = noisy ? " , " : ",";
+
+        switch (pick(9)){
+        case 0: appendMnemonic(out, "NOP", noisy); break;
+        case 1: case 2:
+            appendMnemonic(out, THREE[pick(7)], noisy);
+            for (int i = 0; i < 3; i++){ out += comma; appendRegister(out); }
+            break;
+        case 3:
+            appendMnemonic(out, IMMEDIATE[pick(4)], noisy);
+            out += comma; appendRegister(out); out += comma; appendRegister(out); out += comma; appendHex(out);
+            break;
+        case 4:
+            appendMnemonic(out, TWO[pick(3)], noisy);
+            out += comma; appendRegister(out); out += comma; appendRegister(out);
+            break;
+        case 5:
+            appendMnemonic(out, DATA[pick(2)], noisy);
+            out += comma; appendRegister(out); out += comma; appendHex(out);
+            break;
+        case 6:
+            appendMnemonic(out, "STORE", noisy);
+            out += comma; appendHex(out); out += comma; appendRegister(out);
+            break;
+        case 7:
+            appendMnemonic(out, JUMP[pick(7)], noisy);
+            out += comma; appendHex(out);
+            break;
+        default:
+            appendMnemonic(out, pick(2) ? "PUSH" : "POP", noisy);
+            out += comma; appendRegister(out);
+            break;
+        }
+        out += noisy ? " ;" : ";";
+    }
+
+    // A jump to a label of the window. Returns false if there is none to jump to from here.
+    bool appendJump(std::string &out){
+        static const char *JUMP[] = {"JMP", "JMPZ", "JMPNZ", "JMPC", "JMPNC"};
+        size_t before = windowAt;                       // Labels of the window defined so far
+        size_t after = window.size() - windowAt;
+        size_t label;
+
+        if (after && (!before || chance(shape.forward))){
+            label = before + pick(unsigned(after));
+            counts.forward++;
+        }
+        else if (before){
+            label = pick(unsigned(before));
+            counts.backward++;
+        }
+        else return false;
+
+        out += JUMP[pick(5)];
+        out += ",L" + std::to_string(label) + ";";
+        return true;
+    }
+
+    void appendError(std::string &out, bool noisy){
+        switch (pick(4)){
+        case 0: appendMnemonic(out, "ADDX,R1,R2,R3;", noisy); break;           // Invalid opcode
+        case 1: out += "MOV,R" + std::to_string(16 + pick(84)) + ",R2;"; break; // Register out of range
+        case 2: out += "ADD,R1,R2,R3"; break;                                   // Missing semicolon
+        default: out += "SUB,R4,R5;"; break;                                    // Too few parameters
+        }
+    }
+
+    ProgramShape shape;
+    uint64_t state;
+    uint64_t layout;                    // Draws which lines are code, and which comments or blank
+    std::vector<size_t> window;         // Addresses of the labels in the jump window
+    size_t windowAt = 0;                // Labels of the window defined so far
+    ProgramTally counts;
+};
+
+// Reads an option of the shape, "--lines 1e6", "--labels 0.05" ..., at argv[i], moving `i` past its value.
+// Returns false if argv[i] is not one.
+inline bool parseShapeOption(int argc, char **argv, int &i, ProgramShape &shape){
+    static const struct { const char *name; double ProgramShape::*share; } SHARES[] = {
+        {"--labels", &ProgramShape::labels}, {"--references", &ProgramShape::references}, {"--forward", &ProgramShape::forward},
+        {"--comments", &ProgramShape::comments}, {"--noise", &ProgramShape::noise}, {"--errors", &ProgramShape::errors}
+    };
+    std::string_view name = argv[i];
+    if (i + 1 >= argc) return false;
+
+    if (name == "--lines") shape.lines = uint64_t(std::strtod(argv[++i], nullptr));     // Takes 1e6 as well as 1000000
+    else if (name == "--seed") shape.seed = std::strtoull(argv[++i], nullptr, 10);
+    else {
+        for (const auto &share: SHARES){
+            if (name != share.name) continue;
+            shape.*share.share = std::strtod(argv[++i], nullptr);
+            return true;
+        }
+        return false;
+    }
+    return true;
+}
+
+#define SHAPE_USAGE \
+    "  --lines <n>         Lines of source, 1e6 works (default 100000)\n" \
+    "  --labels <share>    Of the lines of code that define a label (default 0.05)\n" \
+    "  --references <share> Of the statements that jump to a label (default 0.2)\n" \
+    "  --forward <share>   Of the jumps that go to a label further on, where there is one (default 0.5)\n" \
+    "  --comments <share>  Of the lines that are comments or blank (default 0.1)\n" \
+    "  --noise <share>     Of the lines with extra whitespace and lower case (default 0.1)\n" \
+    "  --errors <share>    Of the statements with an error (default 0)\n" \
+    "  --seed <n>          Of the generator (default 1)\n"
+
+#endif // PROGRAM_GEN_H
@@ -0,0 +1,169 @@
+/*
+ * Line scanning benchmark
+ *
+ * Compares the ways of splitting a source into lines and finding their comment, colon and semicolon:
+ *   string      - std::getline into a std::string, then find("//"), toUpper, strip, find(':'), find(';')
+ *                 and count(';') per line, as the assembler used to
+ *   string_view - nextLine() and sanitizeLine() on views of the source, then find(':') and find(';')
+ *   scanner     - LineScanner, with every kernel the CPU supports
+ *
+ * Usage: ./bin/scan_bench [megabytes of source, default 16] [runs, default 5]
+ */
+
+#include "assembler.h"
+#include "scan.h"
+#include "source.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+// What every variant has to agree on
+struct Tally {
+    size_t lines = 0;           // Non-blank lines
+    size_t labels = 0;          // Lines with a colon
+    size_t statements = 0;      // Lines with a semicolon and no colon
+    size_t bytes = 0;           // Characters left after removing comments and spaces
+
+    bool operator==(const Tally &o) const { return lines == o.lines && labels == o.labels && statements == o.statements && bytes == o.bytes; }
+};
+
+// Synthetic source, a mix of the kinds of lines real programs have
+static string makeSource(size_t size){
+    static const char *LINES[] = {
+        "LOOP_%:", "  ADD,R1,R2,R3;", "\tload, r2, 1F;   // load the counter", "STORE,R3,05;", "JMPZ,LOOP_%;",
+        "", "// ---- block % ----", "  MOVI,R4,FF ;", "out,R4,F8;", "NOP;", "SUB,R1,R2,R3"
+    };
+    string source;
+    uint32_t seed = 12345;
+
+    source.reserve(size + 64);
+    for (size_t n = 0; source.size() < size; n++){
+        seed = seed * 1103515245 + 12345;
+        string line = LINES[(seed >> 16) % (sizeof(LINES) / sizeof(LINES[0]))];
+        size_t mark = line.find('%');
+        if (mark != string::npos) line.replace(mark, 1, to_string(n));
+        source += line;
+        source += '\n';
+    }
+    return source;
+}
+
+static string_view stripString(const string &s, string &out){
+    size_t start = s.find_first_not_of(" \t");
+    size_t end = s.find_last_not_of(" \t");
+    out = (start == string::npos) ? string() : s.substr(start, end - start + 1);
+    return out;
+}
+
+// The uppercasing the assembler did before the scanner folded case on the fly
+static void toUpper(string &s){
+    for (char &c: s){
+        if (c >= 'a' && c <= 'z') c = c - 32;
+    }
+}
+
+static Tally scanStrings(const string &source){
+    Tally t;
+    istringstream in(source);
+    string line;
+    string stripped;
+
+    while (getline(in, line)){
+        size_t comment = line.find("//");
+        if (comment != string::npos) line = line.substr(0, comment);
+        toUpper(line);
+        stripString(line, stripped);
+        if (stripped.empty()) continue;
+        t.lines++;
+        t.bytes += stripped.size();
+        if (stripped.find(':') != string::npos) t.labels++;
+        else if (stripped.find(';') != string::npos && count(stripped.begin(), stripped.end(), ';') > 0) t.statements++;
+    }
+    return t;
+}
+
+static Tally scanViews(const string &source){
+    Tally t;
+    string_view line;
+    size_t pos = 0;
+
+    while (nextLine(source, pos, line)){
+        line = sanitizeLine(line);
+        if (line.empty()) continue;
+        t.lines++;
+        t.bytes += line.size();
+        if (line.find(':') != string_view::npos) t.labels++;
+        else if (line.find(';') != string_view::npos) t.statements++;
+    }
+    return t;
+}
+
+static Tally scanBlocks(const string &source){
+    Tally t;
+    LineScanner scanner(source);
+    ScannedLine scanned;
+
+    while (scanner.next(scanned)){
+        string_view line = strip(scanned.text.substr(0, scanned.comment));
+        if (line.empty()) continue;
+        t.lines++;
+        t.bytes += line.size();
+        if (scanned.colon != SCAN_NONE) t.labels++;
+        else if (scanned.semicolon != SCAN_NONE) t.statements++;
+    }
+    return t;
+}
+
+// Best of `runs`, in MB/s
+template <typename F>
+static double measure(const string &source, int runs, F scan, Tally &tally){
+    double best = 0;
+    for (int r = 0; r < runs; r++){
+        auto start = chrono::steady_clock::now();
+        tally = scan(source);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        best = max(best, source.size() / seconds / 1e6);
+    }
+    return best;
+}
+
+int main(int argc, char **argv){
+    size_t megabytes = (argc > 1) ? strtoul(argv[1], nullptr, 10) : 16;
+    int runs = (argc > 2) ? atoi(argv[2]) : 5;
+    string source = makeSource(megabytes << 20);
+    Tally expected;
+    Tally tally;
+    bool agree = true;
+
+    cout << left << fixed << setprecision(1);
+    cout << "Source: " << source.size() << " bytes, best of " << runs << " runs\n";
+
+    double base = measure(source, runs, scanStrings, expected);
+    cout << "  " << setw(15) << "string" << base << " MB/s\n";
+
+    double views = measure(source, runs, scanViews, tally);
+    agree = agree && tally == expected;
+    cout << "  " << setw(15) << "string_view" << views << " MB/s  (x" << views / base << ")\n";
+
+    for (int kernel = 0; kernel < SCAN_KERNELS; kernel++){
+        if (!selectScanKernel(kernel)) continue;
+        double blocks = measure(source, runs, scanBlocks, tally);
+        agree = agree && tally == expected;
+        cout << "  " << setw(15) << "scanner/" + string(scanKernelName(kernel)) << blocks << " MB/s  (x" << blocks / base << ")\n";
+    }
+
+    if (!agree){
+        cout << "Error: The variants did not agree on the lines of the source." << endl;
+        return 1;
+    }
+    cout << "Best kernel on this machine: " << scanKernelName(bestScanKernel()) << endl;
+    return 0;
+}
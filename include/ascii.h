@@ -0,0 +1,29 @@
+#ifndef ASCII_H
+#define ASCII_H
+
+#include <string>
+#include <string_view>
+
+// The assembler is case-insensitive. Rather than making uppercase copies of
+// the source, every comparison folds ASCII case on the fly with these helpers.
+
+constexpr char upperChar(char c){
+    return (c >= 'a' && c <= 'z') ? c - 32 : c;
+}
+
+constexpr bool equalsIgnoreCase(std::string_view a, std::string_view b){
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) if (upperChar(a[i]) != upperChar(b[i])) return false;
+    return true;
+}
+
+// Uppercase copy, only meant for text that is written out (format file, error messages)
+inline std::string upperCopy(std::string_view s){
+    std::string out(s);
+    for (char &c: out) c = upperChar(c);
+    return out;
+}
+
+static_assert(equalsIgnoreCase("jmpPcRz", "JMPPCRZ") && !equalsIgnoreCase("JMP", "JMPZ"), "equalsIgnoreCase is broken");
+
+#endif // ASCII_H
@@ -2,43 +2,179 @@
 #define ASSEMBLER_H
 
 #include <string>
+#include <string_view>
 #include <array>
 #include <cstdint>
-#include <fstream>
-#include <map>
+#include <functional>
+#include <ostream>
+#include <vector>
+#include "ascii.h"
+#include "word.h"
+#include "opcodes.h"
+#include "symbols.h"
+#include "memo.h"
 
-struct Opcode{
-    /*
-    * The 2 LSB bit indicate total number of parameters needed for given opcode
-    * The next 2 indicate number of registers needed in parameters
-    * The next bit indicates whether a Dataline value is required
-    * The next bit indicates whether the Dataline can have a label in it.
-    */
-    unsigned char instr_num;
-    std::string opcode;
-    std::string hex;
+// Defining Error Codes
+// Codes 1 - 6 are found while labelling (first pass), 100 and above while encoding (second pass)
+#define LABEL_EMPTY 1
+#define LABEL_SEMICOLON 2
+#define LABEL_NO_COLON 3
+#define LABEL_RESERVED 4
+#define LABEL_INVALID_NAME 5
+#define LABEL_DUPLICATE 6
+
+#define INVALID_LINE 100
+#define INVALID_OPCODE 101
+#define INVALID_DATALINE 102
+#define REG_W_INVALID_REFERENCE 103
+#define REG_RX_INVALID_REFERENCE 104
+#define REG_RY_INVALID_REFERENCE 105
+#define REG_W_OUT_OF_RANGE 106
+#define REG_RX_OUT_OF_RANGE 107
+#define REG_RY_OUT_OF_RANGE 108
+#define JUMP_OUT_OF_RANGE 109
+#define INVALID_PARAM_NUM 110
+#define INVALID_REG_NUM 111
+#define INVALID_DAT_REF 112
+#define INVALID_LABEL_REF 113
+#define INVALID_LABEL_USE 114
+#define INVALID_INPUT_PORT 115
+#define INVALID_OUTPUT_PORT 116
+#define MISSING_SEMICOLON 117
+#define LINE_TOO_SHORT 118
+
+// Labels are case-insensitive, see symbols.h
+typedef SymbolTable LabelTable;
+
+// Kinds of lines kept in the line table after the first pass
+#define LINE_LABEL 0            // Label definition, `text` is the label name
+#define LINE_STATEMENT 1        // Statement terminated by a semicolon, `text` is everything before it
+#define LINE_UNTERMINATED 2     // Anything else, i.e, a statement missing its semicolon
+
+struct SourceLine {
+    std::string_view text;      // Sanitized text, a view into the source buffer in the case it was written
+    uint8_t kind;
+    uint32_t source_line;       // Line of the source file it came from, starting from 1
+    uint32_t column;            // Column of `text` in that line, starting from 0
 };
 
 struct Instruction {
     const Opcode *opcode;                                            // Opcode of the instruction
-    std::array<std::string, 3> registers = {"", "", ""};           // Registers used in the instruction
+    std::array<std::string_view, 3> registers = {};                 // Register operands as written, kept for error messages
     int reg_num;                                                   // Number of registers used in the instruction
-    std::string dataline;                                          // Data line of the instruction
+    std::string_view dataline;                                     // Data line operand as written, kept for error messages
+    Word word = 0;                                                 // Packed encoding, filled in by instructionCheck()
+    SymbolId label = NO_SYMBOL;                                    // Label the dataline was resolved to, if any
+};
+
+// One error, kept as data so it can be rendered as text, JSON or SARIF (see diagnostics.h)
+struct Diagnostic {
+    size_t line;                // Line of the formatted code, starting from 1
+    size_t position;            // Entries written before it: lines of the format file for labelling errors, words of the hex file otherwise
+    uint8_t code;
+    size_t source_line;         // Line of the source file, starting from 1
+    size_t column_begin;        // Span of the offending text in that line, starting from 1, end exclusive
+    size_t column_end;
+    std::string block;          // Label of the block it was found in, empty if none
+    std::string message;
+    std::string hint;           // Further detail, empty if none
+};
+
+// Output of encoding a run of lines of the formatted code. The second pass of a large
+// program encodes several runs side by side, then merges them in order.
+struct EncodedRun {
+    std::vector<Word> words;
+    std::vector<Diagnostic> diagnostics;        // Positions are counted from the first word of the run
+    AssemblerStats stats;
+};
+
+// The passes split their input into chunks of at least this size, a few per thread.
+// Anything smaller than two chunks is assembled on the calling thread alone.
+#define CHUNK_MIN_BYTES (256 * 1024)            // Of source, for the first pass
+#define CHUNK_MIN_LINES 16384                   // Of formatted code, for the second pass
+#define CHUNKS_PER_THREAD 4
+
+class ThreadPool;
+
+struct AssemblerOptions {
+    bool binary = true;         // Generate the binary file
+    bool format = false;        // Write the format file
+    bool format_only = false;   // Stop after the first pass
+    bool memo = false;          // Encode repeated statements through the statement memo, see memo.h
+};
+
+/*
+ * Everything one assembly works on. Nothing is shared between contexts,
+ * so separate assemblies can run side by side, e.g. on different threads.
+ */
+struct AssemblerContext {
+    AssemblerOptions options;
+    LabelTable labels;                          // Label name to the address of its line
+    std::vector<SourceLine> lines;              // Formatted code, filled by firstPass()
+    std::vector<Word> words;                    // Encoded code, filled by secondPass()
+    std::vector<Diagnostic> diagnostics;        // In the order they were found
+    AssemblerStats stats;
+    bool error = false;
+
+    // Empties the context for the next assembly, holding on to the memory it already has
+    void clear(){
+        labels.clear();
+        lines.clear();
+        words.clear();
+        diagnostics.clear();
+        stats = AssemblerStats();
+        error = false;
+    }
+};
+
+struct Symbol {
+    std::string name;           // Label name, in uppercase
+    size_t address;             // Address of the line the label marks
+};
+
+// Outcome of assemble(), owns all its data so it outlives the source it was made from
+struct AssemblyResult {
+    std::vector<Word> words;
+    std::vector<Symbol> symbols;                // Sorted by name
+    std::vector<Diagnostic> diagnostics;
+    AssemblerStats stats;
+    bool error = false;
 };
 
 // Helper Functions
-void toUpper(std::string &s);
-std::string strip(const std::string &s);
-std::string sanitizeLine(const std::string &s);
+std::string_view strip(std::string_view s);
+std::string_view sanitizeLine(std::string_view s);
 
 // Check functions
-std::string hexBinConversion(char c);
-uint8_t isValidLabel(const std::string &s);
-bool isLabelRecorded(const std::string &s, const std::map<std::string, size_t> &labels);
+uint8_t isValidLabel(std::string_view s);
+uint8_t instructionCheck(Instruction &instr, const AssemblerContext &ctx);
 
 // Main Functions
-uint8_t parse(size_t line_num, const std::string &line, const std::string block_label, const std::map<std::string, size_t> &labels, std::ofstream &out_file); // Function to parse the instruction and check for errors
+uint8_t parse(const AssemblerContext &ctx, EncodedRun &run, size_t line_num, const SourceLine &line, std::string_view block_label, Word &word); // Function to parse the instruction and check for errors
+
+// Encodes line `index` of the formatted code the way the second pass does, a label line being encoded as 0.
+// Returns false if it has errors, which are recorded in the run. If `dataline` is given, it is set to the
+// dataline of the statement when it could be a label name (whether or not it is one), empty otherwise.
+// A statement with errors still has its dataline set, if it was read before the error was found.
+bool encodeLine(const AssemblerContext &ctx, EncodedRun &run, size_t index, std::string_view block_label, Word &word, std::string_view *dataline = nullptr);
+// Same as encodeLine(), for a line that isn't in the line table, `line_num` being the line of the formatted code it stands at
+bool encodeSourceLine(const AssemblerContext &ctx, EncodedRun &run, size_t line_num, const SourceLine &line, std::string_view block_label, Word &word, std::string_view *dataline = nullptr);
+
+// The passes run on `pool` when given and the input is large enough, the result being the same as without it
+void firstPass(AssemblerContext &ctx, std::string_view source, ThreadPool *pool = nullptr);    // Formats the source and records the labels
+void secondPass(AssemblerContext &ctx, ThreadPool *pool = nullptr);                           // Encodes the formatted code
+
+// For sources read a part at a time. Runs the first pass over `batch`, whole lines of the source that come after
+// `source_base` lines of it, on `scratch`. Then hands each label and statement line to `line` and each labelling error
+// to `error`, in the order of their lines and numbered from the start of the source. The labels are left to the
+// caller to record, a label defined twice within the batch being handed over as a label line as well.
+void scanBatch(AssemblerContext &scratch, std::string_view batch, uint32_t source_base, const std::function<void(const SourceLine &)> &line,
+               const std::function<void(Diagnostic &)> &error);
+// Records the error of the label on `line` being defined again at line `line_num` of the formatted code, after line `defined_at`
+void reportDuplicate(std::vector<Diagnostic> &diagnostics, size_t line_num, size_t position, const SourceLine &line, size_t defined_at);
 
-extern bool ERR;
+// Library entry point. Runs both passes on an in-memory source, without touching any file.
+// The second pass is skipped if labelling failed, or if options.format_only is set.
+AssemblyResult assemble(std::string_view source, const AssemblerOptions &options = AssemblerOptions());
 
 #endif // ASSEMBLER_H
@@ -0,0 +1,49 @@
+#ifndef ASSEMBLER_C_H
+#define ASSEMBLER_C_H
+
+/*
+ * Flat C interface to libassembler, for callers that can't use the C++ API
+ * in assembler.h (C programs, Python ctypes, other FFIs).
+ *
+ * A result is created by assembler_assemble(), queried with the accessors below,
+ * and must be released with assembler_result_free(). Returned strings and arrays
+ * belong to the result and stay valid until it is freed.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct assembler_result assembler_result;
+
+// Returns NULL only if the result could not be allocated
+assembler_result *assembler_assemble(const char *source, size_t length, int format_only);
+void assembler_result_free(assembler_result *result);
+
+int assembler_result_failed(const assembler_result *result);           // 1 if any error was found
+
+size_t assembler_result_word_count(const assembler_result *result);
+const uint32_t *assembler_result_words(const assembler_result *result);
+
+size_t assembler_result_symbol_count(const assembler_result *result);
+const char *assembler_result_symbol_name(const assembler_result *result, size_t index);
+size_t assembler_result_symbol_address(const assembler_result *result, size_t index);
+
+size_t assembler_result_diagnostic_count(const assembler_result *result);
+size_t assembler_result_diagnostic_line(const assembler_result *result, size_t index);         // Line of the source, starting from 1
+int assembler_result_diagnostic_code(const assembler_result *result, size_t index);
+size_t assembler_result_diagnostic_column(const assembler_result *result, size_t index);       // Starting from 1
+const char *assembler_result_diagnostic_block(const assembler_result *result, size_t index);
+const char *assembler_result_diagnostic_message(const assembler_result *result, size_t index);
+const char *assembler_result_diagnostic_hint(const assembler_result *result, size_t index);       // Empty if there is none
+
+const char *assembler_version(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ASSEMBLER_C_H
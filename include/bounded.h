@@ -0,0 +1,68 @@
+#ifndef BOUNDED_H
+#define BOUNDED_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "assembler.h"
+
+/*
+ * Bounded-memory assembly
+ *
+ * --low-memory assembles a source of any size in memory that doesn't grow with it, beyond the labels.
+ * The first pass reads the file a block at a time, keeping only the addresses of the labels, and an
+ * entry of the line index every LINE_INDEX_INTERVAL lines of formatted code: where that line starts in
+ * the file, and the block it is in. The second pass reads the file again the same way, encoding each
+ * statement as it comes, and the words go out through the fixed buffers of image streams (see emit.h).
+ *
+ * The line index lets the second pass start anywhere an entry is, so a large file can be encoded in
+ * parts side by side, each writing its words in place into images where every word has a fixed offset.
+ */
+
+#define LINE_INDEX_INTERVAL 65536       // Lines of formatted code between two entries of the line index
+
+struct LineIndexEntry {
+    uint64_t offset = 0;                // Of the source line in the file
+    uint32_t source_lines = 0;          // Lines of the source before it
+    size_t line = 0;                    // Lines of formatted code before it
+    std::string block;                  // Label of the block it is in
+};
+
+struct BoundedStats {
+    uint64_t bytes = 0;                 // Of source, read by the first pass
+    uint32_t source_lines = 0;
+    size_t words = 0;                   // Lines of formatted code, which a clean assembly has as many words as
+    size_t parts = 0;                   // The second pass was split in, 1 if it ran on the calling thread alone
+};
+
+class BoundedAssembler {
+public:
+    explicit BoundedAssembler(const AssemblerOptions &options);
+
+    // First pass. Records the labels and the line index, and the labelling errors if there are any.
+    // Returns false if the file could not be read.
+    bool labelPass(const std::string &path);
+
+    // Second pass over the lines from entry `from` of the line index, up to the entry after `to`, or the
+    // end of the file if that is the last one. Each word goes to `word` as it is encoded, and each error to
+    // `error`, with its position counted from the line of `from`. Stops at the first error if `error`
+    // returns false. Returns false if the file could not be read. Can be called from several threads at once.
+    bool encodePass(const std::string &path, size_t from, size_t to, const std::function<void(Word)> &word,
+                    const std::function<bool(Diagnostic &)> &error) const;
+
+    bool error() const { return ctx.error; }
+    const std::vector<Diagnostic> &diagnostics() const { return ctx.diagnostics; }     // Of labelling
+    const std::vector<LineIndexEntry> &lineIndex() const { return index; }
+    const LabelTable &labels() const { return ctx.labels; }
+    BoundedStats &stats() { return counters; }
+
+private:
+    AssemblerContext ctx;                   // Labels, and the labelling errors
+    std::vector<LineIndexEntry> index;
+    BoundedStats counters;
+};
+
+#endif // BOUNDED_H
@@ -0,0 +1,94 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include "emit.h"
+
+/*
+ * Build cache
+ *
+ * The files generated by a clean assembly are stored in a directory keyed by a hash of the source,
+ * the assembler version and the options that shape the output. A later assembly of the same source
+ * with the same options places the stored files where they belong, by reflink where the file system
+ * allows it and by copy otherwise, without running either pass.
+ *
+ * Each entry is a directory named after its key, holding one file per generated file. It is written
+ * under a temporary name and renamed into place, so other processes sharing the cache only ever see
+ * whole entries. The temporary directories are never taken for entries, and are only removed once the
+ * process that made them is gone, or after CACHE_STALE_SECONDS when it ran on another machine. The
+ * modification time of an entry is bumped on every hit, and once the cache grows past its size limit
+ * the entries used the longest ago are removed first.
+ *
+ * A development build ("dev") has no version telling its encoding apart from the next build's, so the
+ * key of one is also made of the size and modification time of the binary it was loaded from.
+ *
+ * The hash isn't cryptographic, the cache directory is trusted as much as the sources are.
+ */
+
+// Files of an entry: the images, indexed by their format (see emit.h), then the format file
+#define CACHE_FORMAT_FILE IMAGE_FORMATS
+#define CACHE_FILES (IMAGE_FORMATS + 1)
+#define CACHE_FILE_BIT(file) (1u << (file))
+
+#define CACHE_DEFAULT_SIZE (256ull << 20)
+
+#define CACHE_TEMPORARY_PREFIX "tmp-"           // Followed by <pid>-<n>-<host>, entries being written
+#define CACHE_STALE_SECONDS (60 * 60)           // Age past which a temporary directory is taken as abandoned
+
+struct CacheKey {
+    uint64_t high = 0;
+    uint64_t low = 0;
+
+    std::string hex() const;        // 32 hex digits, the name of the entry
+};
+
+// Hashes the source along with the assembler version and `options`, a description of the options that shape the output
+CacheKey cacheKey(std::string_view source, std::string_view options);
+
+struct CacheStats {
+    size_t lookups = 0;
+    size_t hits = 0;
+    size_t stores = 0;
+    size_t evictions = 0;
+    uint64_t evicted_bytes = 0;
+    size_t entries = 0;             // In the cache as of the call to stats()
+    uint64_t bytes = 0;
+};
+
+// Safe to share between threads, and the directory between processes
+class BuildCache {
+public:
+    // Creates the directory if needed. Returns false if it can't be used.
+    bool open(const std::string &dir, uint64_t max_bytes = CACHE_DEFAULT_SIZE);
+    bool isOpen() const { return !root.empty(); }
+
+    // Whether there is an entry for `key` holding exactly the files in `files` (a mask of CACHE_FILE_BIT()s).
+    // A hit marks the entry as just used.
+    bool lookup(const CacheKey &key, unsigned files);
+    // Places file `file` of the entry at `path`. Returns false if it could not, e.g, the entry was evicted meanwhile.
+    bool materialize(const CacheKey &key, int file, const std::string &path);
+    // Adds an entry holding the files in `files`, `data` being indexed by file. Evicts old entries if the cache grew too large.
+    void store(const CacheKey &key, unsigned files, const std::string_view data[CACHE_FILES]);
+
+    CacheStats stats();
+
+private:
+    void evict();
+    void sweep();                               // Removes the temporary directories left behind by others
+    uint64_t scan(size_t *entries = nullptr);   // Bytes held by the cache
+
+    std::string root;
+    uint64_t max_bytes = CACHE_DEFAULT_SIZE;
+    std::mutex mutex;                           // Guards `bytes` and eviction
+    uint64_t bytes = 0;                         // Estimate of the size of the cache, rescanned when evicting
+    std::atomic<size_t> lookups{0}, hits{0}, stores{0}, evictions{0};
+    std::atomic<uint64_t> evicted_bytes{0};
+    std::atomic<unsigned> temporaries{0};       // Names the temporary entries of this process apart
+};
+
+#endif // CACHE_H
@@ -0,0 +1,39 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "assembler.h"
+
+// Ways diagnostics can be rendered, chosen with -d / --diagnostics
+#define DIAGNOSTICS_TEXT 0      // Written into the format or hex file, in place of the lines they were found at
+#define DIAGNOSTICS_JSON 1
+#define DIAGNOSTICS_SARIF 2
+
+// Short name of an error code, e.g. "Invalid opcode"
+const char *diagnosticName(uint8_t code);
+
+// Renders a diagnostic the way it is written into the format and hex files
+std::string renderText(const Diagnostic &d);
+
+// Quotes `s` as a JSON string
+std::string jsonEscape(std::string_view s);
+
+// Machine readable renderings of all diagnostics of one source file
+void writeDiagnosticsJson(std::ostream &out, std::string_view file, const std::vector<Diagnostic> &diagnostics);
+void writeDiagnosticsSarif(std::ostream &out, std::string_view file, const std::vector<Diagnostic> &diagnostics);
+
+// Diagnostics of one source file, for reports covering several
+struct FileDiagnostics {
+    std::string file;
+    std::vector<Diagnostic> diagnostics;
+};
+
+// Machine readable renderings of several source files, in the order given.
+// JSON is an array of the single file objects, SARIF a single run with one artifact per file.
+void writeDiagnosticsJson(std::ostream &out, const std::vector<FileDiagnostics> &files);
+void writeDiagnosticsSarif(std::ostream &out, const std::vector<FileDiagnostics> &files);
+
+#endif // DIAGNOSTICS_H
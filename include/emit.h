@@ -0,0 +1,102 @@
+#ifndef EMIT_H
+#define EMIT_H
+
+#include "assembler.h"
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+#include <fstream>
+#endif
+
+/*
+ * Output emitters
+ *
+ * Every output image is produced straight from the encoded words of an AssemblerContext.
+ * Each word is formatted with the nibble tables of word.h into an in-memory buffer, all the
+ * requested images being filled in a single sweep over the words. Each buffer then goes to
+ * its file with one write().
+ *
+ * Assemblies that learn their words one at a time (see stream.h) write them through an
+ * ImageStream instead, which holds no more than STREAM_BUFFER_SIZE bytes of the image.
+ */
+
+// Image formats
+#define IMAGE_HEX 0             // Logisim "v2.0 raw" file, 7 hex digits per word
+#define IMAGE_BINARY 1          // 25 binary digits per word
+#define IMAGE_RAW 2             // 4 bytes per word, little endian
+#define IMAGE_INTEL_HEX 3       // Intel HEX records of the raw image
+#define IMAGE_READMEMH 4        // Verilog $readmemh, 7 hex digits per word
+#define IMAGE_READMEMB 5        // Verilog $readmemb, 25 binary digits per word
+#define IMAGE_LOGISIM_RLE 6     // Logisim "v2.0 raw" file with runs of a word collapsed to N*value
+#define IMAGE_FORMATS 7
+
+#define IMAGE_BIT(format) (1u << (format))
+
+#define STREAM_BUFFER_SIZE (64 * 1024)     // Bytes an ImageStream holds before writing them out
+
+struct Images {
+    std::string buffers[IMAGE_FORMATS];     // Indexed by the image format
+};
+
+// Fills the buffer of every format set in `formats` (a mask of IMAGE_BIT()s).
+// If `with_errors` is set, the text diagnostics are placed in the hex image in place of the lines they were found at.
+void emitImages(const AssemblerContext &ctx, unsigned formats, bool with_errors, Images &images);
+
+// Returns the formatted code, with labelling errors in place of the lines they were found at if `with_errors` is set
+std::string emitFormat(const AssemblerContext &ctx, bool with_errors);
+
+// Looks up an image format selectable by name (raw, ihex, memh, memb, rle). Returns -1 if there is none.
+int imageFormat(std::string_view name);
+const char *imageName(int format);
+const char *imageExtension(int format);     // Default file extension, with the dot
+bool imageIsBinary(int format);             // Whether the image is bytes rather than text
+bool imageIsPatchable(int format);          // Whether each word of the image sits at a fixed offset of its file
+
+// Rewrites the words at `indices` in place in the image file at `path`, which must hold exactly `words`
+// in all other places. Returns false if it could not, e.g, the image isn't patchable or the file has another size.
+bool patchImage(const std::string &path, int format, const std::vector<Word> &words, const std::vector<size_t> &indices);
+
+// Replaces the file at `path` with `data` in a single write(). Returns false if the file could not be written.
+// Text data gets the platform's line endings, binary data is written untouched. "-" writes to the standard output.
+bool writeFile(const std::string &path, std::string_view data, bool binary = false);
+
+struct EmitState;
+
+// Writes one image a word at a time, through a buffer of fixed size. "-" writes to the standard output.
+class ImageStream {
+public:
+    ImageStream();
+    ~ImageStream();
+    ImageStream(const ImageStream &) = delete;
+    ImageStream &operator=(const ImageStream &) = delete;
+
+    bool open(const std::string &path, int format);    // Returns false if the file could not be created
+    // Opens the image at `path`, already created, to write on from word `index`. Only for patchable images,
+    // so several streams can fill the parts of one image side by side.
+    bool openAt(const std::string &path, int format, size_t index);
+    bool put(Word w);                                   // Writes the buffer out once full. Returns false once writing failed.
+    void putDiagnostic(const Diagnostic &d);            // Writes `d` in place, if the image carries the errors (the hex image does)
+    bool flush();                                       // Writes out what is buffered, so a reader sees every word put so far
+    bool close();                                       // Ends the image. Returns false if any of it could not be written.
+    uint64_t written() const { return bytes; }          // Bytes written out since it was opened
+
+private:
+#ifndef _WIN32
+    bool isOpen() const { return fd >= 0; }
+    int fd = -1;
+#else
+    bool isOpen() const { return opened; }
+    std::unique_ptr<std::ofstream> file;                // None for the standard output
+    bool opened = false;
+#endif
+    int format = 0;
+    bool ok = false;
+    uint64_t bytes = 0;
+    std::string buffer;
+    std::unique_ptr<EmitState> state;
+};
+
+#endif // EMIT_H
@@ -0,0 +1,53 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*
+ * JSON values
+ *
+ * Just enough of a reader for the messages of the language server (see lsp.h). Everything written
+ * elsewhere is put together by hand with jsonEscape(), as are the answers of the language server,
+ * except for values echoed back as they came, such as request IDs.
+ */
+
+#define JSON_NULL 0
+#define JSON_BOOLEAN 1
+#define JSON_NUMBER 2
+#define JSON_STRING 3
+#define JSON_ARRAY 4
+#define JSON_OBJECT 5
+
+#define JSON_MAX_DEPTH 64                   // Nesting the reader accepts, arrays and objects alike
+
+struct JsonValue {
+    uint8_t type = JSON_NULL;
+    bool boolean = false;
+    double number = 0;
+    std::string string;
+    std::vector<JsonValue> items;                               // Of an array
+    std::vector<std::pair<std::string, JsonValue>> members;     // Of an object, in the order written
+
+    // Member `key` of an object, or a null value if there is no such member
+    const JsonValue &operator[](std::string_view key) const;
+    // Item `i` of an array, or a null value if out of range
+    const JsonValue &operator[](size_t i) const;
+
+    bool isNull() const { return type == JSON_NULL; }
+    int64_t asInt(int64_t fallback = 0) const { return type == JSON_NUMBER ? int64_t(number) : fallback; }
+    bool asBool(bool fallback = false) const { return type == JSON_BOOLEAN ? boolean : fallback; }
+    std::string_view asString() const { return string; }          // Empty unless a string
+};
+
+// Reads the JSON document `text` into `value`. Returns false if it isn't valid JSON.
+bool parseJson(std::string_view text, JsonValue &value);
+
+// Writes `value` back as JSON
+void writeJson(std::ostream &out, const JsonValue &value);
+
+#endif // JSON_H
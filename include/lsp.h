@@ -0,0 +1,106 @@
+#ifndef LSP_H
+#define LSP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "assembler.h"
+
+/*
+ * Language server
+ *
+ * --lsp speaks the Language Server Protocol over stdin and stdout, so editors can show the errors of
+ * a source as it is typed, jump to the definition of a label and list the statements using it, and
+ * show what a statement encodes to on hover.
+ *
+ * Each source line of an open document is scanned on its own and the outcome kept. An edit only
+ * scans the lines it touches again. The labels are then recorded afresh from the lines kept, which
+ * reads no source, and only the statements that were edited, had errors, or use a label that was
+ * added, removed or moved are encoded again.
+ *
+ * Unlike an assembly, the statements are encoded even when the labels have errors, so all the
+ * errors of a source show at once. Characters are counted in bytes, which is what the UTF-16 code
+ * units of the protocol come to for the ASCII sources the assembler accepts.
+ */
+
+// What a source line of a document holds, besides the kinds of the line table (see assembler.h)
+#define LINE_BLANK 3            // Nothing, or only a comment
+#define LINE_BAD_LABEL 4        // Label that can't be recorded, which still takes an address
+
+struct DocumentLine {
+    uint8_t kind = LINE_BLANK;
+    uint32_t column = 0;                    // Of the text the line table keeps, as in SourceLine
+    uint32_t length = 0;
+    bool encoded = false;                   // Whether the word, the dataline and the errors are up to date
+    Word word = 0;
+    uint32_t dataline_column = 0;           // Of the dataline, if it could be a label name
+    uint32_t dataline_length = 0;
+    std::vector<Diagnostic> errors;         // Found scanning a bad label, or encoding a statement
+};
+
+// Lines and characters are counted from 0, as the protocol does
+struct DocumentPosition {
+    size_t line = 0;
+    size_t character = 0;
+};
+
+// Span of a single line, end exclusive
+struct DocumentRange {
+    size_t line = 0;
+    size_t begin = 0;
+    size_t end = 0;
+};
+
+// Work done by the last change of a document
+struct DocumentStats {
+    size_t scanned = 0;         // Source lines
+    size_t encoded = 0;         // Statements
+};
+
+class LspDocument {
+public:
+    void open(std::string text);
+    // Replaces the text from `start` to `end` with `text`. Positions past the end of a line, or of the
+    // document, stand for that end.
+    void edit(DocumentPosition start, DocumentPosition end, std::string_view text);
+
+    const std::string &content() const { return text; }
+    const DocumentStats &lastChange() const { return stats; }
+
+    // In the order of their lines, with source_line counted from 1
+    std::vector<Diagnostic> diagnostics() const;
+    // Definition of the label at `at`. Returns false if there is none.
+    bool definition(DocumentPosition at, DocumentRange &range) const;
+    // Datalines using the label at `at`, and its definition first if `declaration` is set
+    std::vector<DocumentRange> references(DocumentPosition at, bool declaration) const;
+    // Markdown describing the label or statement at `at`, empty if there is nothing to show
+    std::string hover(DocumentPosition at, DocumentRange &range) const;
+
+private:
+    size_t offsetOf(DocumentPosition at) const;
+    size_t lineOf(size_t offset) const;
+    std::string_view lineText(size_t line) const;
+    std::string_view wordAt(DocumentPosition at, DocumentRange &range) const;
+    void scan(size_t first, size_t last);
+    void analyze();
+
+    std::string text;
+    std::vector<size_t> starts;             // Offset of each source line in `text`, and the size of `text` last
+    std::vector<DocumentLine> lines;
+    AssemblerContext ctx;                   // Line table and labels of the last analysis
+    AssemblerContext scratch;               // Scans the lines edited
+    SymbolTable previous;                   // Labels before the last change
+    std::vector<size_t> definitions;        // Source line defining each label, by symbol ID
+    std::vector<Diagnostic> duplicates;     // Labels defined twice, in the order of their lines
+    DocumentStats stats;
+};
+
+// Serves the documents of one editor until it asks to exit, or `in` ends. Returns 0 if the editor
+// shut the server down first, 1 otherwise. With `verbose` set, the work each change took is logged.
+int runLanguageServer(std::istream &in, std::ostream &out, std::ostream &log, bool verbose = false);
+
+#endif // LSP_H
@@ -0,0 +1,64 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "word.h"
+#include "symbols.h"
+
+/*
+ * Statement memo
+ *
+ * Generated programs repeat the same few statements over and over. The memo maps the sanitized
+ * text of a statement that encoded cleanly to its word, so a repeat skips parsing and checking.
+ * A statement whose dataline is a label is kept as a template: the word with its DAT field left
+ * at 0, and where the label sits in the text, so the address is patched in from the labels of
+ * the assembly at hand. Statements with errors aren't kept, their messages are per line anyway.
+ */
+
+#define MEMO_MAX_ENTRIES (1 << 16)      // The memo starts over once it holds this many statements
+
+class StatementMemo {
+public:
+    // Whether `statement` is known, and if so its word. A template whose label isn't
+    // defined in `labels`, or is out of reach of the dataline, is reported as unknown.
+    // `patched` tells whether it was a template.
+    bool find(std::string_view statement, const SymbolTable &labels, Word &word, bool &patched) const;
+
+    void insertPlain(std::string_view statement, Word word);
+    // `label` is the dataline, a view into `statement`
+    void insertTemplate(std::string_view statement, std::string_view label, Word word);
+
+    size_t size() const { return entries.size(); }
+    void clear();
+
+private:
+    struct Entry {
+        Word word;
+        uint32_t label_offset;          // Of the label in the statement, only used if label_length isn't 0
+        uint32_t label_length;
+    };
+
+    void insert(std::string_view statement, const Entry &entry);
+
+    SymbolTable keys;                   // Statement to the index of its entry
+    std::vector<Entry> entries;
+};
+
+// Counters of one assembly, added up over the runs and files it is made of
+struct AssemblerStats {
+    size_t memo_lookups = 0;
+    size_t memo_hits = 0;
+    size_t memo_patched = 0;            // Hits that were templates
+
+    AssemblerStats &operator+=(const AssemblerStats &other){
+        memo_lookups += other.memo_lookups;
+        memo_hits += other.memo_hits;
+        memo_patched += other.memo_patched;
+        return *this;
+    }
+};
+
+#endif // MEMO_H
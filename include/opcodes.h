@@ -0,0 +1,150 @@
+#ifndef OPCODES_H
+#define OPCODES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include "ascii.h"
+
+struct Opcode{
+    /*
+    * The 2 LSB bit indicate total number of parameters needed for given opcode
+    * The next 2 indicate number of registers needed in parameters
+    * The next bit indicates whether a Dataline value is required
+    * The next bit indicates whether the Dataline can have a label in it.
+    */
+    unsigned char instr_num;
+    std::string_view opcode;
+    uint8_t code;
+};
+
+inline constexpr Opcode OP_TABLE[] = {
+    {0x00, "NOP", 0x00},
+    {0x0f, "AND", 0x01},
+    {0x0f, "OR", 0x02},
+    {0x0f, "EXOR", 0x03},
+    {0x0f, "ADD", 0x04},
+    {0x1b, "ANDI", 0x05},
+    {0x1b, "ORI", 0x06},
+    {0x1b, "EXORI", 0x07},
+    {0x1b, "ADDI", 0x08},
+    {0x0a, "MOV", 0x09},
+    {0x16, "MOVI", 0x0a},
+    {0x16, "LOAD", 0x0b},
+    {0x16, "STORE", 0x0c},
+    {0x31, "JMP", 0x0d},
+    {0x31, "JMPZ", 0x0e},
+    {0x31, "JMPNZ", 0x0f},
+    {0x31, "JMPC", 0x10},
+    {0x31, "JMPNC", 0x11},
+    {0x05, "PUSH", 0x12},
+    {0x05, "POP", 0x13},
+    {0x16, "IN", 0x14},
+    {0x16, "OUT", 0x15},
+    {0x0a, "LOADI", 0x16},
+    {0x0a, "STOREI", 0x17},
+    {0x0f, "SUB", 0x18},
+    {0x0f, "SHIFTR", 0x19},
+    {0x0f, "SHIFTL", 0x1a},
+    {0x11, "JMPPCRZ", 0x1b},
+    {0x11, "JMPPCRNZ", 0x1c}
+};
+
+inline constexpr size_t OP_TABLE_SIZE = sizeof(OP_TABLE) / sizeof(OP_TABLE[0]); // Should be 29 for now
+
+
+/*
+ * Opcode lookup
+ *
+ * Mnemonics are resolved through a perfect hash built at compile time:
+ * a seeded FNV-1a hash over the uppercased name, reduced to OPCODE_HASH_SLOTS slots.
+ * The first seed for which no two entries of OP_TABLE share a slot is picked
+ * by the compiler, so a lookup is one hash, one table read and one compare.
+ * Both the hash and the compare ignore case, so source text never has to be uppercased.
+ */
+inline constexpr size_t OPCODE_HASH_SLOTS = 64;
+
+constexpr size_t maxOpcodeLength(){
+    size_t max = 0;
+    for (const Opcode &op: OP_TABLE) if (op.opcode.size() > max) max = op.opcode.size();
+    return max;
+}
+
+inline constexpr size_t OPCODE_MAX_LENGTH = maxOpcodeLength();
+
+constexpr uint32_t opcodeHash(std::string_view name, uint32_t seed){
+    uint32_t h = 2166136261u ^ seed;
+    for (char c: name) h = (h ^ (unsigned char)upperChar(c)) * 16777619u;
+    return (h ^ (h >> 15)) % OPCODE_HASH_SLOTS;
+}
+
+constexpr bool opcodeSeedWorks(uint32_t seed){
+    bool used[OPCODE_HASH_SLOTS] = {};
+    for (const Opcode &op: OP_TABLE){
+        uint32_t slot = opcodeHash(op.opcode, seed);
+        if (used[slot]) return false;
+        used[slot] = true;
+    }
+    return true;
+}
+
+constexpr uint32_t findOpcodeSeed(){
+    for (uint32_t seed = 0; seed < 4096; seed++) if (opcodeSeedWorks(seed)) return seed;
+    return UINT32_MAX;
+}
+
+inline constexpr uint32_t OPCODE_HASH_SEED = findOpcodeSeed();
+
+struct OpcodeSlots {
+    uint8_t index[OPCODE_HASH_SLOTS];      // Index into OP_TABLE plus one, 0 marks an empty slot
+};
+
+constexpr OpcodeSlots buildOpcodeSlots(){
+    OpcodeSlots slots = {};
+    for (size_t i = 0; i < OP_TABLE_SIZE; i++) slots.index[opcodeHash(OP_TABLE[i].opcode, OPCODE_HASH_SEED)] = i + 1;
+    return slots;
+}
+
+inline constexpr OpcodeSlots OPCODE_SLOTS = buildOpcodeSlots();
+
+// Returns the matching entry of OP_TABLE, or nullptr if the name is not an opcode
+constexpr const Opcode* findOpcode(std::string_view name){
+    if (name.empty() || name.size() > OPCODE_MAX_LENGTH) return nullptr;
+    uint8_t index = OPCODE_SLOTS.index[opcodeHash(name, OPCODE_HASH_SEED)];
+    if (!index || !equalsIgnoreCase(OP_TABLE[index - 1].opcode, name)) return nullptr;
+    return &OP_TABLE[index - 1];
+}
+
+
+// Compile time checks on the table
+constexpr bool opcodeFlagsValid(){
+    for (const Opcode &op: OP_TABLE){
+        unsigned params = op.instr_num & 0x03;
+        unsigned regs = (op.instr_num >> 2) & 0x03;
+        unsigned dat = (op.instr_num >> 4) & 0x01;
+        unsigned label = (op.instr_num >> 5) & 0x01;
+
+        if (op.instr_num & 0xc0) return false;          // Only 6 flag bits are defined
+        if (params != regs + dat) return false;         // Every parameter is either a register or the dataline
+        if (label && !dat) return false;                // Labels can only be passed on the dataline
+    }
+    return true;
+}
+
+constexpr bool opcodeCodesValid(){
+    for (size_t i = 0; i < OP_TABLE_SIZE; i++){
+        if (OP_TABLE[i].code != i) return false;        // Table is ordered by code, with no gaps
+        if (OP_TABLE[i].code >= 0x20) return false;     // The processor only decodes 5 opcode bits
+    }
+    return true;
+}
+
+static_assert(OP_TABLE_SIZE == 29, "OP_TABLE should hold all 29 opcodes of the processor");
+static_assert(OPCODE_HASH_SEED != UINT32_MAX, "No collision free hash seed found for OP_TABLE");
+static_assert(opcodeFlagsValid(), "An instr_num in OP_TABLE has inconsistent flag bits");
+static_assert(opcodeCodesValid(), "OP_TABLE codes should be 0x00 - 0x1C in table order");
+static_assert(findOpcode("JMPPCRNZ") == &OP_TABLE[0x1c] && findOpcode("STOREI") == &OP_TABLE[0x17], "Opcode lookup is broken");
+static_assert(findOpcode("jmpPcRnz") == &OP_TABLE[0x1c], "Opcode lookup should ignore case");
+static_assert(!findOpcode("START") && !findOpcode("JMPPCRNZZ") && !findOpcode(""), "Opcode lookup accepts non opcodes");
+
+#endif // OPCODES_H
@@ -0,0 +1,60 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/*
+ * Vectorized line scanner
+ *
+ * Rather than searching every line for '\n', "//", ':' and ';' one after the other, the source is
+ * classified 64 bytes at a time into a bit mask of the positions holding any of '\n', '/', ':' or ';'.
+ * Walking the set bits gives, in one pass, where each line ends along with where its comment,
+ * first colon and first semicolon are.
+ *
+ * The masks are built with AVX2 or SSE2 when the CPU has them, chosen at runtime, and with plain
+ * C++ otherwise. All kernels give the same result.
+ */
+
+// Scanning kernels
+#define SCAN_SCALAR 0
+#define SCAN_SSE2 1
+#define SCAN_AVX2 2
+#define SCAN_KERNELS 3
+
+static constexpr uint32_t SCAN_NONE = UINT32_MAX;      // No such character in the line
+
+// One line of the text, offsets are counted from its start
+struct ScannedLine {
+    std::string_view text;      // Without its '\n', same as nextLine() gives
+    uint32_t comment;           // Start of "//", or SCAN_NONE
+    uint32_t colon;             // First ':' before the comment, or SCAN_NONE
+    uint32_t semicolon;         // First ';' before the comment, or SCAN_NONE
+};
+
+class LineScanner {
+public:
+    explicit LineScanner(std::string_view text);
+    bool next(ScannedLine &line);           // Same lines as nextLine(), false once the text is over
+
+private:
+    void load(size_t block);                // Classifies the 64 bytes starting at `block`
+
+    std::string_view text;
+    size_t pos = 0;                         // Start of the next line
+    size_t block = 0;                       // Start of the block `events` belongs to
+    uint64_t events = 0;                    // Positions of the block not looked at yet
+    uint64_t (*classify)(const char *p);    // Kernel, reads exactly 64 bytes
+};
+
+// Kernels. The one in use can be forced, e.g. to compare them, false if the CPU lacks it.
+int bestScanKernel();
+int scanKernel();
+bool selectScanKernel(int kernel);
+const char *scanKernelName(int kernel);
+
+// Uppercases `n` ASCII characters of `src` into `dst`, which may be the same
+void upperInto(char *dst, const char *src, size_t n);
+
+#endif // SCAN_H
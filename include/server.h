@@ -0,0 +1,72 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include "assembler.h"
+
+/*
+ * Assembler daemon
+ *
+ * --serve <socket> keeps the assembler running on a Unix domain socket, so editors and test runners
+ * pay for process startup and table setup once rather than per assembly. A connection may carry any
+ * number of requests.
+ *
+ * The main thread watches every connection with poll(), reading what is sent as it comes. Only once a
+ * whole request is in, the source included, is the connection handed to one of a fixed pool of workers,
+ * which answers that one request and hands it back. So a client keeping its connection open between
+ * requests, or sending slowly, never holds a worker. Each worker keeps its context (and statement memo)
+ * warm from one request to the next. A connection with nothing sent for SERVER_IDLE_SECONDS is closed.
+ *
+ * Request:     <command>\n
+ *              <Header>: <value>\n             (any number of them)
+ *              \n
+ *              <body>
+ *
+ * Commands:    ASSEMBLE    Headers: Path (a file to assemble) or Source-Length (the source follows as the body),
+ *                          Directory (absolute, that a relative Path is taken from), File (name used in the
+ *                          diagnostics), Memo (on / off), Format-Only (on / off)
+ *              STATS       Counters of the daemon and its latency histogram
+ *
+ * Response:    <OK | ERROR> <length>\n
+ *              <length bytes of JSON>
+ *
+ * An assembly answers with {"error", "words" (7 hex digits each), "symbols", "report" (as with -d json)}.
+ * The working directory of the daemon has nothing to do with the client's, so a relative Path is only
+ * taken with the Directory it is relative to, usually the client's working directory.
+ */
+
+#define SERVER_MAX_SOURCE (256u << 20)          // Largest source a request may send
+#define SERVER_MAX_HEADERS (64u << 10)          // Longest command and headers of a request, the connection is closed past them
+#define SERVER_MAX_CONNECTIONS 1024             // Open at once, further ones wait in the listen backlog
+#define SERVER_IDLE_SECONDS 60                  // A connection with nothing sent for this long is closed
+#define SERVER_SEND_SECONDS 10                  // Longest a worker waits for a client to take its answer
+#define LATENCY_BUCKETS 32                      // Bucket i counts requests that took under 2^i microseconds
+
+// Request latencies, bucketed by powers of 2. Safe to record into from several threads.
+class LatencyHistogram {
+public:
+    void record(uint64_t microseconds);
+    uint64_t count() const { return total; }
+    uint64_t percentile(double p) const;        // Upper bound of the bucket holding the p-th percentile, in microseconds
+    void writeJson(std::ostream &out) const;
+
+private:
+    std::atomic<uint64_t> buckets[LATENCY_BUCKETS] = {};
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> longest{0};
+};
+
+struct ServerOptions {
+    AssemblerOptions options;       // Defaults of every request
+    size_t workers = 0;             // 0 for one per hardware thread
+};
+
+// Serves until SIGINT or SIGTERM, then removes the socket. Returns 0, or 1 if the socket could not be set up.
+int serve(const std::string &path, const ServerOptions &options, std::ostream &log);
+
+#endif // SERVER_H
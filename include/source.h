@@ -0,0 +1,50 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+/*
+ * Read-only view of an assembly source file.
+ *
+ * On POSIX systems the file is memory mapped, so the tokenizer can hand out
+ * string_view slices of it without copying a single line. Elsewhere (Windows),
+ * and for the standard input, the file is read into memory in one go.
+ */
+
+// Path standing for the standard input, or output, wherever a file is named
+#define STANDARD_STREAM "-"
+
+// Bytes read at a time by readBlocks()
+#define SOURCE_BLOCK_SIZE (64 * 1024)
+class SourceFile {
+public:
+    SourceFile() = default;
+    ~SourceFile();
+    SourceFile(const SourceFile &) = delete;
+    SourceFile &operator=(const SourceFile &) = delete;
+
+    bool open(const std::string &path);     // Returns false if the file could not be opened or read. "-" reads the standard input.
+    void close();
+    std::string_view text() const { return std::string_view(data, size); }
+
+private:
+    const char *data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    std::string buffer;                     // Holds the file when it is not memory mapped
+};
+
+// Reads the file at `path` ("-" for the standard input) a block of at most SOURCE_BLOCK_SIZE bytes at a time,
+// handing each one to `consume` as soon as it is read. Reading stops early if `consume` returns false.
+// Only the `length` bytes from `offset` on are read, which the standard input can't skip to.
+// Returns false if the file could not be opened or read.
+bool readBlocks(const std::string &path, const std::function<bool(std::string_view)> &consume, uint64_t offset = 0, uint64_t length = UINT64_MAX);
+
+// Returns the line starting at `pos` (without its '\n') and moves `pos` past it.
+// Behaves like std::getline, i.e, a trailing '\n' does not produce an extra empty line.
+bool nextLine(std::string_view text, size_t &pos, std::string_view &line);
+
+#endif // SOURCE_H
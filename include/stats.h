@@ -0,0 +1,123 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include "memo.h"
+
+/*
+ * Run statistics
+ *
+ * --stats times each phase of an assembly, by the wall clock and in CPU time, and counts what went
+ * through it: source lines, statements, labels and errors, bytes read and written, and the allocations
+ * of the heap, which the executable counts from its operator new (see main.cpp).
+ *
+ * None of it costs anything unless asked for: a PhaseTimer with no RunStats to fill reads no clock,
+ * the counters are only worked out when there are stats to put them in, and operator new only counts
+ * once countHeap() turned counting on.
+ *
+ * --counters adds the hardware counters of the CPU to each phase, read through perf_event_open() on
+ * Linux: cycles, instructions, branch misses and cache misses, of every thread of the process. They
+ * are left out where the kernel doesn't give them, e.g. in most containers and virtual machines.
+ */
+
+// Phases of an assembly
+#define PHASE_READ 0            // Opening and reading the source
+#define PHASE_FIRST_PASS 1      // Formatting the source and recording the labels
+#define PHASE_SECOND_PASS 2     // Encoding the formatted code
+#define PHASE_EMIT 3            // Formatting the images and the format file
+#define PHASE_WRITE 4           // Writing the generated files
+#define PHASES 5
+
+// Hardware counters
+#define COUNTER_CYCLES 0
+#define COUNTER_INSTRUCTIONS 1
+#define COUNTER_BRANCH_MISSES 2
+#define COUNTER_CACHE_MISSES 3
+#define COUNTERS 4
+
+struct PhaseTime {
+    double wall = 0;            // Seconds
+    double cpu = 0;             // Seconds, of every thread of the process, or of the thread that ran the phase alone
+    size_t runs = 0;            // Times the phase ran, 0 if it didn't
+    uint64_t counters[COUNTERS] = {};   // With --counters, of every thread, unless the CPU time is of one thread alone
+
+    PhaseTime &operator+=(const PhaseTime &other){
+        wall += other.wall;
+        cpu += other.cpu;
+        runs += other.runs;
+        for (int c = 0; c < COUNTERS; c++) counters[c] += other.counters[c];
+        return *this;
+    }
+};
+
+// Counters of one assembly, added up over the files of batch mode
+struct RunStats {
+    PhaseTime phases[PHASES];
+    PhaseTime total;            // Of the whole run, set once it is done
+    uint64_t source_lines = 0;
+    uint64_t statements = 0;    // Lines of formatted code that aren't labels
+    uint64_t labels = 0;
+    uint64_t errors = 0;
+    uint64_t bytes_read = 0;
+    uint64_t bytes_written = 0;
+
+    RunStats &operator+=(const RunStats &other);
+};
+
+// Times a phase from its creation to stop() or its destruction, adding it to `stats` if given.
+// `thread_cpu` counts the CPU time of the calling thread alone, for phases that run beside others of their kind.
+class PhaseTimer {
+public:
+    PhaseTimer(RunStats *stats, int phase, bool thread_cpu = false) : PhaseTimer(stats ? &stats->phases[phase] : nullptr, thread_cpu) {}
+    explicit PhaseTimer(PhaseTime *time, bool thread_cpu = false);
+    ~PhaseTimer(){ stop(); }
+    PhaseTimer(const PhaseTimer &) = delete;
+    PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+    void stop();
+
+private:
+    PhaseTime *time;
+    bool thread_cpu;
+    double wall = 0;
+    double cpu = 0;
+    uint64_t counters[COUNTERS] = {};
+};
+
+// Heap allocations made since countHeap(), of every thread
+struct HeapStats {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+};
+
+extern std::atomic<bool> heap_counting;
+
+void countHeap();                           // Turns counting on
+inline bool countingHeap(){ return heap_counting.load(std::memory_order_relaxed); }
+void countAllocation(size_t size);          // Called by operator new while counting
+HeapStats heapStats();
+
+double wallTime();                          // Seconds since some fixed point
+double cpuTime(bool thread = false);        // Seconds of CPU, of the process or of the calling thread
+
+// Peak resident memory of the process so far, in bytes. 0 if it can't be told.
+size_t peakMemory();
+
+// Opens the hardware counters, for this thread and the ones it starts from then on. Returns false if none
+// could be, countersError() telling why.
+bool startCounters();
+bool countingHardware();                    // Whether any counter is open
+bool counterAvailable(int counter);
+const std::string &countersError();         // Empty unless startCounters() failed for some of them
+// Counts since startCounters(), scaled up if the kernel had to share the hardware between counters. 0 for those not open.
+void readCounters(uint64_t values[COUNTERS]);
+
+// The report of --stats, the memo counters (see memo.h) included
+void printRunStats(std::ostream &log, const RunStats &stats, const AssemblerStats &memo);
+void writeRunStatsJson(std::ostream &out, const RunStats &stats, const AssemblerStats &memo);
+
+#endif // STATS_H
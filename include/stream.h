@@ -0,0 +1,95 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "assembler.h"
+
+/*
+ * Streaming assembly
+ *
+ * --stream assembles the source as it is read, handing out each word as soon as it is final, so the
+ * assembler can sit in a pipeline between a program generator and a simulator. Every whole line read
+ * goes through the first pass as it comes in, and its statement is encoded right away with the labels
+ * defined so far.
+ *
+ * A statement whose dataline could be the name of a label that isn't defined yet can't be final: the
+ * label may still be defined further on, and if not, the dataline is hex (or an error). Such a
+ * statement is held until that label is defined, or the source ends, and the words after it wait
+ * behind it so they come out in order. Only the held statements keep a copy of their text.
+ *
+ * Words stop at the first error. The errors are the ones an assembly of the whole source reports, and
+ * are only known once the source ends: labelling errors, if there are any, otherwise encoding errors.
+ */
+
+struct StreamStats {
+    size_t source_lines = 0;
+    size_t statements = 0;
+    size_t labels = 0;
+    size_t words = 0;               // Handed out
+    size_t peak_held = 0;           // Most words waiting at once behind a held statement
+};
+
+class StreamAssembler {
+public:
+    explicit StreamAssembler(const AssemblerOptions &options);
+
+    // Takes the next piece of the source, which may end anywhere in a line.
+    // The words that became final are appended to `ready`.
+    void feed(std::string_view data, std::vector<Word> &ready);
+    // Ends the source, appending the words that were still held to `ready`
+    void finish(std::vector<Word> &ready);
+
+    bool error() const { return failed; }
+    const std::vector<Diagnostic> &diagnostics() const { return errors; }     // Complete once finished
+    size_t held() const { return queue.size(); }
+    const StreamStats &stats() const { return counters; }
+
+private:
+    // Line of the formatted code that isn't final yet, or is but waits behind one that isn't
+    struct Pending {
+        uint8_t state = 0;
+        Word word = 0;
+    };
+
+    // Statement held on a label, with what it takes to encode it again
+    struct Held {
+        size_t line_num;                    // Of the formatted code, for the messages
+        std::string text;                   // Copy of the statement
+        SourceLine line;                    // The statement, viewing into `text`
+        std::string block;                  // Label of the block it is in
+    };
+
+    void scan(std::string_view batch);
+    void defineLabel(const SourceLine &line);
+    void labelError(Diagnostic d);
+    void statement(const SourceLine &line);
+    bool encode(size_t entry, size_t line_num, const SourceLine &line, std::string_view block_label, bool last);
+    void release(std::vector<Word> &ready);
+
+    AssemblerContext ctx;                   // Labels defined so far
+    AssemblerContext scratch;               // Scans each batch of whole lines
+    EncodedRun run;                         // Errors of the statement last encoded
+    std::string partial;                    // Start of a line whose end hasn't been read yet
+    std::deque<Pending> queue;
+    size_t queue_base = 0;                  // Entries that left the queue, the front being counted as that one
+    std::unordered_map<size_t, Held> holds; // By entry of the queue
+    SymbolTable waiting;                    // Names held statements wait on, to their index in `waiters`
+    std::vector<std::vector<size_t>> waiters;   // Entries of the queue held on each name
+    std::string block;
+    size_t address = 0;                     // Of the next line, bad labels included
+    size_t formatted = 0;                   // Lines of formatted code so far, bad labels left out
+    uint32_t source_lines = 0;
+    bool labelling_failed = false;
+    bool failed = false;
+    bool stopped = false;                   // Whether the words stopped at an error
+    std::vector<Diagnostic> errors;         // Positions are lines of the formatted code until finished
+    StreamStats counters;
+};
+
+#endif // STREAM_H
@@ -0,0 +1,75 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*
+ * Arena and symbol table
+ *
+ * Label names are interned once: copied into an arena and given a 32 bit symbol ID. Names map to
+ * IDs through a flat open-addressing hash, and IDs to addresses through a dense array, so a lookup
+ * touches two small arrays rather than the nodes of a tree. clear() lets go of everything in one
+ * arena reset, keeping the memory for the next assembly.
+ */
+
+// Bump allocator. Nothing is freed on its own, reset() frees it all at once.
+class Arena {
+public:
+    explicit Arena(size_t block_size = 16 * 1024);
+
+    char *allocate(size_t size);
+    std::string_view copy(std::string_view s);
+    void reset();                           // Keeps the blocks, so the next use doesn't allocate
+    size_t used() const { return bytes; }   // Handed out since the last reset
+
+private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    size_t block_size;
+    size_t current = 0;                     // Block being allocated from
+    size_t offset = 0;                      // Into that block
+    size_t bytes = 0;
+};
+
+typedef uint32_t SymbolId;
+static constexpr SymbolId NO_SYMBOL = UINT32_MAX;
+
+// Case-insensitive table of label names to addresses
+class SymbolTable {
+public:
+    SymbolTable();
+
+    SymbolId find(std::string_view name) const;     // NO_SYMBOL if it isn't defined
+    // Defines `name` at `address`. If it already was, returns its ID with false, and leaves its address be.
+    std::pair<SymbolId, bool> insert(std::string_view name, size_t address);
+
+    std::string_view name(SymbolId id) const { return names[id]; }      // As first written
+    size_t address(SymbolId id) const { return addresses[id]; }
+    size_t size() const { return names.size(); }
+    void clear();
+
+private:
+    struct Slot {
+        uint32_t hash;
+        SymbolId id;                        // NO_SYMBOL if empty
+    };
+
+    size_t slotOf(std::string_view name, uint32_t hash) const;     // Slot holding `name`, or the empty one it would go in
+    void grow();
+
+    Arena arena;
+    std::vector<Slot> slots;                // Size is a power of 2, at most half full
+    std::vector<std::string_view> names;    // Indexed by ID, views into the arena
+    std::vector<size_t> addresses;          // Indexed by ID
+};
+
+#endif // SYMBOLS_H
@@ -0,0 +1,57 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Work-stealing thread pool
+ *
+ * run(count, task) calls task(i) for every i in [0, count), and returns once all of them are done.
+ * The indices are dealt round-robin into one deque per worker. A worker takes from the back of its
+ * own deque, and once that is empty steals from the front of the others, so a few slow tasks don't
+ * leave the rest of the machine idle.
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads = 0);    // 0 starts one worker per hardware thread
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    // Only one run() at a time. The first exception thrown by a task is rethrown here.
+    void run(size_t count, const std::function<void(size_t)> &task);
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> items;
+    };
+
+    void work(size_t id);
+    bool take(size_t id, size_t &item);
+
+    std::vector<std::thread> workers;
+    std::unique_ptr<Queue[]> queues;
+
+    std::mutex mutex;                       // Guards everything below
+    std::condition_variable start;
+    std::condition_variable done;
+    const std::function<void(size_t)> *task = nullptr;
+    size_t generation = 0;                  // Incremented by every run()
+    size_t pending = 0;                     // Tasks of the current run not finished yet
+    size_t active = 0;                      // Workers still busy with the current run
+    std::exception_ptr failure;
+    bool stopping = false;
+};
+
+#endif // THREAD_POOL_H
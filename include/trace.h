@@ -0,0 +1,67 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+/*
+ * Timeline tracing
+ *
+ * --trace=<file> records a span for each piece of work of an assembly, on the thread that did it: opening
+ * and reading the source, the first pass and each chunk it scanned, the second pass and each chunk it
+ * encoded, emitting the images and the format file, cache lookups and writing the files. Batch mode adds
+ * a span per file, and the daemon one per request. They are written out once the run is over in the trace
+ * event format of Chrome, which Perfetto (ui.perfetto.dev) opens offline as a timeline of every thread.
+ *
+ * Each thread records into a buffer of its own, a list of blocks that never move once allocated. A span
+ * is written into the last block, then published by a release store of the block's count, so no thread
+ * ever waits on another to record. The first span of a thread links its buffer into the list of buffers
+ * with a compare and swap. The buffers are kept until the process exits, so a thread that is done can
+ * still be written out.
+ *
+ * Without --trace a span costs one relaxed load.
+ */
+
+#define TRACE_BLOCK_SPANS 1024          // Spans per block of a thread's buffer
+
+extern std::atomic<bool> trace_on;
+
+// Starts recording, naming the calling thread the main one
+void startTrace();
+inline bool tracing(){ return trace_on.load(std::memory_order_relaxed); }
+
+// Writes every span recorded so far as a JSON trace. The threads may still be recording, their later spans are left out.
+void writeTrace(std::ostream &out);
+
+// Records the time from its creation to its destruction or end() as a span, while tracing.
+// `name`, `category` and `key` are kept as they are, string literals are expected. `file` is copied.
+class TraceSpan {
+public:
+    TraceSpan(const char *name, const char *category) : TraceSpan(name, category, nullptr, 0) {}
+    TraceSpan(const char *name, const char *category, const char *key, int64_t value) : name(name), category(category), key(key), value(value) {
+        if (tracing()) begin();
+    }
+    TraceSpan(const char *name, const char *category, std::string_view file) : name(name), category(category), file(file) {
+        if (tracing()) begin();
+    }
+    ~TraceSpan(){ end(); }
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+    void end(){ if (start >= 0) record(); }
+
+private:
+    void begin();
+    void record();
+
+    const char *name;
+    const char *category;
+    const char *key = nullptr;          // Of `value`, the one argument of the span if given
+    int64_t value = 0;
+    std::string_view file;              // Argument "file" if not empty, only valid until the span ends
+    int64_t start = -1;                 // Nanoseconds since startTrace(), -1 when not recording
+};
+
+#endif // TRACE_H
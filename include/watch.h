@@ -0,0 +1,71 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "assembler.h"
+
+/*
+ * Incremental reassembly
+ *
+ * --watch keeps the line table, the labels and the encoded words of the last assembly in memory.
+ * When the source changes, the text is edited in place and only the source lines between the first
+ * and the last line that differ go through the first pass again, and only their statements are
+ * encoded. The rest of the line table is kept, the views after the change moved by as much as the
+ * text grew or shrank. Statements elsewhere are only touched if
+ * they refer to a label whose address moved: a label that was already defined has the new address
+ * patched into the word, anything else is encoded again.
+ *
+ * Only a clean assembly is kept incrementally. Once an error is found, or while there was one, the
+ * whole source is assembled from scratch, into the context assembling it in two passes would give.
+ */
+
+struct WatchUpdate {
+    bool incremental = false;       // False if the whole source was assembled again
+    bool resized = false;           // Whether the number of words changed
+    bool labelling_error = false;   // Whether the first pass failed, leaving the statements unencoded
+    size_t lines = 0;               // Source lines that were added, removed or changed, or all of them if not incremental
+    std::vector<size_t> changed;    // Words that changed, in order. Only kept if incremental and not resized.
+};
+
+class IncrementalAssembler {
+public:
+    explicit IncrementalAssembler(const AssemblerOptions &options);
+
+    // Takes the whole of the new source, and brings the context up to date with it
+    WatchUpdate update(std::string source);
+    const AssemblerContext &context() const { return ctx; }
+
+private:
+    void rebuild(WatchUpdate &result);
+    bool splice(WatchUpdate &result, const std::string &source);
+    bool relabel(SymbolTable &dirty);
+
+    AssemblerContext ctx;
+    std::string text;                           // Source the line table views into
+    std::vector<size_t> starts;                 // Offset of each source line in `text`, and the size of `text` last
+    std::vector<std::string_view> datalines;    // Of each line of the formatted code, see encodeLine()
+    SymbolTable spare;                          // Labels of the previous version, kept to compare with
+    EncodedRun run;                             // Collects the errors of the lines encoded
+};
+
+// Blocks until the file at `path` is written to, or moved into place. Linux (inotify) only.
+class FileWatcher {
+public:
+    FileWatcher() = default;
+    ~FileWatcher();
+    FileWatcher(const FileWatcher &) = delete;
+    FileWatcher &operator=(const FileWatcher &) = delete;
+
+    bool open(const std::string &path);        // Returns false if the file can't be watched
+    bool wait();                                // Returns false if watching failed
+
+private:
+    int fd = -1;
+    std::string name;                           // Of the file in its directory
+};
+
+#endif // WATCH_H
@@ -0,0 +1,70 @@
+#ifndef WORD_H
+#define WORD_H
+
+#include <cstdint>
+
+/*
+ * Packed instruction word
+ *
+ * Every assembled statement is stored in the lower 28 bits of a uint32_t,
+ * which is exactly what one line of the Logisim hex file holds (7 hex digits):
+ *
+ *   27      20 19  16 15  12 11   8 7       0
+ *  +----------+------+------+------+---------+
+ *  |  OPCODE  |  Rw  |  Rx  |  Ry  |   DAT   |
+ *  +----------+------+------+------+---------+
+ *
+ * The processor itself only decodes the lower 25 bits, since no opcode is wider than 5 bits.
+ */
+typedef uint32_t Word;
+
+struct DecodedWord {
+    uint8_t opcode;
+    uint8_t rw;
+    uint8_t rx;
+    uint8_t ry;
+    uint8_t dat;
+};
+
+static constexpr unsigned WORD_HEX_DIGITS = 7;     // Hex digits written per word
+static constexpr unsigned WORD_BITS = 25;          // Bits written per word in the binary file
+static constexpr Word WORD_MASK = 0x0fffffff;
+
+constexpr Word encode(uint8_t opcode, uint8_t rw, uint8_t rx, uint8_t ry, uint8_t dat){
+    return (Word(opcode) << 20) | (Word(rw & 0x0f) << 16) | (Word(rx & 0x0f) << 12) | (Word(ry & 0x0f) << 8) | Word(dat);
+}
+
+constexpr Word encode(const DecodedWord &d){
+    return encode(d.opcode, d.rw, d.rx, d.ry, d.dat);
+}
+
+// Nibble to ASCII tables the emitters format words with
+inline constexpr char HEX_DIGITS[] = "0123456789ABCDEF";
+inline constexpr char BIN_NIBBLES[16][5] = {
+    "0000", "0001", "0010", "0011",
+    "0100", "0101", "0110", "0111",
+    "1000", "1001", "1010", "1011",
+    "1100", "1101", "1110", "1111"
+};
+
+// Field accessors
+constexpr uint8_t wordOpcode(Word w) { return (w >> 20) & 0xff; }
+constexpr uint8_t wordRw(Word w) { return (w >> 16) & 0x0f; }
+constexpr uint8_t wordRx(Word w) { return (w >> 12) & 0x0f; }
+constexpr uint8_t wordRy(Word w) { return (w >> 8) & 0x0f; }
+constexpr uint8_t wordData(Word w) { return w & 0xff; }
+
+// Returns the i-th hex digit of the word, counted from the most significant of the 7
+constexpr uint8_t wordNibble(Word w, unsigned i) { return (w >> (4 * (WORD_HEX_DIGITS - 1 - i))) & 0x0f; }
+
+constexpr DecodedWord decode(Word w){
+    return {wordOpcode(w), wordRw(w), wordRx(w), wordRy(w), wordData(w)};
+}
+
+static_assert(encode(0x04, 1, 2, 3, 0x00) == 0x0412300, "ADD,R1,R2,R3 should encode to 0412300");
+static_assert(encode(0x1c, 0, 0, 0, 0xae) == 0x1c000ae, "JMPPCRNZ,AE should encode to 1C000AE");
+static_assert(encode(decode(0x0d00006)) == 0x0d00006, "decode() should be the inverse of encode()");
+static_assert(WORD_BITS == 1 + 4 * (WORD_HEX_DIGITS - 1), "The binary word is the lowest bit of the first hex digit followed by the other six");
+static_assert(wordNibble(0x1c000ae, 0) == 0x1 && wordNibble(0x1c000ae, 6) == 0xe, "Nibbles are counted from the most significant digit");
+
+#endif // WORD_H
@@ -1,145 +1,78 @@
 #include "assembler.h"
+#include "scan.h"
+#include "source.h"
+#include "thread_pool.h"
+#include "trace.h"
+#include <algorithm>
 #include <iostream>
 #include <cstddef> // For size_t
 #include <cstdint>
-#include <map>
-#include <sstream>
-
-// Defining Error Codes
-#define INVALID_LINE 100
-#define INVALID_OPCODE 101
-#define INVALID_DATALINE 102
-#define REG_W_INVALID_REFERENCE 103
-#define REG_RX_INVALID_REFERENCE 104
-#define REG_RY_INVALID_REFERENCE 105
-#define REG_W_OUT_OF_RANGE 106
-#define REG_RX_OUT_OF_RANGE 107
-#define REG_RY_OUT_OF_RANGE 108
-#define JUMP_OUT_OF_RANGE 109
-#define INVALID_PARAM_NUM 110
-#define INVALID_REG_NUM 111
-#define INVALID_DAT_REF 112
-#define INVALID_LABEL_REF 113
-#define INVALID_LABEL_USE 114
-#define INVALID_INPUT_PORT 115
-#define INVALID_OUTPUT_PORT 116
+#include <string>
+#include <vector>
 
 using namespace std;
 
-// Error variable
-bool ERR = 0;
+static const uint8_t INPUT_PORTS[] = {0xf1, 0xf2, 0xf3, 0xf4};
 
-// regular expression checks
-static const char HEX_CHARS[] = {
-    '0', '1', '2', '3', '4', '5', '6', '7',
-    '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'
-};
-
-static const string BIN_STR[] = {
-    "0000", "0001", "0010", "0011",
-    "0100", "0101", "0110", "0111",
-    "1000", "1001", "1010", "1011",
-    "1100", "1101", "1110", "1111"
-};
-
-static const string INPUT_PORTS[] = {"F1", "F2", "F3", "F4"};
-
-static const string OUTPUT_PORTS[] = {"F8", "F9", "FA", "FB"};
-
-static const Opcode OP_TABLE[] = {
-    {0x00, "NOP", "00"},
-    {0x0f, "AND", "01"},
-    {0x0f, "OR", "02"},
-    {0x0f, "EXOR", "03"},
-    {0x0f, "ADD", "04"},
-    {0x1b, "ANDI", "05"},
-    {0x1b, "ORI", "06"},
-    {0x1b, "EXORI", "07"},
-    {0x1b, "ADDI", "08"},
-    {0x0a, "MOV", "09"},
-    {0x16, "MOVI", "0A"},
-    {0x16, "LOAD", "0B"},
-    {0x16, "STORE", "0C"},
-    {0x31, "JMP", "0D"},
-    {0x31, "JMPZ", "0E"},
-    {0x31, "JMPNZ", "0F"},
-    {0x31, "JMPC", "10"},
-    {0x31, "JMPNC", "11"},
-    {0x05, "PUSH", "12"},
-    {0x05, "POP", "13"},
-    {0x16, "IN", "14"},
-    {0x16, "OUT", "15"},
-    {0x0a, "LOADI", "16"},
-    {0x0a, "STOREI", "17"},
-    {0x0f, "SUB", "18"},
-    {0x0f, "SHIFTR", "19"},
-    {0x0f, "SHIFTL", "1A"},
-    {0x11, "JMPPCRZ", "1B"},
-    {0x11, "JMPPCRNZ", "1C"}
-};
+static const uint8_t OUTPUT_PORTS[] = {0xf8, 0xf9, 0xfa, 0xfb};
 
-static const size_t OP_TABLE_SIZE = sizeof(OP_TABLE) / sizeof(OP_TABLE[0]); // Should be 29 for now
 static const size_t INPUT_PORT_NUMBERS = sizeof(INPUT_PORTS) / sizeof(INPUT_PORTS[0]);
 static const size_t OUTPUT_PORT_NUMBERS = sizeof(OUTPUT_PORTS) / sizeof(OUTPUT_PORTS[0]);
 
 // Helper functions
-static bool validHexDAT(const string &s){
+static bool validHexDAT(string_view s){
     if (s.empty() || s.size() > 2) return false;
-    for (char c: s) if ((c < 'A' || c > 'F') && (c < '0' || c > '9')) return false;
+    for (char c: s){
+        c = upperChar(c);
+        if ((c < 'A' || c > 'F') && (c < '0' || c > '9')) return false;
+    }
     return true;
 }
 
-static bool validReg(const string &s){
+static bool validReg(string_view s){
     if (s.size() < 2) return false;
-    else if (s[0] != 'R') return false;
-    for (char c: s.substr(1)) if (c < '0' || c > '9') return false;
+    else if (upperChar(s[0]) != 'R') return false;
+    for (size_t i = 1; i < s.size(); i++) if (s[i] < '0' || s[i] > '9') return false;
     return true;
 }
 
-static bool validLabelName(const string &s){
+static bool validLabelName(string_view s){
     if (s.size() < 1) return false;
-    else if ((s[0] < 'A' || s[0] > 'Z') && s[0] != '_') return false;
-    for (char c: s.substr(1)) if ((c < '0' || c >'9') && (c < 'A' || c > 'Z') && c != '_') return false;
-    return true;
-}
-
-const Opcode* findOpcode(const string &name){
-    for (size_t i = 0; i < OP_TABLE_SIZE; i++){
-        if (OP_TABLE[i].opcode == name) return &OP_TABLE[i];
-    }
-    return nullptr;
-}
-
-void toUpper(string &s){
-    for (char &c : s) {
-        if (c >= 'a' && c <= 'z'){
-            c = c - 32; // Convert to uppercase
-        }
+    else if ((upperChar(s[0]) < 'A' || upperChar(s[0]) > 'Z') && s[0] != '_') return false;
+    for (size_t i = 1; i < s.size(); i++){
+        char c = upperChar(s[i]);
+        if ((c < '0' || c >'9') && (c < 'A' || c > 'Z') && c != '_') return false;
     }
+    return true;
 }
 
-// Function to check whether a string is present in the given array
+// Function to check whether a port address is present in the given array
 // If yes, returns the index, if no returns -1
-int isPresent(const string &s, const string *array, size_t array_size){
+int isPresent(uint8_t port, const uint8_t *array, size_t array_size){
     for (size_t i = 0; i < array_size; i++){
-        if (array[i] == s) return i;
+        if (array[i] == port) return i;
     }
     return -1;
 }
 
-string strip(const string &s) {
+// Returns the value of a single hex digit, assumes the digit has already been validated
+static uint8_t hexValue(char c){
+    c = upperChar(c);
+    return (c <= '9') ? c - '0' : c - 'A' + 10;
+}
+
+string_view strip(string_view s) {
     size_t start = s.find_first_not_of(" \t");
     size_t end = s.find_last_not_of(" \t");
-    return (start == string::npos) ? "" : s.substr(start, end - start + 1);
+    return (start == string_view::npos) ? string_view() : s.substr(start, end - start + 1);
 }
 
-// This function removes comments, makes the line uppercase, and returns it removing leading and trailing whitespaces or tabs.
-string sanitizeLine(const string &s){
-    string uncommented = s;
+// This function removes comments, and returns the line removing leading and trailing whitespaces or tabs.
+// The line keeps the case it was written in, everything downstream compares ignoring case.
+string_view sanitizeLine(string_view s){
     size_t comment = s.find("//");              // Comments can be specified by starting the comment with '//'
-    if (comment != string::npos) uncommented = s.substr(0, comment);
-    toUpper(uncommented);
-    return strip(uncommented);
+    if (comment != string_view::npos) s = s.substr(0, comment);
+    return strip(s);
 }
 
 /*
@@ -151,40 +84,28 @@ string sanitizeLine(const string &s){
  * 4: Label is a valid OPCODE
  * 5: Label is not a valid label name
 */
-uint8_t isValidLabel(const string &s){
-    string label;
-    string stripped;
+uint8_t isValidLabel(string_view s){
+    string_view label;
+    string_view stripped;
     
     stripped = strip(s);
     
     // Conditions
-    if (stripped.empty()) return 1;                             // Should not be empty
-    else if (stripped.find(';') != string::npos) return 2;      // Should not end with a semi-colon              
-    else if (stripped[stripped.size() - 1] != ':') return 3;    // Should end with a colon
+    if (stripped.empty()) return LABEL_EMPTY;                             // Should not be empty
+    else if (stripped.find(';') != string_view::npos) return LABEL_SEMICOLON; // Should not end with a semi-colon              
+    else if (stripped[stripped.size() - 1] != ':') return LABEL_NO_COLON;    // Should end with a colon
 
     // If the above conditions are passed, we remove the colon, and strip the passed label again
     label = strip(stripped.substr(0, stripped.size() - 1));
     
     // return false if it is a valid OPCODE
-    if (findOpcode(label)) return 4;
-    else if (!validLabelName(label))return 5;
+    if (findOpcode(label)) return LABEL_RESERVED;
+    else if (!validLabelName(label)) return LABEL_INVALID_NAME;
 
     return 0;
 
 }
 
-bool isLabelRecorded(const string &s, const map<string, size_t> &labels){
-    if (labels.find(s) == labels.end()) return false;
-    return true;
-}
-
-string hexBinConversion(char c) {
-    for (uint8_t i = 0; i < 16; i++){
-        if (HEX_CHARS[i] == c) return BIN_STR[i];
-    }
-    return "xxxx";
-}
-
 /*
 Function to check whether the values in Instruction are correct
 Meaning of returned values
@@ -203,8 +124,11 @@ Meaning of returned values
 */
 
 
-uint8_t instructionCheck(Instruction &instr, const map<string, size_t> &labels){
-    int temp;
+uint8_t instructionCheck(Instruction &instr, const AssemblerContext &ctx){
+    uint8_t regs[3] = {0, 0, 0};
+    uint8_t dat = 0;
+    size_t temp;
+    SymbolId label = NO_SYMBOL;
 
     // Checking opcode
     if (!instr.opcode) return INVALID_OPCODE;
@@ -213,239 +137,636 @@ uint8_t instructionCheck(Instruction &instr, const map<string, size_t> &labels){
     // These are allowed in the function since they just re-arrage the regs to their correct position according to the Opcode
     if (instr.opcode->opcode == "STORE" || instr.opcode->opcode == "PUSH" || instr.opcode->opcode == "OUT"){ 
         instr.registers[1] = instr.registers[0];
-        instr.registers[0] = "";
+        instr.registers[0] = string_view();
     } 
     else if( instr.opcode->opcode == "STOREI"){
         instr.registers[2] = instr.registers[1];
         instr.registers[1] = instr.registers[0];
-        instr.registers[0] = "";
+        instr.registers[0] = string_view();
     }
 
     // Checking for registers
     for (uint8_t i = 0; i < 3; i++){
-        if (instr.registers[i].empty()) {
-            instr.registers[i] = "0";
-            continue;
-        }
+        if (instr.registers[i].empty()) continue;
         else if (!validReg(instr.registers[i])){
             if (i == 0) return REG_W_INVALID_REFERENCE;
             else if (i == 1) return REG_RX_INVALID_REFERENCE;
             else return REG_RY_INVALID_REFERENCE;
         }
-        temp = stoi(instr.registers[i].substr(1, instr.registers[i].size()));
+
+        // Register numbers are decimal, we stop accumulating once it is out of range so long numbers can't overflow
+        temp = 0;
+        for (size_t j = 1; j < instr.registers[i].size() && temp < 16; j++) temp = temp * 10 + (instr.registers[i][j] - '0');
         if (temp >= 16){
             if (i == 0) return REG_W_OUT_OF_RANGE;
             else if (i == 1) return REG_RX_OUT_OF_RANGE;
             else return REG_RY_OUT_OF_RANGE;
         }
-        instr.registers[i] = string(1, HEX_CHARS[temp]);
+        regs[i] = temp;
     }
         
     // Checking valid dataline
-    if (instr.dataline.empty()) return 0;
+    if (instr.dataline.empty()) dat = 0;
     else if (!validLabelName(instr.dataline) && !validHexDAT(instr.dataline)) return INVALID_DATALINE;
-    else if (validLabelName(instr.dataline) && !isLabelRecorded(instr.dataline, labels) && !validHexDAT(instr.dataline)) return INVALID_LABEL_REF;
-    else if (isLabelRecorded(instr.dataline, labels)){
+    else if (validLabelName(instr.dataline) && (label = ctx.labels.find(instr.dataline)) == NO_SYMBOL && !validHexDAT(instr.dataline)) return INVALID_LABEL_REF;
+    else if (label != NO_SYMBOL){
         
         // Checking to see if the label is valid for given opcode
         if (!(instr.opcode->instr_num & 0x20)) return INVALID_LABEL_USE;
 
-        // Now we know that the dataline is having a label and it is recorded, we convert the address of the label to the dataline in hex
-        temp = labels.at(instr.dataline);
-        if (!temp){
-            instr.dataline = "00";
-            return 0;
-        }
-        else if (temp > 255 || temp < 0) return JUMP_OUT_OF_RANGE;
-        instr.dataline = "";
-        while (temp > 0){
-            instr.dataline = HEX_CHARS[temp % 16] + instr.dataline;
-            temp /= 16;
-        }
+        // Now we know that the dataline is having a label and it is recorded, we use the address of the label as the dataline
+        temp = ctx.labels.address(label);
+        instr.label = label;
+        if (temp > 255) return JUMP_OUT_OF_RANGE;
+        dat = temp;
     }
 
-    // If we reach this position, we know the dataline has a valid hex data and hence can safely parse the coming statements
-    if (instr.dataline.size() == 1) instr.dataline = "0" + instr.dataline;
+    // If we reach this position, we know the dataline has a valid hex data
+    else for (char c: instr.dataline) dat = (dat << 4) | hexValue(c);
+
+    instr.word = encode(instr.opcode->code, regs[0], regs[1], regs[2], dat);
     return 0;   
 }
 
 
+// Records a diagnostic, returns its code for convenience.
+// `span` is the offending part of `line`, the whole line is used if it is empty.
+static uint8_t report(vector<Diagnostic> &diagnostics, size_t line_num, size_t position, uint8_t code, const SourceLine &line, string_view span, string_view block_label, string message, string hint = string()){
+    Diagnostic d;
+
+    if (span.empty()) span = line.text;
+    d.line = line_num;
+    d.position = position;
+    d.code = code;
+    d.source_line = line.source_line;
+    d.column_begin = line.column + (span.data() - line.text.data()) + 1;
+    d.column_end = d.column_begin + span.size();
+    d.block = upperCopy(block_label);
+    d.message = std::move(message);
+    d.hint = std::move(hint);
+
+    diagnostics.push_back(std::move(d));
+    return code;
+}
+
+static string hexByte(uint8_t byte){
+    return string(1, HEX_DIGITS[byte >> 4]) + HEX_DIGITS[byte & 0x0f];
+}
+
+
 // Main Parsing Logic
-uint8_t parse(size_t line_num, const string &line, const string block_label, const map<string, size_t> &labels, ofstream &out_file) {
-    Instruction instr;
-    string word;
-    string wrong_code;
+// On success the encoded statement is left in `instr.word`, errors are recorded in the run
+static uint8_t parseInstruction(const AssemblerContext &ctx, EncodedRun &run, size_t line_num, const SourceLine &source_line, string_view block_label, Instruction &instr) {
+    string_view line = source_line.text;
+    string_view word;
+    string_view wrong_code;
+    string_view span;                   // Operand the error is about
+    string message;
+    string hint;
     int error_num = 0;
     int param_num = 0;
+    size_t pos;
+    size_t next;
 
     instr.reg_num = 0;
-    instr.dataline = "";
    
-    stringstream ss(line);
     // Getting Opcode
-    getline(ss, word, ',');
+    pos = line.find(',');
+    word = line.substr(0, pos);
     instr.opcode = findOpcode(strip(word));
 
     if (!instr.opcode) wrong_code = word;
     
     // Getting rest of the instructions
-    while (getline(ss, word, ',')){
+    // Same as splitting with getline, a single trailing comma does not give an extra empty parameter
+    while (pos != string_view::npos && pos + 1 < line.size()){
+        next = line.find(',', pos + 1);
+        word = line.substr(pos + 1, (next == string_view::npos) ? string_view::npos : next - pos - 1);
+        pos = next;
+
         if (param_num >= 4){
-            if (!block_label.empty()) out_file << "In block: " << block_label << ".\n";
-            out_file << "Error (Code 100): Bad line at line number " << line_num << ".\n";
-            out_file << "Too many parameters passed.\n";
-            ERR = true;
-            return INVALID_LINE;
+            return report(run.diagnostics, line_num, run.words.size(), INVALID_LINE, source_line, word, block_label,
+                          "Bad line at line number " + to_string(line_num) + ".", "Too many parameters passed.");
         }
         word = strip(word);
         
         if (word.empty()){
-            if (!block_label.empty()) out_file << "In block: " << block_label << ".\n";
-            out_file << "Error (Code 100): Bad line at line number " << line_num << " and parameter number " << param_num << ".\n";
-            out_file << "Passed value:  \"\".\n";
-            ERR = true;
-            return INVALID_LINE;
+            return report(run.diagnostics, line_num, run.words.size(), INVALID_LINE, source_line, string_view(), block_label,
+                          "Bad line at line number " + to_string(line_num) + " and parameter number " + to_string(param_num) + ".", "Passed value:  \"\".");
         }
  
         else if (validReg(word) && instr.reg_num >= 3){
-            if (!block_label.empty()) out_file << "In block: " << block_label << ".\n";
-            out_file << "Error (Code 111): Too many register references at line number " << line_num << ".\n";
-            out_file << "Maximum Register References allowed: 3.\n";
-            ERR = true;
-            return INVALID_REG_NUM;
+            return report(run.diagnostics, line_num, run.words.size(), INVALID_REG_NUM, source_line, word, block_label,
+                          "Too many register references at line number " + to_string(line_num) + ".", "Maximum Register References allowed: 3.");
         }
         else if (validReg(word)) instr.registers[instr.reg_num++] = word;
         else instr.dataline = word;
         param_num++;
     }
 
-    error_num = instructionCheck(instr, labels);
-    
-    // checking to see if there is any error, to get a default message for all switch cases with error;
-    if (error_num && !block_label.empty()){ 
-        out_file << "In block: " << block_label << ".\n";
+    error_num = instructionCheck(instr, ctx);
+
+    // The remaining checks are only made if the operands themselves were fine
+    if (!error_num){
+        if (param_num != (instr.opcode->instr_num & 0x03)) error_num = INVALID_PARAM_NUM;                    // Checking the 2 LSB bits for expected number of parameters
+        else if (instr.reg_num != ((instr.opcode->instr_num >> 2) & 0x03)) error_num = INVALID_REG_NUM;   // Shifting 2 bits and checking the 2 LSB bits for expected number of register references
+        else if ((instr.opcode->instr_num & 0x10) && instr.dataline.empty()) error_num = INVALID_DAT_REF;
+        else if (instr.opcode->opcode == "IN" && isPresent(wordData(instr.word), INPUT_PORTS, INPUT_PORT_NUMBERS) == -1) error_num = INVALID_INPUT_PORT;
+        else if (instr.opcode->opcode == "OUT" && isPresent(wordData(instr.word), OUTPUT_PORTS, OUTPUT_PORT_NUMBERS) == -1) error_num = INVALID_OUTPUT_PORT;
     }
 
+    if (!error_num){
+        // Unused registers and an unused dataline are already encoded as 0 by instructionCheck()
+        return 0;
+    }
+
+    // The message is only put together when there is an error, keeping the common path free of allocations
     switch (error_num){
-        case 0:
-            // No error
-            break;
-   
         case INVALID_OPCODE:
-            out_file << "Error (Code 101): Invalid opcode: " << wrong_code << ", at line " << line_num << ".\n";
-            out_file << "Hint: Check for typos or undefined instruction mnemonic.\n";
-            ERR = true;
+            span = strip(wrong_code);
+            message = "Invalid opcode: " + upperCopy(wrong_code) + ", at line " + to_string(line_num) + ".";
+            hint = "Check for typos or undefined instruction mnemonic.";
             break;
 
         case INVALID_DATALINE:
-            out_file << "Error (Code 102): Invalid or undefined data/label: " << instr.dataline << ", at line " << line_num << ".\n";
-            out_file << "Hint: Ensure the immediate value is valid hex, or the label is defined earlier.\n";
-            ERR = true;
+            span = instr.dataline;
+            message = "Invalid or undefined data/label: " + upperCopy(instr.dataline) + ", at line " + to_string(line_num) + ".";
+            hint = "Ensure the immediate value is valid hex, or the label is defined earlier.";
             break;
 
         case REG_W_INVALID_REFERENCE:
-            out_file << "Error (Code 103): Invalid destination register (Rw) reference: " << instr.registers[0] << ", at line " << line_num << ".\n";
-            out_file << "Hint: Register names must be in the form R0–R15.\n";
-            ERR = true;
+            span = instr.registers[0];
+            message = "Invalid destination register (Rw) reference: " + upperCopy(instr.registers[0]) + ", at line " + to_string(line_num) + ".";
+            hint = "Register names must be in the form R0–R15.";
             break;
 
         case REG_RX_INVALID_REFERENCE:
-            out_file << "Error (Code 104): Invalid source register (Rx) reference: " << instr.registers[1] << ", at line " << line_num << ".\n";
-            out_file << "Hint: Register names must be in the form R0–R15.\n";
-            ERR = true;
+            span = instr.registers[1];
+            message = "Invalid source register (Rx) reference: " + upperCopy(instr.registers[1]) + ", at line " + to_string(line_num) + ".";
+            hint = "Register names must be in the form R0–R15.";
             break;
 
         case REG_RY_INVALID_REFERENCE:
-            out_file << "Error (Code 105): Invalid second source register (Ry) reference: " << instr.registers[2] << ", at line " << line_num << ".\n";
-            out_file << "Hint: Register names must be in the form R0–R15.\n";
-            ERR = true;
+            span = instr.registers[2];
+            message = "Invalid second source register (Ry) reference: " + upperCopy(instr.registers[2]) + ", at line " + to_string(line_num) + ".";
+            hint = "Register names must be in the form R0–R15.";
             break;
 
         case REG_W_OUT_OF_RANGE:
-            out_file << "Error (Code 106): Destination register (Rw) out of range at line " << line_num << ".\n";
-            out_file << "Hint: Only registers R0–R15 are valid.\n";
-            ERR = true;
+            span = instr.registers[0];
+            message = "Destination register (Rw) out of range at line " + to_string(line_num) + ".";
+            hint = "Only registers R0–R15 are valid.";
             break;
 
         case REG_RX_OUT_OF_RANGE:
-            out_file << "Error (Code 107): Source register (Rx) out of range at line " << line_num << ".\n";
-            out_file << "Hint: Only registers R0–R15 are valid.\n";
-            ERR = true;
+            span = instr.registers[1];
+            message = "Source register (Rx) out of range at line " + to_string(line_num) + ".";
+            hint = "Only registers R0–R15 are valid.";
             break;
 
         case REG_RY_OUT_OF_RANGE:
-            out_file << "Error (Code 108): Second source register (Ry) out of range at line " << line_num << ".\n";
-            out_file << "Hint: Only registers R0–R15 are valid.\n";
-            ERR = true;
+            span = instr.registers[2];
+            message = "Second source register (Ry) out of range at line " + to_string(line_num) + ".";
+            hint = "Only registers R0–R15 are valid.";
             break;
 
         case JUMP_OUT_OF_RANGE:
-            out_file << "Error (Code 109): Jump target out of range at line " << line_num << ".\n";
-            out_file << "Hint: Label address exceeds 255. Ensure label positions fit in 8-bit number size.\n";
-            ERR = true;
+            span = instr.dataline;
+            message = "Jump target out of range at line " + to_string(line_num) + ".";
+            hint = "Label address exceeds 255. Ensure label positions fit in 8-bit number size.";
+            break;
+
+        case INVALID_PARAM_NUM:
+            message = "Invalid number of parameters for OPCODE: " + string(instr.opcode->opcode) + ", at line number " + to_string(line_num) + ".";
+            hint = "Expected number of parameters: " + to_string(instr.opcode->instr_num & 0x03) + ", Received: " + to_string(param_num) + ".";
+            break;
+
+        case INVALID_REG_NUM:
+            message = "Invalid number of registers referenced for OPCODE: " + string(instr.opcode->opcode) + ", at line number " + to_string(line_num) + ".";
+            hint = "Expected number of refereced registers: " + to_string((instr.opcode->instr_num >> 2) & 0x03) + ", Received: " + to_string(instr.reg_num) + ".";
+            break;
+
+        case INVALID_DAT_REF:
+            message = "Expected Data on Dataline for OPCODE: " + string(instr.opcode->opcode) + ", at line number " + to_string(line_num) + " But non was passed.";
             break;
 
         case INVALID_LABEL_REF:
-            out_file << "Error (Code 113): Referenced Label: " << instr.dataline << " at line " << line_num << " not found.\n";
-            out_file << "The error could either be due to invalid label name, or no label of same name was found.\n";
-            ERR = true;
+            span = instr.dataline;
+            message = "Referenced Label: " + upperCopy(instr.dataline) + " at line " + to_string(line_num) + " not found.";
+            hint = "The error could either be due to invalid label name, or no label of same name was found.";
             break;
+
         case INVALID_LABEL_USE:
-            out_file << "Error (Code 114): Invalid use of label with opcode " << instr.opcode->opcode << ", at line " << line_num  << ".\n";
-            out_file << "The error is because labels are explicitly only to be used with `jmp`, or similar statements.\n";
-            ERR = true;
+            span = instr.dataline;
+            message = "Invalid use of label with opcode " + string(instr.opcode->opcode) + ", at line " + to_string(line_num) + ".";
+            hint = "The error is because labels are explicitly only to be used with `jmp`, or similar statements.";
+            break;
+
+        case INVALID_INPUT_PORT:
+            span = instr.dataline;
+            message = "Invalid input port at line number " + to_string(line_num) + ".";
+            hint = "Passed port: " + hexByte(wordData(instr.word)) + ".";
+            break;
+
+        case INVALID_OUTPUT_PORT:
+            span = instr.dataline;
+            message = "Invalid output port at line number " + to_string(line_num) + ".";
+            hint = "Passed port: " + hexByte(wordData(instr.word)) + ".";
             break;
+
         default:
-            out_file << "Error (Code 100): Bad line at line number " << line_num << ".\n";
-            ERR = true;
-            return INVALID_LINE;
+            message = "Bad line at line number " + to_string(line_num) + ".";
+            error_num = INVALID_LINE;
     };
 
-    if (error_num) return error_num;
+    return report(run.diagnostics, line_num, run.words.size(), error_num, source_line, span, block_label, std::move(message), std::move(hint));
+}
+
+
+// On success the encoded statement is placed in `encoded`, errors are recorded in the run
+uint8_t parse(const AssemblerContext &ctx, EncodedRun &run, size_t line_num, const SourceLine &source_line, string_view block_label, Word &encoded) {
+    Instruction instr;
+    uint8_t code = parseInstruction(ctx, run, line_num, source_line, block_label, instr);
+    if (!code) encoded = instr.word;
+    return code;
+}
+
+
+// First pass
+// Formatting Assembly code
+// This parse does not check whether the line is valid instruction or not.
+// It checks just two things:
+// 1. If the line is blank, skip it, don't include it in the formatted assembly code
+// 2. If a label is encountered, check it, record it along with its line number, and replace it with an NOP statement
+//
+// The formatted code is kept in the context as a table of views into the source.
+//
+// **NOTE**
+// Since the labels will be replaced with the hexadecimal value of their locations in JMP statements, their line numbering starts from 0.
+//
+// A large source is split into chunks at line boundaries, which are scanned side by side with everything numbered
+// from the start of the chunk. Running sums over the chunks, in order, then give the addresses of their labels, and
+// tell which labels are duplicates. A small source is a single chunk scanned on the calling thread.
+
+namespace {
+
+// Valid label definition of a chunk. Whether it is a duplicate is only known once the chunks before it are merged.
+struct ChunkLabel {
+    size_t index;                       // Of its line in the chunk's lines
+    size_t address;                     // Counted from the first line of the chunk
+};
 
-    else if (param_num != (instr.opcode->instr_num & 0x03)){       // Checking the 2 LSB bits for expected number of parameters
-        if (!block_label.empty()) out_file << "In block: " << block_label << ".\n";
-        out_file << "Error (Code 110): Invalid number of parameters for OPCODE: " << instr.opcode->opcode << ", at line number " << line_num << ".\n";
-        out_file << "Expected number of parameters: " << (instr.opcode->instr_num & 0x03) << ", ";
-        out_file << "Received: " << param_num << ".\n";
-        ERR = true;
-        return INVALID_PARAM_NUM;
+struct ScannedChunk {
+    string_view text;
+    vector<SourceLine> lines;           // Source lines are counted from the start of the chunk
+    vector<ChunkLabel> labels;
+    vector<Diagnostic> diagnostics;     // Invalid labels, numbered as if the chunk was all of the source
+    size_t addresses = 0;               // Lines of formatted code it accounts for, invalid labels included
+    uint32_t source_lines = 0;
+};
+
+}
+
+// Splits the source into at most `parts` chunks of at least CHUNK_MIN_BYTES, each ending with a newline except the last
+static vector<ScannedChunk> splitSource(string_view source, size_t parts){
+    vector<ScannedChunk> chunks;
+    size_t begin = 0;
+
+    parts = max<size_t>(1, min(parts, source.size() / CHUNK_MIN_BYTES));
+    for (size_t i = 1; i < parts; i++){
+        size_t end = source.find('\n', max(begin, source.size() / parts * i));
+        if (end == string_view::npos) break;
+        chunks.emplace_back();
+        chunks.back().text = source.substr(begin, end + 1 - begin);
+        begin = end + 1;
     }
-    else if (instr.reg_num != ((instr.opcode->instr_num >> 2) & 0x03)) { // Shifting 2 bits and checking the 2 LSB bits for expected number of register references
-        if (!block_label.empty()) out_file << "In block: " << block_label << ".\n";
-        out_file << "Error (Code 111): Invalid number of registers referenced for OPCODE: " << instr.opcode->opcode << ", at line number " << line_num << ".\n";
-        out_file << "Expected number of refereced registers: " << ((instr.opcode->instr_num >> 2) & 0x03) << ", ";
-        out_file << "Received: " << instr.reg_num << ".\n";
-        ERR = true;
-        return INVALID_REG_NUM;
+    chunks.emplace_back();
+    chunks.back().text = source.substr(begin);
+    return chunks;
+}
+
+static void scanChunk(ScannedChunk &chunk){
+    LineScanner scanner(chunk.text);    // Finds the comment, colon and semicolon of each line on the way
+    ScannedLine scanned;
+    string_view raw;                    // Line as it is in the source
+    string_view line;
+    uint8_t code;
+    string message;
+
+    while(scanner.next(scanned)){
+        chunk.source_lines++;
+        raw = scanned.text;
+        line = strip(raw.substr(0, scanned.comment));       // Same as sanitizeLine(), the comment being known
+        
+        // The line should be now stripped of leading and trailing whitespaces and tabs, and comments removed.
+        if (!line.size()) continue;
+        else if (scanned.colon == SCAN_NONE){
+            if (scanned.semicolon == SCAN_NONE) chunk.lines.push_back({line, LINE_UNTERMINATED, chunk.source_lines, uint32_t(line.data() - raw.data())});
+            else{
+                line = strip(raw.substr(0, scanned.semicolon));
+                if (!line.size()) continue;                           // Skip the line with only a semi-colon present;
+                chunk.lines.push_back({line, LINE_STATEMENT, chunk.source_lines, uint32_t(line.data() - raw.data())});
+            }
+            chunk.addresses++;
+            continue;
+        }
+
+        SourceLine label_line = {line, LINE_LABEL, chunk.source_lines, uint32_t(line.data() - raw.data())};
+        code = isValidLabel(line);
+        if (!code){
+            // The name starts where the line does, so the line table entry also serves to report a duplicate
+            label_line.text = sanitizeLine(line.substr(0, line.size() - 1));
+            chunk.labels.push_back({chunk.lines.size(), chunk.addresses++});
+            chunk.lines.push_back(label_line);
+            continue;
+        }
+
+        switch (code){
+            case LABEL_EMPTY:
+                message = "Empty labels are invalid";
+                break;
+
+            case LABEL_SEMICOLON:
+                message = "Label ended with a semi-colon";
+                break;
+
+            case LABEL_NO_COLON:
+                message = "Label does not end with a colon";
+                break;
+
+            case LABEL_RESERVED:
+                message = "Label: " + upperCopy(strip(line.substr(0, line.size() - 1))) + " is a valid OPCode, which is a reserved name";
+                break;
+
+            case LABEL_INVALID_NAME:
+                message = "Label: " + upperCopy(strip(line.substr(0, line.size() - 1))) + " is not a valid label name";
+                break;
+
+            default:
+                message = "Unknown Label Error";
+        }
+        report(chunk.diagnostics, ++chunk.addresses, chunk.lines.size(), code, label_line, string_view(), string_view(), message);
+    }
+}
+
+void firstPass(AssemblerContext &ctx, string_view source, ThreadPool *pool){
+    TraceSpan span("first pass", "assembly");
+    vector<ScannedChunk> chunks = splitSource(source, pool ? pool->size() * CHUNKS_PER_THREAD : 1);
+
+    auto scan = [&](size_t c){
+        TraceSpan chunk_span("scan chunk", "assembly", "chunk", c);
+        scanChunk(chunks[c]);
+    };
+    if (chunks.size() > 1) pool->run(chunks.size(), scan);
+    else scan(0);
+
+    // Where each chunk starts, and which of its label lines turned out to be duplicates
+    vector<size_t> line_bases(chunks.size());
+    vector<uint32_t> source_bases(chunks.size());
+    vector<vector<size_t>> duplicates(chunks.size());
+    size_t address = 0;
+    size_t line_base = ctx.lines.size();
+    uint32_t source_base = 0;
+
+    for (size_t c = 0; c < chunks.size(); c++){
+        ScannedChunk &chunk = chunks[c];
+        size_t next_label = 0;
+        size_t next_error = 0;
+
+        line_bases[c] = line_base;
+        source_bases[c] = source_base;
+
+        // Labels and label errors are taken in the order of their lines, as that is the order they are reported in
+        while (next_label < chunk.labels.size() || next_error < chunk.diagnostics.size()){
+            if (next_error == chunk.diagnostics.size() || (next_label < chunk.labels.size() && chunk.lines[chunk.labels[next_label].index].source_line < chunk.diagnostics[next_error].source_line)){
+                const ChunkLabel &label = chunk.labels[next_label++];
+                SourceLine label_line = chunk.lines[label.index];
+                size_t line_num = address + label.address;
+                auto [recorded, inserted] = ctx.labels.insert(label_line.text, line_num);
+
+                if (inserted) continue;
+                label_line.source_line += source_base;
+                reportDuplicate(ctx.diagnostics, line_num + 1, line_base + label.index - duplicates[c].size(), label_line, ctx.labels.address(recorded) + 1);
+                duplicates[c].push_back(label.index);
+            }
+            else {
+                Diagnostic &d = chunk.diagnostics[next_error++];
+                d.line += address;
+                d.position += line_base - duplicates[c].size();
+                d.source_line += source_base;
+                ctx.diagnostics.push_back(std::move(d));
+            }
+            ctx.error = true;
+        }
+
+        address += chunk.addresses;
+        line_base += chunk.lines.size() - duplicates[c].size();
+        source_base += chunk.source_lines;
     }
-    else if ((instr.opcode->instr_num & 0x10) && instr.dataline.empty()){
-        if (!block_label.empty()) out_file << "In block: " << block_label << ".\n";
-        out_file << "Error (Code 112): Expected Data on Dataline for OPCODE: " << instr.opcode->opcode << ", at line number " << line_num << " ";
-        out_file << "But non was passed.\n";
-        ERR = true;
-        return INVALID_DAT_REF;
+
+    if (chunks.size() == 1 && ctx.lines.empty() && duplicates[0].empty()){
+        ctx.lines = std::move(chunks[0].lines);
+        return;
     }
-    else if (instr.opcode->opcode == "IN" && isPresent(instr.dataline, INPUT_PORTS, INPUT_PORT_NUMBERS) == -1){
-        if (!block_label.empty()) out_file << "In block: " << block_label << ".\n";
-        out_file << "Error (Code 115): Invalid input port at line number " << line_num << ".\n";
-        out_file << "Passed port: " << instr.dataline << ".\n";
-        ERR = true;
-        return INVALID_INPUT_PORT;
+
+    // Every chunk copies its lines in place, leaving out the duplicate labels
+    ctx.lines.resize(line_base);
+    auto copy = [&](size_t c){
+        TraceSpan chunk_span("copy lines", "assembly", "chunk", c);
+        size_t out = line_bases[c];
+        size_t next_duplicate = 0;
+        for (size_t i = 0; i < chunks[c].lines.size(); i++){
+            if (next_duplicate < duplicates[c].size() && duplicates[c][next_duplicate] == i){
+                next_duplicate++;
+                continue;
+            }
+            ctx.lines[out] = chunks[c].lines[i];
+            ctx.lines[out++].source_line += source_bases[c];
+        }
+    };
+    if (chunks.size() > 1) pool->run(chunks.size(), copy);
+    else copy(0);
+}
+
+
+void reportDuplicate(vector<Diagnostic> &diagnostics, size_t line_num, size_t position, const SourceLine &line, size_t defined_at){
+    report(diagnostics, line_num, position, LABEL_DUPLICATE, line, line.text, string_view(),
+           "Already duplicate label: " + upperCopy(line.text) + ", at line number " + to_string(line_num) + ".", "Label already defined at: " + to_string(defined_at) + ".");
+}
+
+void scanBatch(AssemblerContext &scratch, string_view batch, uint32_t source_base, const function<void(const SourceLine &)> &line, const function<void(Diagnostic &)> &error){
+    scratch.clear();
+    firstPass(scratch, batch);
+
+    // Lines the first pass left out for being duplicates are found again in the batch
+    size_t cursor = 0;
+    uint32_t cursor_line = 1;
+    auto lineAt = [&](size_t n){
+        for (; cursor_line < n; cursor_line++) cursor = batch.find('\n', cursor) + 1;
+        size_t end = batch.find('\n', cursor);
+        return batch.substr(cursor, end == string_view::npos ? string_view::npos : end - cursor);
+    };
+
+    size_t next_line = 0, next_error = 0;
+    while (next_line < scratch.lines.size() || next_error < scratch.diagnostics.size()){
+        if (next_error == scratch.diagnostics.size() || (next_line < scratch.lines.size() && scratch.lines[next_line].source_line < scratch.diagnostics[next_error].source_line)){
+            SourceLine source_line = scratch.lines[next_line++];
+            source_line.source_line += source_base;
+            line(source_line);
+            continue;
+        }
+
+        Diagnostic &d = scratch.diagnostics[next_error++];
+        if (d.code == LABEL_DUPLICATE){
+            string_view text = lineAt(d.source_line);
+            line({text.substr(d.column_begin - 1, d.column_end - d.column_begin), LINE_LABEL, uint32_t(d.source_line + source_base), uint32_t(d.column_begin - 1)});
+        }
+        else {
+            d.source_line += source_base;
+            error(d);
+        }
     }
-    else if (instr.opcode->opcode == "OUT" && isPresent(instr.dataline, OUTPUT_PORTS, OUTPUT_PORT_NUMBERS) == -1){
-        if (!block_label.empty()) out_file << "In block: " << block_label << ".\n";
-        out_file << "Error (Code 116): Invalid output port at line number " << line_num << ".\n";
-        out_file << "Passed port: " << instr.dataline << ".\n";
-        ERR = true;
-        return INVALID_OUTPUT_PORT;
+}
+
+
+// Second pass
+// Encodes every line of the formatted code into ctx.words. Label lines are encoded as NOP statements.
+//
+// A large program is split into runs of lines that are encoded side by side, each starting in the block of the last
+// label before it. The runs are then merged in order, their words and diagnostics moved by the words before them.
+
+// Kept across assemblies on the same thread, entries don't depend on the program they came from
+static thread_local StatementMemo memo;
+
+// Encodes a statement through the memo, remembering it if it encoded cleanly
+static uint8_t parseMemo(const AssemblerContext &ctx, EncodedRun &run, size_t line_num, const SourceLine &source_line, string_view block_label, Word &word){
+    run.stats.memo_lookups++;
+    bool patched;
+    if (memo.find(source_line.text, ctx.labels, word, patched)){
+        run.stats.memo_hits++;
+        run.stats.memo_patched += patched;
+        return 0;
     }
 
-    // If dataline is empty, that means dataline was not used, and hence default value to be given is 00
-    else if (instr.dataline.empty()) instr.dataline = "00";
+    Instruction instr;
+    uint8_t code = parseInstruction(ctx, run, line_num, source_line, block_label, instr);
+    if (code) return code;
+    word = instr.word;
 
-    out_file << instr.opcode->hex << instr.registers[0] << instr.registers[1] << instr.registers[2] << instr.dataline << "\n";
-    
+    // A dataline that could be a label but was read as hex would change meaning once such a label is defined
+    if (instr.label != NO_SYMBOL) memo.insertTemplate(source_line.text, instr.dataline, word);
+    else if (!validLabelName(instr.dataline)) memo.insertPlain(source_line.text, word);
     return 0;
+}
+
+bool encodeLine(const AssemblerContext &ctx, EncodedRun &run, size_t index, string_view block_label, Word &word, string_view *dataline){
+    return encodeSourceLine(ctx, run, index + 1, ctx.lines[index], block_label, word, dataline);
+}
+
+bool encodeSourceLine(const AssemblerContext &ctx, EncodedRun &run, size_t line_num, const SourceLine &source_line, string_view block_label, Word &word, string_view *dataline){
+    if (dataline) *dataline = string_view();
+    if (source_line.kind == LINE_LABEL){
+        word = 0;
+        return true;
+    }
+
+    else if (source_line.kind == LINE_UNTERMINATED){
+        report(run.diagnostics, line_num, run.words.size(), MISSING_SEMICOLON, source_line, string_view(), block_label, "Missing semicolon at line " + to_string(line_num));
+        return false;
+    }
+
+    else if (source_line.text.size() < 3){
+        report(run.diagnostics, line_num, run.words.size(), LINE_TOO_SHORT, source_line, string_view(), block_label, "Invalid line at line " + to_string(line_num));
+        return false;
+    }
+
+    if (dataline){
+        Instruction instr;
+        uint8_t code = parseInstruction(ctx, run, line_num, source_line, block_label, instr);
+        if (validLabelName(instr.dataline)) *dataline = instr.dataline;
+        if (code) return false;
+        word = instr.word;
+        return true;
+    }
+    return ctx.options.memo ? !parseMemo(ctx, run, line_num, source_line, block_label, word) : !parse(ctx, run, line_num, source_line, block_label, word);
+}
+
+// Encodes lines [begin, end) into `run`
+static void encodeRun(const AssemblerContext &ctx, size_t begin, size_t end, string_view label, EncodedRun &run){
+    Word word;
+
+    for (size_t i = begin; i < end; i++){
+        if (ctx.lines[i].kind == LINE_LABEL) label = ctx.lines[i].text;
+        if (encodeLine(ctx, run, i, label, word)) run.words.push_back(word);
+    }
+}
+
+void secondPass(AssemblerContext &ctx, ThreadPool *pool){
+    TraceSpan span("second pass", "assembly");
+    size_t parts = pool ? max<size_t>(1, min(pool->size() * CHUNKS_PER_THREAD, ctx.lines.size() / CHUNK_MIN_LINES)) : 1;
+    vector<EncodedRun> runs(parts);
+    vector<size_t> bounds(parts + 1);
+    vector<string_view> labels(parts);      // Block each run starts in
+
+    // Keeping label blank in case there is no label at line 0
+    string_view label;
+    for (size_t r = 0, i = 0; r < parts; r++){
+        bounds[r] = ctx.lines.size() / parts * r;
+        for (; i < bounds[r]; i++){
+            if (ctx.lines[i].kind == LINE_LABEL) label = ctx.lines[i].text;
+        }
+        labels[r] = label;
+    }
+    bounds[parts] = ctx.lines.size();
+
+    auto encode = [&](size_t r){
+        TraceSpan chunk_span("encode chunk", "assembly", "chunk", r);
+        encodeRun(ctx, bounds[r], bounds[r + 1], labels[r], runs[r]);
+    };
+    if (parts > 1) pool->run(parts, encode);
+    else encode(0);
+
+    // Each run's words start after the ones of the runs before it
+    vector<size_t> word_bases(parts);
+    size_t word_base = ctx.words.size();
+    for (size_t r = 0; r < parts; r++){
+        word_bases[r] = word_base;
+        for (Diagnostic &d: runs[r].diagnostics){
+            d.position += word_base;
+            ctx.diagnostics.push_back(std::move(d));
+            ctx.error = true;
+        }
+        ctx.stats += runs[r].stats;
+        word_base += runs[r].words.size();
+    }
+
+    if (parts == 1 && ctx.words.empty()){
+        ctx.words = std::move(runs[0].words);
+        return;
+    }
+    ctx.words.resize(word_base);
+    auto copy = [&](size_t r){
+        TraceSpan chunk_span("copy words", "assembly", "chunk", r);
+        copy_n(runs[r].words.begin(), runs[r].words.size(), ctx.words.begin() + word_bases[r]);
+    };
+    if (parts > 1) pool->run(parts, copy);
+    else copy(0);
+}
 
+AssemblyResult assemble(string_view source, const AssemblerOptions &options){
+    AssemblerContext ctx;
+    AssemblyResult result;
+
+    ctx.options = options;
+    firstPass(ctx, source);
+    if (!ctx.error && !ctx.options.format_only) secondPass(ctx);
+
+    result.words = std::move(ctx.words);
+    result.diagnostics = std::move(ctx.diagnostics);
+    result.stats = ctx.stats;
+    result.error = ctx.error;
+    result.symbols.reserve(ctx.labels.size());
+    for (SymbolId id = 0; id < ctx.labels.size(); id++) result.symbols.push_back({upperCopy(ctx.labels.name(id)), ctx.labels.address(id)});
+    sort(result.symbols.begin(), result.symbols.end(), [](const Symbol &a, const Symbol &b){ return a.name < b.name; });
+    return result;
 }
@@ -0,0 +1,94 @@
+#include "assembler_c.h"
+#include "assembler.h"
+#include <new>
+
+#ifndef ASSEMBLER_VERSION
+#define ASSEMBLER_VERSION "dev"
+#endif
+
+using namespace std;
+
+struct assembler_result {
+    AssemblyResult result;
+};
+
+// No exception may cross the C boundary, the only one assemble() can throw is bad_alloc
+assembler_result *assembler_assemble(const char *source, size_t length, int format_only){
+    AssemblerOptions options;
+    options.format_only = format_only != 0;
+
+    try {
+        return new assembler_result{assemble(string_view(source, source ? length : 0), options)};
+    }
+    catch (const bad_alloc &){
+        return nullptr;
+    }
+}
+
+void assembler_result_free(assembler_result *result){
+    delete result;
+}
+
+int assembler_result_failed(const assembler_result *result){
+    return result->result.error ? 1 : 0;
+}
+
+size_t assembler_result_word_count(const assembler_result *result){
+    return result->result.words.size();
+}
+
+const uint32_t *assembler_result_words(const assembler_result *result){
+    return result->result.words.data();
+}
+
+size_t assembler_result_symbol_count(const assembler_result *result){
+    return result->result.symbols.size();
+}
+
+const char *assembler_result_symbol_name(const assembler_result *result, size_t index){
+    if (index >= result->result.symbols.size()) return nullptr;
+    return result->result.symbols[index].name.c_str();
+}
+
+size_t assembler_result_symbol_address(const assembler_result *result, size_t index){
+    if (index >= result->result.symbols.size()) return 0;
+    return result->result.symbols[index].address;
+}
+
+size_t assembler_result_diagnostic_count(const assembler_result *result){
+    return result->result.diagnostics.size();
+}
+
+size_t assembler_result_diagnostic_line(const assembler_result *result, size_t index){
+    if (index >= result->result.diagnostics.size()) return 0;
+    return result->result.diagnostics[index].source_line;
+}
+
+int assembler_result_diagnostic_code(const assembler_result *result, size_t index){
+    if (index >= result->result.diagnostics.size()) return 0;
+    return result->result.diagnostics[index].code;
+}
+
+size_t assembler_result_diagnostic_column(const assembler_result *result, size_t index){
+    if (index >= result->result.diagnostics.size()) return 0;
+    return result->result.diagnostics[index].column_begin;
+}
+
+const char *assembler_result_diagnostic_block(const assembler_result *result, size_t index){
+    if (index >= result->result.diagnostics.size()) return nullptr;
+    return result->result.diagnostics[index].block.c_str();
+}
+
+const char *assembler_result_diagnostic_message(const assembler_result *result, size_t index){
+    if (index >= result->result.diagnostics.size()) return nullptr;
+    return result->result.diagnostics[index].message.c_str();
+}
+
+const char *assembler_result_diagnostic_hint(const assembler_result *result, size_t index){
+    if (index >= result->result.diagnostics.size()) return nullptr;
+    return result->result.diagnostics[index].hint.c_str();
+}
+
+const char *assembler_version(void){
+    return ASSEMBLER_VERSION;
+}
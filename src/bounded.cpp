@@ -0,0 +1,126 @@
+#include "bounded.h"
+#include "source.h"
+#include "trace.h"
+#include <algorithm>
+
+using namespace std;
+
+// Hands `length` bytes of the file from `offset` on to `consume` a batch of whole lines at a time, along with
+// where the batch starts in the file. The last line is handed over alone if it has no newline.
+static bool readLines(const string &path, uint64_t offset, uint64_t length, const function<void(string_view, uint64_t)> &consume){
+    string partial;                 // Start of a line whose end hasn't been read yet
+
+    bool read = readBlocks(path, [&](string_view block){
+        size_t end = block.rfind('\n');
+        if (end == string_view::npos){
+            partial.append(block);
+            return true;
+        }
+
+        if (partial.empty()) consume(block.substr(0, end + 1), offset);
+        else {
+            partial.append(block.substr(0, end + 1));
+            consume(partial, offset);
+        }
+        offset += partial.empty() ? end + 1 : partial.size();
+        partial.assign(block.substr(end + 1));
+        return true;
+    }, offset, length);
+
+    if (read && !partial.empty()) consume(partial, offset);
+    return read;
+}
+
+BoundedAssembler::BoundedAssembler(const AssemblerOptions &options){
+    ctx.options = options;
+    ctx.options.memo = false;           // The memo grows with the distinct statements of the source
+}
+
+bool BoundedAssembler::labelPass(const string &path){
+    TraceSpan span("label pass", "assembly", path);
+    AssemblerContext scratch;
+    size_t address = 0;                 // Of the next line, bad labels included
+    size_t line = 0;                    // Of the formatted code, bad labels left out
+    string block;
+
+    ctx.clear();
+    index.assign(1, LineIndexEntry());
+    counters = BoundedStats();
+
+    bool read = readLines(path, 0, UINT64_MAX, [&](string_view batch, uint64_t offset){
+        uint32_t base = counters.source_lines;
+        counters.source_lines += count(batch.begin(), batch.end(), '\n') + (batch.back() != '\n');
+        counters.bytes += batch.size();
+
+        scanBatch(scratch, batch, base, [&](const SourceLine &source_line){
+            if (line == index.back().line + LINE_INDEX_INTERVAL){
+                size_t start = source_line.text.data() - batch.data() - source_line.column;
+                index.push_back({offset + start, source_line.source_line - 1, line, block});
+            }
+
+            if (source_line.kind == LINE_LABEL){
+                auto [recorded, inserted] = ctx.labels.insert(source_line.text, address);
+                if (!inserted){
+                    reportDuplicate(ctx.diagnostics, address++ + 1, line, source_line, ctx.labels.address(recorded) + 1);
+                    ctx.error = true;
+                    return;
+                }
+                block = source_line.text;
+            }
+            address++;
+            line++;
+        }, [&](Diagnostic &d){
+            // A bad label still takes an address, though not a line of the formatted code
+            d.line = ++address;
+            d.position = line;
+            ctx.diagnostics.push_back(std::move(d));
+            ctx.error = true;
+        });
+    });
+
+    counters.words = line;
+    return read;
+}
+
+bool BoundedAssembler::encodePass(const string &path, size_t from, size_t to, const function<void(Word)> &word, const function<bool(Diagnostic &)> &error) const{
+    TraceSpan span("encode part", "assembly", "from", from);
+    const LineIndexEntry &start = index[from];
+    uint64_t length = (to + 1 < index.size()) ? index[to + 1].offset - start.offset : UINT64_MAX;
+    AssemblerContext scratch;
+    EncodedRun run;
+    uint32_t source_lines = start.source_lines;
+    size_t line = start.line;
+    size_t failed = 0;                  // Lines with errors, which have no word
+    string block = start.block;
+    bool stopped = false;
+    Word w;
+
+    bool read = readLines(path, start.offset, length, [&](string_view batch, uint64_t){
+        if (stopped) return;
+        uint32_t base = source_lines;
+        source_lines += count(batch.begin(), batch.end(), '\n') + (batch.back() != '\n');
+
+        // Labelling errors were all found by the first pass, this one only runs without them
+        scanBatch(scratch, batch, base, [&](const SourceLine &source_line){
+            if (stopped) return;
+            line++;
+            if (source_line.kind == LINE_LABEL){
+                block = source_line.text;
+                word(0);
+                return;
+            }
+
+            run.diagnostics.clear();
+            if (encodeSourceLine(ctx, run, line, source_line, block, w)){
+                word(w);
+                return;
+            }
+            for (Diagnostic &d: run.diagnostics){
+                d.position = line - 1 - failed - start.line;
+                stopped = stopped || !error(d);
+            }
+            failed++;
+        }, [](Diagnostic &){});
+    });
+    return read;
+}
@@ -0,0 +1,312 @@
+#include "cache.h"
+#include "source.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+#ifndef ASSEMBLER_VERSION
+#define ASSEMBLER_VERSION "dev"
+#endif
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// Hashing
+// Two 64 bit lanes fed 8 bytes at a time, mixed together at the end. Quick on large sources,
+// and the 128 bits make an accidental collision between entries a non-issue.
+static constexpr uint64_t PRIME_1 = 0x9e3779b185ebca87ull;
+static constexpr uint64_t PRIME_2 = 0xc2b2ae3d27d4eb4full;
+static constexpr uint64_t PRIME_3 = 0x165667b19e3779f9ull;
+static constexpr uint64_t PRIME_4 = 0x85ebca77c2b2ae63ull;
+
+static uint64_t rotl(uint64_t x, int r){ return (x << r) | (x >> (64 - r)); }
+
+static uint64_t mix(uint64_t x){
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+static void hashInto(uint64_t &a, uint64_t &b, string_view data){
+    size_t i = 0;
+    for (; i + 8 <= data.size(); i += 8){
+        uint64_t w;
+        memcpy(&w, data.data() + i, 8);
+        a = rotl(a ^ (w * PRIME_1), 31) * PRIME_2;
+        b = rotl(b ^ (w * PRIME_3), 27) * PRIME_4;
+    }
+
+    uint64_t tail = 0;
+    if (i < data.size()) memcpy(&tail, data.data() + i, data.size() - i);
+    a = rotl(a ^ (tail * PRIME_1) ^ data.size(), 31) * PRIME_2;
+    b = rotl(b ^ (tail * PRIME_3) ^ data.size(), 27) * PRIME_4;
+}
+
+// What tells this build apart from others of the same version. Development builds all share the version "dev",
+// so the binary holding this code stands in for it: the executable, or the shared library when loaded as one.
+static string buildId(){
+    string id = ASSEMBLER_VERSION;
+    if (id != "dev") return id;
+
+#ifndef _WIN32
+    Dl_info info;
+    struct stat st;
+    if (dladdr(reinterpret_cast<void *>(&buildId), &info) && info.dli_fname && stat(info.dli_fname, &st) == 0)
+        id += " " + to_string(st.st_size) + " " + to_string(st.st_mtime);
+#endif
+    return id;
+}
+
+CacheKey cacheKey(string_view source, string_view options){
+    TraceSpan span("cache key", "cache");
+    static const string build = buildId();
+    uint64_t a = PRIME_3, b = PRIME_1;
+
+    hashInto(a, b, build);
+    hashInto(a, b, options);
+    hashInto(a, b, source);
+
+    CacheKey key;
+    key.high = mix(a + rotl(b, 17));
+    key.low = mix(b ^ rotl(a, 41));
+    return key;
+}
+
+string CacheKey::hex() const{
+    static const char DIGITS[] = "0123456789abcdef";
+    string s(32, '0');
+    for (int i = 0; i < 16; i++){
+        s[15 - i] = DIGITS[(high >> (4 * i)) & 0xf];
+        s[31 - i] = DIGITS[(low >> (4 * i)) & 0xf];
+    }
+    return s;
+}
+
+
+// Files
+static string fileName(int file){
+    return (file == CACHE_FORMAT_FILE) ? "format" : to_string(file);
+}
+
+// Clones `from` into `to` if the file system can share the blocks, copies it otherwise. "-" writes it to the standard output.
+static bool copyFile(const fs::path &from, const string &to){
+    if (to == STANDARD_STREAM){
+        SourceFile entry;
+        return entry.open(from.string()) && writeFile(to, entry.text(), true);
+    }
+#ifdef FICLONE
+    int src = ::open(from.c_str(), O_RDONLY);
+    if (src < 0) return false;
+    int dst = ::open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (dst < 0){
+        ::close(src);
+        return false;
+    }
+    bool cloned = ::ioctl(dst, FICLONE, src) == 0;
+    ::close(src);
+    if (::close(dst) != 0) return false;
+    if (cloned) return true;
+#endif
+    error_code ec;
+    return fs::copy_file(from, to, fs::copy_options::overwrite_existing, ec);
+}
+
+static long processId(){
+#ifndef _WIN32
+    return ::getpid();
+#else
+    return 0;
+#endif
+}
+
+// Names the machine in the temporary directories, so only the processes of this one are looked up
+static const string &hostName(){
+    static const string name = []{
+        char host[256] = "";
+#ifndef _WIN32
+        if (gethostname(host, sizeof(host) - 1) != 0) host[0] = '\0';
+#endif
+        return string(host);
+    }();
+    return name;
+}
+
+static bool isTemporary(const fs::path &dir){
+    return dir.filename().string().compare(0, strlen(CACHE_TEMPORARY_PREFIX), CACHE_TEMPORARY_PREFIX) == 0;
+}
+
+// Size of an entry, and when it was last used
+struct Entry {
+    fs::path path;
+    uint64_t bytes = 0;
+    fs::file_time_type used;
+};
+
+static vector<Entry> listEntries(const string &root){
+    vector<Entry> entries;
+    error_code ec;
+
+    for (const fs::directory_entry &dir: fs::directory_iterator(root, ec)){
+        if (!dir.is_directory(ec) || isTemporary(dir.path())) continue;
+        Entry entry;
+        entry.path = dir.path();
+        entry.used = dir.last_write_time(ec);
+        for (const fs::directory_entry &file: fs::directory_iterator(dir.path(), ec)){
+            uint64_t size = file.file_size(ec);
+            if (!ec) entry.bytes += size;
+        }
+        entries.push_back(entry);
+    }
+    return entries;
+}
+
+
+// Build cache
+bool BuildCache::open(const string &dir, uint64_t max){
+    error_code ec;
+    fs::create_directories(dir, ec);
+    if (!fs::is_directory(dir, ec)) return false;
+
+    root = dir;
+    max_bytes = max;
+    sweep();
+    bytes = scan();
+    return true;
+}
+
+bool BuildCache::lookup(const CacheKey &key, unsigned files){
+    TraceSpan span("cache lookup", "cache");
+    fs::path entry = fs::path(root) / key.hex();
+    error_code ec;
+
+    lookups++;
+    if (!fs::is_directory(entry, ec)) return false;
+    for (int f = 0; f < CACHE_FILES; f++){
+        if (fs::exists(entry / fileName(f), ec) != bool(files & CACHE_FILE_BIT(f))) return false;
+    }
+
+    // Marking it as just used, for eviction
+    fs::last_write_time(entry, fs::file_time_type::clock::now(), ec);
+    hits++;
+    return true;
+}
+
+bool BuildCache::materialize(const CacheKey &key, int file, const string &path){
+    TraceSpan span("cache materialize", "cache", path);
+    return copyFile(fs::path(root) / key.hex() / fileName(file), path);
+}
+
+void BuildCache::store(const CacheKey &key, unsigned files, const string_view data[CACHE_FILES]){
+    TraceSpan span("cache store", "cache");
+    fs::path entry = fs::path(root) / key.hex();
+    error_code ec;
+    if (fs::is_directory(entry, ec)) return;
+
+    fs::path temporary = fs::path(root) / (CACHE_TEMPORARY_PREFIX + to_string(processId()) + "-" + to_string(temporaries++) + "-" + hostName());
+    fs::remove_all(temporary, ec);
+    if (!fs::create_directory(temporary, ec)) return;
+
+    uint64_t size = 0;
+    for (int f = 0; f < CACHE_FILES; f++){
+        if (!(files & CACHE_FILE_BIT(f))) continue;
+        if (!writeFile((temporary / fileName(f)).string(), data[f], f != CACHE_FORMAT_FILE && imageIsBinary(f))){
+            fs::remove_all(temporary, ec);
+            return;
+        }
+        size += data[f].size();
+    }
+
+    // Another process, or thread, may have stored the same entry meanwhile. Either one will do.
+    fs::rename(temporary, entry, ec);
+    if (ec){
+        fs::remove_all(temporary, ec);
+        return;
+    }
+    stores++;
+
+    lock_guard<std::mutex> lock(mutex);
+    bytes += size;
+    if (bytes > max_bytes) evict();
+}
+
+// Removes the entries used the longest ago until the cache fits, called with the mutex held
+void BuildCache::evict(){
+    sweep();
+    vector<Entry> entries = listEntries(root);
+    sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b){ return a.used < b.used; });
+
+    bytes = 0;
+    for (const Entry &entry: entries) bytes += entry.bytes;
+
+    error_code ec;
+    for (size_t i = 0; i < entries.size() && bytes > max_bytes; i++){
+        fs::remove_all(entries[i].path, ec);
+        if (ec) continue;
+        bytes -= entries[i].bytes;
+        evictions++;
+        evicted_bytes += entries[i].bytes;
+    }
+}
+
+// A temporary directory is only removed once the process named in it is gone, or it was left alone for long enough,
+// so a store running in another process is never pulled from under it
+void BuildCache::sweep(){
+    error_code ec;
+    auto now = fs::file_time_type::clock::now();
+
+    for (const fs::directory_entry &dir: fs::directory_iterator(root, ec)){
+        if (!dir.is_directory(ec) || !isTemporary(dir.path())) continue;
+        bool stale = now - dir.last_write_time(ec) > chrono::seconds(CACHE_STALE_SECONDS);
+#ifndef _WIN32
+        // <pid>-<n>-<host>
+        string name = dir.path().filename().string().substr(strlen(CACHE_TEMPORARY_PREFIX));
+        char *end;
+        long pid = strtol(name.c_str(), &end, 10);
+        size_t host = name.find('-', end - name.c_str() + 1);
+        bool here = *end == '-' && host != string::npos && name.compare(host + 1, string::npos, hostName()) == 0;
+        stale = stale || (here && pid > 0 && pid != processId() && ::kill(pid, 0) != 0 && errno == ESRCH);
+#endif
+        if (stale) fs::remove_all(dir.path(), ec);
+    }
+}
+
+uint64_t BuildCache::scan(size_t *count){
+    vector<Entry> entries = listEntries(root);
+    uint64_t total = 0;
+    for (const Entry &entry: entries) total += entry.bytes;
+    if (count) *count = entries.size();
+    return total;
+}
+
+CacheStats BuildCache::stats(){
+    CacheStats s;
+    s.lookups = lookups;
+    s.hits = hits;
+    s.stores = stores;
+    s.evictions = evictions;
+    s.evicted_bytes = evicted_bytes;
+
+    lock_guard<std::mutex> lock(mutex);
+    bytes = s.bytes = scan(&s.entries);
+    return s;
+}
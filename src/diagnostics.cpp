@@ -0,0 +1,175 @@
+#include "diagnostics.h"
+#include <cstdio>
+
+#ifndef ASSEMBLER_VERSION
+#define ASSEMBLER_VERSION "dev"
+#endif
+
+using namespace std;
+
+struct DiagnosticRule {
+    uint8_t code;
+    const char *name;
+};
+
+static const DiagnosticRule RULES[] = {
+    {LABEL_EMPTY, "Empty label"},
+    {LABEL_SEMICOLON, "Label ends with a semicolon"},
+    {LABEL_NO_COLON, "Label does not end with a colon"},
+    {LABEL_RESERVED, "Label is a reserved opcode"},
+    {LABEL_INVALID_NAME, "Invalid label name"},
+    {LABEL_DUPLICATE, "Duplicate label"},
+    {INVALID_LINE, "Bad line"},
+    {INVALID_OPCODE, "Invalid opcode"},
+    {INVALID_DATALINE, "Invalid data or label"},
+    {REG_W_INVALID_REFERENCE, "Invalid Rw register reference"},
+    {REG_RX_INVALID_REFERENCE, "Invalid Rx register reference"},
+    {REG_RY_INVALID_REFERENCE, "Invalid Ry register reference"},
+    {REG_W_OUT_OF_RANGE, "Rw register out of range"},
+    {REG_RX_OUT_OF_RANGE, "Rx register out of range"},
+    {REG_RY_OUT_OF_RANGE, "Ry register out of range"},
+    {JUMP_OUT_OF_RANGE, "Jump target out of range"},
+    {INVALID_PARAM_NUM, "Invalid number of parameters"},
+    {INVALID_REG_NUM, "Invalid number of registers"},
+    {INVALID_DAT_REF, "Missing data"},
+    {INVALID_LABEL_REF, "Undefined label"},
+    {INVALID_LABEL_USE, "Label not allowed for opcode"},
+    {INVALID_INPUT_PORT, "Invalid input port"},
+    {INVALID_OUTPUT_PORT, "Invalid output port"},
+    {MISSING_SEMICOLON, "Missing semicolon"},
+    {LINE_TOO_SHORT, "Invalid line"}
+};
+
+static const size_t RULES_SIZE = sizeof(RULES) / sizeof(RULES[0]);
+
+const char *diagnosticName(uint8_t code){
+    for (size_t i = 0; i < RULES_SIZE; i++) if (RULES[i].code == code) return RULES[i].name;
+    return "Unknown error";
+}
+
+/*
+ * The text rendering follows what the assembler has always written:
+ * - labelling errors (1 - 5):           Error: Invalid Label at line N.\n<message>
+ * - statement errors with a code:       [In block: B.\n]Error (Code N): <message>\n[<hint>]
+ * - everything else:                    [In block: B\n]Error: <message>\n[<hint>]
+ * Hints of codes 101 - 109 are prefixed with "Hint: ".
+ */
+string renderText(const Diagnostic &d){
+    string out;
+    bool coded = d.code >= INVALID_LINE && d.code != MISSING_SEMICOLON && d.code != LINE_TOO_SHORT;
+
+    if (d.code < LABEL_DUPLICATE) return "Error: Invalid Label at line " + to_string(d.line) + ".\n" + d.message + "\n";
+
+    if (!d.block.empty()) out = "In block: " + d.block + (coded ? ".\n" : "\n");
+    out += coded ? "Error (Code " + to_string(d.code) + "): " : "Error: ";
+    out += d.message + "\n";
+    if (!d.hint.empty()){
+        if (d.code >= INVALID_OPCODE && d.code <= JUMP_OUT_OF_RANGE) out += "Hint: ";
+        out += d.hint + "\n";
+    }
+    return out;
+}
+
+string jsonEscape(string_view s){
+    string out;
+    char buf[8];
+
+    out.reserve(s.size() + 2);
+    out += '"';
+    for (char c: s){
+        if (c == '"' || c == '\\'){
+            out += '\\';
+            out += c;
+        }
+        else if (c == '\n') out += "\\n";
+        else if (c == '\t') out += "\\t";
+        else if ((unsigned char)c < 0x20){
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        }
+        else out += c;
+    }
+    out += '"';
+    return out;
+}
+
+// One file's object, without a trailing newline
+static void writeJsonFile(ostream &out, string_view file, const vector<Diagnostic> &diagnostics){
+    out << "{\"file\":" << jsonEscape(file) << ",\"errors\":" << diagnostics.size() << ",\"diagnostics\":[";
+    for (size_t i = 0; i < diagnostics.size(); i++){
+        const Diagnostic &d = diagnostics[i];
+        if (i) out << ',';
+        out << "\n  {\"file\":" << jsonEscape(file)
+            << ",\"line\":" << d.source_line
+            << ",\"column\":" << d.column_begin
+            << ",\"endColumn\":" << d.column_end
+            << ",\"formattedLine\":" << d.line
+            << ",\"block\":" << jsonEscape(d.block)
+            << ",\"code\":" << (int)d.code
+            << ",\"name\":" << jsonEscape(diagnosticName(d.code))
+            << ",\"message\":" << jsonEscape(d.message)
+            << ",\"hint\":" << jsonEscape(d.hint) << '}';
+    }
+    out << (diagnostics.empty() ? "]}" : "\n]}");
+}
+
+void writeDiagnosticsJson(ostream &out, string_view file, const vector<Diagnostic> &diagnostics){
+    writeJsonFile(out, file, diagnostics);
+    out << '\n';
+}
+
+// An array of the objects of every file
+void writeDiagnosticsJson(ostream &out, const vector<FileDiagnostics> &files){
+    out << '[';
+    for (size_t i = 0; i < files.size(); i++){
+        if (i) out << ",\n";
+        writeJsonFile(out, files[i].file, files[i].diagnostics);
+    }
+    out << "]\n";
+}
+
+typedef pair<string_view, const vector<Diagnostic> *> SarifArtifact;
+
+// SARIF 2.1.0, one run with one rule per error code, and one artifact per file
+static void writeSarif(ostream &out, const vector<SarifArtifact> &artifacts){
+    out << "{\"$schema\":\"https://json.schemastore.org/sarif-2.1.0.json\",\"version\":\"2.1.0\",\"runs\":[{";
+    out << "\"tool\":{\"driver\":{\"name\":\"Assembler\",\"version\":" << jsonEscape(ASSEMBLER_VERSION)
+        << ",\"informationUri\":\"https://github.com/Ashwamedh-14/RISC-V-Based-Architecture-Assembler\",\"rules\":[";
+    for (size_t i = 0; i < RULES_SIZE; i++){
+        if (i) out << ',';
+        out << "\n  {\"id\":\"ASM" << (int)RULES[i].code << "\",\"shortDescription\":{\"text\":" << jsonEscape(RULES[i].name) << "}}";
+    }
+    out << "]}},\n\"artifacts\":[";
+    for (size_t a = 0; a < artifacts.size(); a++){
+        if (a) out << ',';
+        out << "{\"location\":{\"uri\":" << jsonEscape(artifacts[a].first) << "}}";
+    }
+    out << "],\n\"results\":[";
+
+    bool first = true;
+    for (size_t a = 0; a < artifacts.size(); a++){
+        for (const Diagnostic &d: *artifacts[a].second){
+            string text = d.message;
+
+            if (!d.hint.empty()) text += "\n" + d.hint;
+            if (!d.block.empty()) text += "\nIn block: " + d.block;
+            if (!first) out << ',';
+            first = false;
+            out << "\n  {\"ruleId\":\"ASM" << (int)d.code << "\",\"level\":\"error\",\"message\":{\"text\":" << jsonEscape(text) << "},"
+                << "\"locations\":[{\"physicalLocation\":{\"artifactLocation\":{\"uri\":" << jsonEscape(artifacts[a].first) << ",\"index\":" << a << "},"
+                << "\"region\":{\"startLine\":" << d.source_line << ",\"startColumn\":" << d.column_begin << ",\"endColumn\":" << d.column_end << "}}}]}";
+        }
+    }
+    out << "]}]}\n";
+}
+
+void writeDiagnosticsSarif(ostream &out, string_view file, const vector<Diagnostic> &diagnostics){
+    writeSarif(out, {SarifArtifact(file, &diagnostics)});
+}
+
+void writeDiagnosticsSarif(ostream &out, const vector<FileDiagnostics> &files){
+    vector<SarifArtifact> artifacts;
+    artifacts.reserve(files.size());
+    for (const FileDiagnostics &f: files) artifacts.emplace_back(f.file, &f.diagnostics);
+    writeSarif(out, artifacts);
+}
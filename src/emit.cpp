@@ -0,0 +1,394 @@
+#include "emit.h"
+#include "ascii.h"
+#include "diagnostics.h"
+#include "scan.h"
+#include "source.h"
+#include "trace.h"
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#include <fstream>
+#endif
+
+using namespace std;
+
+static constexpr size_t WORD_BYTES = 4;                 // Bytes per word in the raw and Intel HEX images
+static constexpr size_t INTEL_HEX_RECORD_BYTES = 16;    // Data bytes per Intel HEX record
+
+// Running state of the emitters that don't write each word on its own
+struct EmitState {
+    size_t address = 0;             // Byte address of the next word (Intel HEX)
+    size_t segment = 0;             // Upper 16 bits of the address last set with an extended linear address record
+    unsigned char record[INTEL_HEX_RECORD_BYTES];
+    size_t record_size = 0;
+    Word run_word = 0;              // Word being repeated (run-length encoding)
+    size_t run_length = 0;
+};
+
+static void appendHexByte(string &out, unsigned char byte){
+    out.push_back(HEX_DIGITS[byte >> 4]);
+    out.push_back(HEX_DIGITS[byte & 0x0f]);
+}
+
+static void appendHexWord(string &out, Word w){
+    char digits[WORD_HEX_DIGITS];
+    for (unsigned i = 0; i < WORD_HEX_DIGITS; i++) digits[i] = HEX_DIGITS[wordNibble(w, i)];
+    out.append(digits, sizeof(digits));
+}
+
+// Word formatters, each appends what its image holds for one word
+static void hexWord(string &out, EmitState &, Word w){
+    appendHexWord(out, w);
+    out.push_back('\n');
+}
+
+static void binaryWord(string &out, EmitState &, Word w){
+    // Only the lowest bit of the first hex digit is part of the 25 bit word
+    char line[WORD_BITS + 1];
+    line[0] = '0' + (wordNibble(w, 0) & 1);
+    for (unsigned i = 1; i < WORD_HEX_DIGITS; i++) memcpy(line + 1 + 4 * (i - 1), BIN_NIBBLES[wordNibble(w, i)], 4);
+    line[WORD_BITS] = '\n';
+    out.append(line, sizeof(line));
+}
+
+static void rawWord(string &out, EmitState &, Word w){
+    char bytes[WORD_BYTES];
+    for (size_t i = 0; i < WORD_BYTES; i++) bytes[i] = (w >> (8 * i)) & 0xff;
+    out.append(bytes, sizeof(bytes));
+}
+
+// Appends one Intel HEX record, ":LLAAAATT<data>CC"
+static void intelHexRecord(string &out, uint16_t address, uint8_t type, const unsigned char *data, size_t size){
+    unsigned char sum = size + (address >> 8) + (address & 0xff) + type;
+    out.push_back(':');
+    appendHexByte(out, size);
+    appendHexByte(out, address >> 8);
+    appendHexByte(out, address & 0xff);
+    appendHexByte(out, type);
+    for (size_t i = 0; i < size; i++){
+        appendHexByte(out, data[i]);
+        sum += data[i];
+    }
+    appendHexByte(out, -sum & 0xff);
+    out.push_back('\n');
+}
+
+static void intelHexFlush(string &out, EmitState &state){
+    if (state.record_size == 0) return;
+
+    size_t start = state.address - state.record_size;
+    if ((start >> 16) != state.segment){
+        state.segment = start >> 16;
+        unsigned char upper[2] = {(unsigned char)(state.segment >> 8), (unsigned char)(state.segment & 0xff)};
+        intelHexRecord(out, 0, 0x04, upper, sizeof(upper));
+    }
+    intelHexRecord(out, start & 0xffff, 0x00, state.record, state.record_size);
+    state.record_size = 0;
+}
+
+static void intelHexWord(string &out, EmitState &state, Word w){
+    // Records never cross a 64K segment, since their address only holds the lower 16 bits
+    for (size_t i = 0; i < WORD_BYTES; i++){
+        state.record[state.record_size++] = (w >> (8 * i)) & 0xff;
+        state.address++;
+        if (state.record_size == INTEL_HEX_RECORD_BYTES || (state.address & 0xffff) == 0) intelHexFlush(out, state);
+    }
+}
+
+static void intelHexEnd(string &out, EmitState &state){
+    intelHexFlush(out, state);
+    intelHexRecord(out, 0, 0x01, nullptr, 0);
+}
+
+static void rleFlush(string &out, EmitState &state){
+    if (state.run_length > 1){
+        out += to_string(state.run_length);
+        out.push_back('*');
+    }
+    if (state.run_length > 0){
+        appendHexWord(out, state.run_word);
+        out.push_back('\n');
+    }
+    state.run_length = 0;
+}
+
+static void rleWord(string &out, EmitState &state, Word w){
+    if (state.run_length > 0 && w == state.run_word){
+        state.run_length++;
+        return;
+    }
+    rleFlush(out, state);
+    state.run_word = w;
+    state.run_length = 1;
+}
+
+struct Emitter {
+    const char *name;               // Name it is selected by, nullptr if it always has its own option
+    const char *extension;          // Default file extension
+    const char *header;             // Written before the first word
+    size_t word_size;               // Upper bound of the characters written per word, used to size the buffer
+    bool carries_errors;            // Whether text diagnostics are interleaved with the words
+    bool binary;                    // Whether the image is bytes rather than text
+    bool fixed_size;                // Whether every word takes exactly word_size characters, at a known offset
+    void (*word)(string &out, EmitState &state, Word w);
+    void (*end)(string &out, EmitState &state);     // Writes whatever is still pending, may be nullptr
+};
+
+// Indexed by the image format
+static const Emitter EMITTERS[IMAGE_FORMATS] = {
+    {nullptr, ".txt", "v2.0 raw\n", WORD_HEX_DIGITS + 1, true, false, true, hexWord, nullptr},
+    {nullptr, ".txt", "", WORD_BITS + 1, false, false, true, binaryWord, nullptr},
+    {"raw", ".bin", "", WORD_BYTES, false, true, true, rawWord, nullptr},
+    {"ihex", ".hex", "", 2 * WORD_BYTES + 3, false, false, false, intelHexWord, intelHexEnd},
+    {"memh", ".memh", "", WORD_HEX_DIGITS + 1, false, false, true, hexWord, nullptr},
+    {"memb", ".memb", "", WORD_BITS + 1, false, false, true, binaryWord, nullptr},
+    {"rle", ".rle", "v2.0 raw\n", WORD_HEX_DIGITS + 1, false, false, false, rleWord, rleFlush}
+};
+
+void emitImages(const AssemblerContext &ctx, unsigned formats, bool with_errors, Images &images){
+    TraceSpan span("emit images", "emit", "formats", formats);
+    EmitState states[IMAGE_FORMATS];
+    size_t next_error = 0;
+
+    for (int f = 0; f < IMAGE_FORMATS; f++){
+        if (!(formats & IMAGE_BIT(f))) continue;
+        images.buffers[f].clear();
+        images.buffers[f].reserve(strlen(EMITTERS[f].header) + ctx.words.size() * EMITTERS[f].word_size + 16);
+        images.buffers[f] += EMITTERS[f].header;
+    }
+
+    for (size_t i = 0; i <= ctx.words.size(); i++){
+        while (with_errors && next_error < ctx.diagnostics.size() && ctx.diagnostics[next_error].position == i){
+            string text = renderText(ctx.diagnostics[next_error++]);
+            for (int f = 0; f < IMAGE_FORMATS; f++){
+                if ((formats & IMAGE_BIT(f)) && EMITTERS[f].carries_errors) images.buffers[f] += text;
+            }
+        }
+        if (i == ctx.words.size()) break;
+
+        for (int f = 0; f < IMAGE_FORMATS; f++){
+            if (formats & IMAGE_BIT(f)) EMITTERS[f].word(images.buffers[f], states[f], ctx.words[i]);
+        }
+    }
+
+    for (int f = 0; f < IMAGE_FORMATS; f++){
+        if ((formats & IMAGE_BIT(f)) && EMITTERS[f].end) EMITTERS[f].end(images.buffers[f], states[f]);
+    }
+}
+
+string emitFormat(const AssemblerContext &ctx, bool with_errors){
+    TraceSpan span("emit format", "emit");
+    string out;
+    size_t next_error = 0;
+
+    for (size_t i = 0; i <= ctx.lines.size(); i++){
+        while (with_errors && next_error < ctx.diagnostics.size() && ctx.diagnostics[next_error].position == i) out += renderText(ctx.diagnostics[next_error++]);
+        if (i == ctx.lines.size()) break;
+
+        size_t at = out.size();
+        out.resize(at + ctx.lines[i].text.size());
+        upperInto(&out[at], ctx.lines[i].text.data(), ctx.lines[i].text.size());
+        if (ctx.lines[i].kind == LINE_LABEL) out.push_back(':');
+        else if (ctx.lines[i].kind == LINE_STATEMENT) out.push_back(';');
+        out.push_back('\n');
+    }
+    return out;
+}
+
+int imageFormat(string_view name){
+    for (int f = 0; f < IMAGE_FORMATS; f++){
+        if (EMITTERS[f].name && equalsIgnoreCase(name, EMITTERS[f].name)) return f;
+    }
+    return -1;
+}
+
+const char *imageName(int format){
+    return EMITTERS[format].name;
+}
+
+const char *imageExtension(int format){
+    return EMITTERS[format].extension;
+}
+
+bool imageIsBinary(int format){
+    return EMITTERS[format].binary;
+}
+
+bool imageIsPatchable(int format){
+#ifndef _WIN32
+    return EMITTERS[format].fixed_size;
+#else
+    return EMITTERS[format].fixed_size && EMITTERS[format].binary;     // Text files get two characters per line ending
+#endif
+}
+
+bool patchImage(const string &path, int format, const vector<Word> &words, const vector<size_t> &indices){
+    const Emitter &emitter = EMITTERS[format];
+    size_t header = strlen(emitter.header);
+    if (!imageIsPatchable(format)) return false;
+
+    // Each word is formatted on its own, the state is only used by the emitters that aren't fixed size
+    EmitState state;
+    string out;
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_WRONLY);
+    if (fd < 0) return false;
+
+    // A file that doesn't hold as many words as expected wasn't written from these words
+    struct stat st;
+    bool ok = ::fstat(fd, &st) == 0 && size_t(st.st_size) == header + words.size() * emitter.word_size;
+    for (size_t i = 0; ok && i < indices.size(); i++){
+        out.clear();
+        emitter.word(out, state, words[indices[i]]);
+        ok = ::pwrite(fd, out.data(), out.size(), header + indices[i] * emitter.word_size) == ssize_t(out.size());
+    }
+    return ::close(fd) == 0 && ok;
+#else
+    fstream file(path, ios::in | ios::out | ios::binary);
+    if (!file.is_open()) return false;
+    file.seekg(0, ios::end);
+    if (size_t(file.tellg()) != header + words.size() * emitter.word_size) return false;
+    for (size_t i: indices){
+        out.clear();
+        emitter.word(out, state, words[i]);
+        file.seekp(header + i * emitter.word_size);
+        file.write(out.data(), out.size());
+    }
+    return bool(file);
+#endif
+}
+
+#ifndef _WIN32
+// A single write() in practice, the loop only picks up after a partial write or a signal
+static bool writeAll(int fd, string_view data){
+    while (!data.empty()){
+        ssize_t written = ::write(fd, data.data(), data.size());
+        if (written < 0){
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data.remove_prefix(written);
+    }
+    return true;
+}
+#endif
+
+bool writeFile(const string &path, string_view data, bool binary){
+#ifndef _WIN32
+    (void)binary;       // No difference between the two here
+    if (path == STANDARD_STREAM){
+        cout << flush;                  // Whatever went through cout before comes first
+        return writeAll(STDOUT_FILENO, data);
+    }
+
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    bool ok = writeAll(fd, data);
+    return ::close(fd) == 0 && ok;
+#else
+    if (path == STANDARD_STREAM){
+        cout.write(data.data(), data.size());
+        return bool(cout.flush());
+    }
+
+    ofstream file(path, binary ? ios::out | ios::binary : ios::out);
+    if (!file.is_open()) return false;
+    file.write(data.data(), data.size());
+    return bool(file);
+#endif
+}
+
+
+// Image streams
+ImageStream::ImageStream(): state(new EmitState()) {}
+
+ImageStream::~ImageStream(){
+    close();
+}
+
+bool ImageStream::open(const string &path, int image_format){
+    close();
+    format = image_format;
+    *state = EmitState();
+    bytes = 0;
+    buffer.clear();
+    buffer.reserve(STREAM_BUFFER_SIZE + EMITTERS[format].word_size + 64);
+    buffer += EMITTERS[format].header;
+    ok = true;
+
+#ifndef _WIN32
+    fd = (path == STANDARD_STREAM) ? STDOUT_FILENO : ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == STDOUT_FILENO) cout.flush();
+    ok = fd >= 0;
+#else
+    if (path != STANDARD_STREAM){
+        file.reset(new ofstream(path, imageIsBinary(format) ? ios::out | ios::binary : ios::out));
+        ok = file->is_open();
+    }
+    opened = true;
+#endif
+    return ok;
+}
+
+bool ImageStream::openAt(const string &path, int image_format, size_t index){
+    close();
+    format = image_format;
+    *state = EmitState();
+    bytes = 0;
+    buffer.clear();
+    buffer.reserve(STREAM_BUFFER_SIZE + EMITTERS[format].word_size);
+    uint64_t offset = strlen(EMITTERS[format].header) + index * EMITTERS[format].word_size;
+    ok = imageIsPatchable(format);
+
+#ifndef _WIN32
+    fd = ok ? ::open(path.c_str(), O_WRONLY) : -1;
+    ok = fd >= 0 && ::lseek(fd, off_t(offset), SEEK_SET) == off_t(offset);
+#else
+    file.reset(new ofstream(path, ios::in | ios::out | ios::binary));
+    ok = ok && file->is_open() && file->seekp(offset);
+    opened = true;
+#endif
+    return ok;
+}
+
+bool ImageStream::put(Word w){
+    EMITTERS[format].word(buffer, *state, w);
+    return buffer.size() < STREAM_BUFFER_SIZE || flush();
+}
+
+void ImageStream::putDiagnostic(const Diagnostic &d){
+    if (EMITTERS[format].carries_errors) buffer += renderText(d);
+}
+
+bool ImageStream::flush(){
+    if (!isOpen()) return false;
+#ifndef _WIN32
+    ok = ok && writeAll(fd, buffer);
+#else
+    ostream &out = file ? *file : cout;
+    ok = ok && out.write(buffer.data(), buffer.size()).flush();
+#endif
+    if (ok) bytes += buffer.size();
+    buffer.clear();
+    return ok;
+}
+
+bool ImageStream::close(){
+    if (!isOpen()) return ok;
+    if (EMITTERS[format].end) EMITTERS[format].end(buffer, *state);
+    flush();
+#ifndef _WIN32
+    if (fd != STDOUT_FILENO) ok = (::close(fd) == 0) && ok;
+    fd = -1;
+#else
+    file.reset();
+    opened = false;
+#endif
+    return ok;
+}
@@ -0,0 +1,223 @@
+#include "json.h"
+#include "diagnostics.h"
+#include <cmath>
+#include <cstdlib>
+
+using namespace std;
+
+static const JsonValue JSON_NONE;
+
+const JsonValue &JsonValue::operator[](string_view key) const{
+    if (type != JSON_OBJECT) return JSON_NONE;
+    for (const auto &[name, value]: members) if (name == key) return value;
+    return JSON_NONE;
+}
+
+const JsonValue &JsonValue::operator[](size_t i) const{
+    return (type == JSON_ARRAY && i < items.size()) ? items[i] : JSON_NONE;
+}
+
+
+// Reader
+namespace {
+
+struct JsonReader {
+    string_view text;
+    size_t pos = 0;
+
+    void skipSpace(){
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) pos++;
+    }
+
+    bool consume(char c){
+        skipSpace();
+        if (pos < text.size() && text[pos] == c){
+            pos++;
+            return true;
+        }
+        return false;
+    }
+
+    bool literal(string_view word){
+        if (text.substr(pos, word.size()) != word) return false;
+        pos += word.size();
+        return true;
+    }
+
+    bool hex4(uint32_t &code){
+        if (pos + 4 > text.size()) return false;
+        code = 0;
+        for (size_t i = 0; i < 4; i++){
+            char c = text[pos++];
+            if (c >= '0' && c <= '9') code = code * 16 + (c - '0');
+            else if (c >= 'a' && c <= 'f') code = code * 16 + (c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') code = code * 16 + (c - 'A' + 10);
+            else return false;
+        }
+        return true;
+    }
+
+    static void appendUtf8(string &out, uint32_t code){
+        if (code < 0x80) out += char(code);
+        else if (code < 0x800){
+            out += char(0xc0 | (code >> 6));
+            out += char(0x80 | (code & 0x3f));
+        }
+        else if (code < 0x10000){
+            out += char(0xe0 | (code >> 12));
+            out += char(0x80 | ((code >> 6) & 0x3f));
+            out += char(0x80 | (code & 0x3f));
+        }
+        else {
+            out += char(0xf0 | (code >> 18));
+            out += char(0x80 | ((code >> 12) & 0x3f));
+            out += char(0x80 | ((code >> 6) & 0x3f));
+            out += char(0x80 | (code & 0x3f));
+        }
+    }
+
+    // The opening quote is already consumed
+    bool readString(string &out){
+        for (;;){
+            size_t end = text.find_first_of("\"\\", pos);
+            if (end == string_view::npos) return false;
+            out.append(text.substr(pos, end - pos));
+            pos = end + 1;
+            if (text[end] == '"') return true;
+            if (pos >= text.size()) return false;
+
+            char c = text[pos++];
+            uint32_t code;
+            switch (c){
+                case '"': case '\\': case '/': out += c; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u':
+                    if (!hex4(code)) return false;
+                    // A high surrogate followed by a low one stands for a single code point
+                    if (code >= 0xd800 && code < 0xdc00 && text.substr(pos, 2) == "\\u"){
+                        uint32_t low;
+                        pos += 2;
+                        if (!hex4(low)) return false;
+                        if (low >= 0xdc00 && low < 0xe000) code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                        else {
+                            appendUtf8(out, code);
+                            code = low;
+                        }
+                    }
+                    appendUtf8(out, code);
+                    break;
+                default: return false;
+            }
+        }
+    }
+
+    bool readNumber(double &out){
+        size_t begin = pos;
+        if (pos < text.size() && text[pos] == '-') pos++;
+        while (pos < text.size() && ((text[pos] >= '0' && text[pos] <= '9') || text[pos] == '.' || text[pos] == 'e' || text[pos] == 'E' || text[pos] == '+' || text[pos] == '-')) pos++;
+        if (pos == begin) return false;
+
+        string number(text.substr(begin, pos - begin));
+        char *end;
+        out = strtod(number.c_str(), &end);
+        return *end == '\0';
+    }
+
+    bool readValue(JsonValue &value, size_t depth){
+        skipSpace();
+        if (pos >= text.size() || depth > JSON_MAX_DEPTH) return false;
+
+        char c = text[pos];
+        if (c == '{'){
+            pos++;
+            value.type = JSON_OBJECT;
+            if (consume('}')) return true;
+            do {
+                if (!consume('"')) return false;
+                value.members.emplace_back();
+                if (!readString(value.members.back().first) || !consume(':') || !readValue(value.members.back().second, depth + 1)) return false;
+            } while (consume(','));
+            return consume('}');
+        }
+        if (c == '['){
+            pos++;
+            value.type = JSON_ARRAY;
+            if (consume(']')) return true;
+            do {
+                value.items.emplace_back();
+                if (!readValue(value.items.back(), depth + 1)) return false;
+            } while (consume(','));
+            return consume(']');
+        }
+        if (c == '"'){
+            pos++;
+            value.type = JSON_STRING;
+            return readString(value.string);
+        }
+        if (literal("true") || literal("false")){
+            value.type = JSON_BOOLEAN;
+            value.boolean = c == 't';
+            return true;
+        }
+        if (literal("null")) return true;
+
+        value.type = JSON_NUMBER;
+        return readNumber(value.number);
+    }
+};
+
+}
+
+bool parseJson(string_view text, JsonValue &value){
+    JsonReader reader{text};
+    value = JsonValue();
+    if (!reader.readValue(value, 0)) return false;
+    reader.skipSpace();
+    return reader.pos == text.size();
+}
+
+
+// Writer
+void writeJson(ostream &out, const JsonValue &value){
+    switch (value.type){
+        case JSON_BOOLEAN:
+            out << (value.boolean ? "true" : "false");
+            break;
+
+        case JSON_NUMBER:
+            // Integers, as request IDs usually are, are written without a fraction
+            if (value.number == trunc(value.number) && fabs(value.number) < 9e15) out << int64_t(value.number);
+            else out << value.number;
+            break;
+
+        case JSON_STRING:
+            out << jsonEscape(value.string);
+            break;
+
+        case JSON_ARRAY:
+            out << '[';
+            for (size_t i = 0; i < value.items.size(); i++){
+                if (i) out << ',';
+                writeJson(out, value.items[i]);
+            }
+            out << ']';
+            break;
+
+        case JSON_OBJECT:
+            out << '{';
+            for (size_t i = 0; i < value.members.size(); i++){
+                if (i) out << ',';
+                out << jsonEscape(value.members[i].first) << ':';
+                writeJson(out, value.members[i].second);
+            }
+            out << '}';
+            break;
+
+        default:
+            out << "null";
+    }
+}
@@ -0,0 +1,506 @@
+#include "lsp.h"
+#include "ascii.h"
+#include "diagnostics.h"
+#include "json.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <unordered_map>
+
+#ifndef ASSEMBLER_VERSION
+#define ASSEMBLER_VERSION "dev"
+#endif
+
+using namespace std;
+
+#define LSP_MAX_MESSAGE (256u << 20)            // Largest message the editor may send
+
+// JSON-RPC error codes
+#define LSP_PARSE_ERROR -32700
+#define LSP_INVALID_REQUEST -32600
+#define LSP_METHOD_NOT_FOUND -32601
+
+// Operand shapes of every opcode, as listed in Valid OP Codes.txt
+static constexpr string_view OPCODE_EXAMPLES[] = {
+    "NOP;", "AND,R1,R2,R14;", "OR,R13,R4,R5;", "EXOR,R6,R7,R8;", "ADD,R9,R10,R11;", "ANDI,R12,R3,AE;", "ORI,R13,R11,A2;",
+    "EXORI,R3,R4,F5;", "ADDI,R6,R7,F8;", "MOV,R12,R13;", "MOVI,R12,AB;", "LOAD,R12,CD;", "STORE,83,R10;", "JMP,AB;",
+    "JMPZ,AC;", "JMPNZ,AD;", "JMPC,AE;", "JMPNC,AF;", "PUSH,R12;", "POP,R13;", "IN,R11,F1;", "OUT,F8,R14;",
+    "LOADI,R10,R2;", "STOREI,R10,R2;", "SUB,R12,R13,R14;", "SHIFTR,R12,R13,R1;", "SHIFTL,R2,R3,R14;", "JMPPCRZ,AD;", "JMPPCRNZ,AE;"
+};
+
+static_assert(sizeof(OPCODE_EXAMPLES) / sizeof(OPCODE_EXAMPLES[0]) == OP_TABLE_SIZE, "Every opcode should have an example");
+
+// Characters label names are made of
+static bool isNameChar(char c){
+    c = upperChar(c);
+    return (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// Appends the offset of each line starting in [from, to) of `text`
+static void splitLines(string_view text, size_t from, size_t to, vector<size_t> &starts){
+    for (size_t pos = from; pos < to;){
+        starts.push_back(pos);
+        const char *nl = (const char *)memchr(text.data() + pos, '\n', to - pos);
+        pos = nl ? nl - text.data() + 1 : to;
+    }
+}
+
+static string hexDigits(uint32_t value, unsigned digits){
+    string out(digits, '0');
+    for (unsigned i = 0; i < digits; i++) out[digits - 1 - i] = HEX_DIGITS[(value >> (4 * i)) & 0x0f];
+    return out;
+}
+
+// E.g. "2 registers and a DAT"
+static string operandShape(const Opcode &op){
+    unsigned regs = (op.instr_num >> 2) & 0x03;
+    string shape = regs ? to_string(regs) + (regs == 1 ? " register" : " registers") : "";
+
+    if (op.instr_num & 0x10) shape += string(regs ? " and " : "") + ((op.instr_num & 0x20) ? "a DAT or a label" : "a DAT");
+    return shape.empty() ? "no operands" : shape;
+}
+
+
+// Document
+void LspDocument::open(string source){
+    text = std::move(source);
+    starts.clear();
+    splitLines(text, 0, text.size(), starts);
+    starts.push_back(text.size());
+
+    lines.assign(starts.size() - 1, DocumentLine());
+    stats = DocumentStats();
+    scan(0, lines.size());
+    analyze();
+}
+
+void LspDocument::edit(DocumentPosition start, DocumentPosition end, string_view insert){
+    size_t from = offsetOf(start), to = max(from, offsetOf(end));
+    size_t first = lineOf(from), last = min(lineOf(to) + 1, lines.size());
+
+    // The lines edited are taken whole, up to the newline ending the last of them, which the edit can't reach
+    size_t begin = starts[first];
+    ptrdiff_t shift = ptrdiff_t(insert.size()) - ptrdiff_t(to - from);
+    text.replace(from, to - from, insert);
+
+    vector<size_t> region;
+    splitLines(text, begin, starts[last] + shift, region);
+    starts.erase(starts.begin() + first, starts.begin() + last);
+    starts.insert(starts.begin() + first, region.begin(), region.end());
+    if (shift) for (size_t i = first + region.size(); i < starts.size(); i++) starts[i] += shift;
+
+    lines.erase(lines.begin() + first, lines.begin() + last);
+    lines.insert(lines.begin() + first, region.size(), DocumentLine());
+    stats = DocumentStats();
+    scan(first, first + region.size());
+    analyze();
+}
+
+size_t LspDocument::offsetOf(DocumentPosition at) const{
+    if (at.line >= lines.size()) return text.size();
+    return starts[at.line] + min(at.character, lineText(at.line).size());
+}
+
+// Line holding the byte at `offset`, the end of the text belonging to the last line
+size_t LspDocument::lineOf(size_t offset) const{
+    if (lines.empty()) return 0;
+    return upper_bound(starts.begin(), starts.end() - 1, offset) - starts.begin() - 1;
+}
+
+// Without its newline
+string_view LspDocument::lineText(size_t line) const{
+    string_view s = string_view(text).substr(starts[line], starts[line + 1] - starts[line]);
+    if (!s.empty() && s.back() == '\n') s.remove_suffix(1);
+    return s;
+}
+
+// Scans source lines [first, last) on their own, as the first pass would
+void LspDocument::scan(size_t first, size_t last){
+    stats.scanned += last - first;
+    if (first == last) return;
+
+    string_view region = string_view(text).substr(starts[first], starts[last] - starts[first]);
+    scratch.clear();
+    firstPass(scratch, region);
+
+    for (const SourceLine &source: scratch.lines){
+        size_t i = first + source.source_line - 1;
+        lines[i].kind = source.kind;
+        lines[i].column = source.text.data() - (text.data() + starts[i]);
+        lines[i].length = source.text.size();
+    }
+
+    // A label defined twice in the region is still a label, whether it is a duplicate is decided by analyze()
+    for (Diagnostic &d: scratch.diagnostics){
+        DocumentLine &line = lines[first + d.source_line - 1];
+        if (d.code == LABEL_DUPLICATE){
+            line.kind = LINE_LABEL;
+            line.column = d.column_begin - 1;
+            line.length = d.column_end - d.column_begin;
+        }
+        else {
+            line.kind = LINE_BAD_LABEL;
+            line.errors.push_back(std::move(d));
+        }
+    }
+}
+
+// Records the labels and builds the line table from the lines scanned, then encodes the statements that may have changed
+void LspDocument::analyze(){
+    swap(previous, ctx.labels);
+    ctx.labels.clear();
+    ctx.lines.clear();
+    definitions.clear();
+    duplicates.clear();
+
+    // Addresses are counted the way firstPass() does, bad and duplicate labels taking one too
+    size_t address = 0;
+    for (size_t i = 0; i < lines.size(); i++){
+        const DocumentLine &line = lines[i];
+        if (line.kind == LINE_BLANK) continue;
+        if (line.kind == LINE_BAD_LABEL){
+            address++;
+            continue;
+        }
+
+        SourceLine source = {string_view(text).substr(starts[i] + line.column, line.length), line.kind, uint32_t(i + 1), line.column};
+        if (line.kind == LINE_LABEL){
+            auto [id, inserted] = ctx.labels.insert(source.text, address);
+            if (!inserted){
+                Diagnostic d;
+                d.line = address + 1;
+                d.position = ctx.lines.size();
+                d.code = LABEL_DUPLICATE;
+                d.source_line = i + 1;
+                d.column_begin = line.column + 1;
+                d.column_end = d.column_begin + line.length;
+                d.message = "Already duplicate label: " + upperCopy(source.text) + ", at line number " + to_string(address + 1) + ".";
+                d.hint = "Label already defined at: " + to_string(ctx.labels.address(id) + 1) + ".";
+                duplicates.push_back(std::move(d));
+                address++;
+                continue;
+            }
+            definitions.push_back(i);
+        }
+        ctx.lines.push_back(source);
+        address++;
+    }
+
+    // Labels that are new, gone or at another address
+    SymbolTable dirty;
+    for (SymbolId id = 0; id < ctx.labels.size(); id++){
+        SymbolId was = previous.find(ctx.labels.name(id));
+        if (was == NO_SYMBOL || previous.address(was) != ctx.labels.address(id)) dirty.insert(ctx.labels.name(id), 0);
+    }
+    for (SymbolId id = 0; id < previous.size(); id++){
+        if (ctx.labels.find(previous.name(id)) == NO_SYMBOL) dirty.insert(previous.name(id), 0);
+    }
+
+    // Errors are always found again, as their messages count the lines of the formatted code
+    EncodedRun run;
+    string_view block;
+    for (size_t j = 0; j < ctx.lines.size(); j++){
+        const SourceLine &source = ctx.lines[j];
+        if (source.kind == LINE_LABEL){
+            block = source.text;
+            continue;
+        }
+
+        size_t i = source.source_line - 1;
+        DocumentLine &line = lines[i];
+        string_view dataline = string_view(text).substr(starts[i] + line.dataline_column, line.dataline_length);
+        if (line.encoded && line.errors.empty() && (dataline.empty() || dirty.find(dataline) == NO_SYMBOL)) continue;
+
+        run.diagnostics.clear();
+        encodeLine(ctx, run, j, block, line.word, &dataline);
+        line.encoded = true;
+        line.errors = std::move(run.diagnostics);
+        line.dataline_column = dataline.empty() ? 0 : dataline.data() - (text.data() + starts[i]);
+        line.dataline_length = dataline.size();
+        stats.encoded++;
+    }
+}
+
+vector<Diagnostic> LspDocument::diagnostics() const{
+    vector<Diagnostic> out;
+    size_t next = 0;
+
+    for (size_t i = 0; i < lines.size(); i++){
+        while (next < duplicates.size() && duplicates[next].source_line == i + 1) out.push_back(duplicates[next++]);
+        for (const Diagnostic &d: lines[i].errors){
+            out.push_back(d);
+            out.back().source_line = i + 1;
+        }
+    }
+    return out;
+}
+
+// Label name, or anything that could be one, around `at`. Only the text kept in the line table counts, comments don't.
+string_view LspDocument::wordAt(DocumentPosition at, DocumentRange &range) const{
+    if (at.line >= lines.size()) return string_view();
+    const DocumentLine &line = lines[at.line];
+    if (line.kind != LINE_LABEL && line.kind != LINE_STATEMENT && line.kind != LINE_UNTERMINATED) return string_view();
+
+    string_view s = lineText(at.line);
+    size_t begin = min(at.character, s.size()), end = begin;
+    while (begin > line.column && isNameChar(s[begin - 1])) begin--;
+    while (end < line.column + line.length && isNameChar(s[end])) end++;
+    if (begin >= end || begin < line.column) return string_view();
+
+    range = {at.line, begin, end};
+    return s.substr(begin, end - begin);
+}
+
+bool LspDocument::definition(DocumentPosition at, DocumentRange &range) const{
+    DocumentRange word;
+    SymbolId id = ctx.labels.find(wordAt(at, word));
+    if (id == NO_SYMBOL) return false;
+
+    size_t i = definitions[id];
+    range = {i, lines[i].column, lines[i].column + lines[i].length};
+    return true;
+}
+
+vector<DocumentRange> LspDocument::references(DocumentPosition at, bool declaration) const{
+    vector<DocumentRange> ranges;
+    DocumentRange word;
+    SymbolId id = ctx.labels.find(wordAt(at, word));
+    if (id == NO_SYMBOL) return ranges;
+
+    if (declaration) ranges.push_back({definitions[id], lines[definitions[id]].column, lines[definitions[id]].column + lines[definitions[id]].length});
+    for (size_t i = 0; i < lines.size(); i++){
+        const DocumentLine &line = lines[i];
+        if (line.kind != LINE_STATEMENT || !line.dataline_length || !line.errors.empty()) continue;
+        if (equalsIgnoreCase(string_view(text).substr(starts[i] + line.dataline_column, line.dataline_length), ctx.labels.name(id))){
+            ranges.push_back({i, line.dataline_column, line.dataline_column + line.dataline_length});
+        }
+    }
+    return ranges;
+}
+
+string LspDocument::hover(DocumentPosition at, DocumentRange &range) const{
+    string_view word = wordAt(at, range);
+    if (word.empty()) return string();
+
+    ostringstream out;
+    SymbolId id = ctx.labels.find(word);
+    if (id != NO_SYMBOL){
+        size_t address = ctx.labels.address(id);
+        out << "Label `" << upperCopy(ctx.labels.name(id)) << "` at address `" << hexDigits(address, address > 0xff ? 4 : 2) << "`, defined at line " << definitions[id] + 1 << '.';
+        return out.str();
+    }
+
+    // Anywhere else on a statement, the statement itself
+    const DocumentLine &line = lines[at.line];
+    if (line.kind != LINE_STATEMENT) return string();
+    string_view statement = lineText(at.line).substr(line.column, line.length);
+    const Opcode *op = findOpcode(strip(statement.substr(0, statement.find(','))));
+    if (!op) return string();
+
+    range = {at.line, line.column, line.column + line.length};
+    out << "**" << op->opcode << "** `" << hexDigits(op->code, 2) << "`: " << operandShape(*op) << "\n\n"
+        << "`" << OPCODE_EXAMPLES[op->code] << "`\n\n";
+    if (line.encoded && line.errors.empty()){
+        DecodedWord d = decode(line.word);
+        out << "Encodes to `" << hexDigits(line.word, WORD_HEX_DIGITS) << "`: opcode `" << hexDigits(d.opcode, 2) << "`, Rw `" << hexDigits(d.rw, 1)
+            << "`, Rx `" << hexDigits(d.rx, 1) << "`, Ry `" << hexDigits(d.ry, 1) << "`, DAT `" << hexDigits(d.dat, 2) << '`';
+    }
+    else if (!line.errors.empty()) out << "Does not encode: " << line.errors[0].message;
+    return out.str();
+}
+
+
+// Server
+namespace {
+
+class LanguageServer {
+public:
+    LanguageServer(ostream &out, ostream &log, bool verbose): out(out), log(log), verbose(verbose) {}
+    bool handle(const JsonValue &message);         // Returns false once asked to exit
+    void fail(const JsonValue &id, int code, string_view message);
+    bool stopped() const { return shutdown; }
+
+private:
+    void send(const string &json);
+    void reply(const JsonValue &id, const string &result);
+    void publish(const string &uri, const LspDocument *document);
+    LspDocument *find(const JsonValue &params);
+
+    ostream &out;
+    ostream &log;
+    bool verbose;
+    bool shutdown = false;
+    unordered_map<string, LspDocument> documents;      // By URI
+};
+
+}
+
+static DocumentPosition positionOf(const JsonValue &v){
+    return {size_t(max<int64_t>(0, v["line"].asInt())), size_t(max<int64_t>(0, v["character"].asInt()))};
+}
+
+static string rangeJson(const DocumentRange &r){
+    return "{\"start\":{\"line\":" + to_string(r.line) + ",\"character\":" + to_string(r.begin) + "},\"end\":{\"line\":" + to_string(r.line) + ",\"character\":" + to_string(r.end) + "}}";
+}
+
+static string locationJson(const string &uri, const DocumentRange &r){
+    return "{\"uri\":" + jsonEscape(uri) + ",\"range\":" + rangeJson(r) + '}';
+}
+
+// Reads the next message, "Content-Length: <n>" and any other headers, an empty line, then <n> bytes of JSON
+static bool readMessage(istream &in, string &body){
+    string header;
+    size_t length = SIZE_MAX;
+
+    while (getline(in, header)){
+        if (!header.empty() && header.back() == '\r') header.pop_back();
+        if (header.empty()) break;
+
+        size_t colon = header.find(':');
+        if (colon != string::npos && equalsIgnoreCase(string_view(header).substr(0, colon), "Content-Length")){
+            length = strtoull(header.c_str() + colon + 1, nullptr, 10);
+        }
+    }
+    if (!in || length == SIZE_MAX || length > LSP_MAX_MESSAGE) return false;
+
+    body.resize(length);
+    return bool(in.read(body.data(), length));
+}
+
+void LanguageServer::send(const string &json){
+    out << "Content-Length: " << json.size() << "\r\n\r\n" << json << flush;
+}
+
+void LanguageServer::reply(const JsonValue &id, const string &result){
+    ostringstream json;
+    json << "{\"jsonrpc\":\"2.0\",\"id\":";
+    writeJson(json, id);
+    json << ",\"result\":" << result << '}';
+    send(json.str());
+}
+
+void LanguageServer::fail(const JsonValue &id, int code, string_view message){
+    ostringstream json;
+    json << "{\"jsonrpc\":\"2.0\",\"id\":";
+    writeJson(json, id);
+    json << ",\"error\":{\"code\":" << code << ",\"message\":" << jsonEscape(message) << "}}";
+    send(json.str());
+}
+
+// Sends the diagnostics of a document, none if it was closed
+void LanguageServer::publish(const string &uri, const LspDocument *document){
+    ostringstream json;
+    json << "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":" << jsonEscape(uri) << ",\"diagnostics\":[";
+    if (document){
+        bool first = true;
+        for (const Diagnostic &d: document->diagnostics()){
+            string message = d.hint.empty() ? d.message : d.message + ' ' + d.hint;
+            json << (first ? "" : ",") << "{\"range\":" << rangeJson({d.source_line - 1, d.column_begin - 1, d.column_end - 1})
+                 << ",\"severity\":1,\"code\":" << int(d.code) << ",\"source\":\"assembler\",\"message\":" << jsonEscape(message) << '}';
+            first = false;
+        }
+    }
+    json << "]}}";
+    send(json.str());
+}
+
+LspDocument *LanguageServer::find(const JsonValue &params){
+    auto it = documents.find(string(params["textDocument"]["uri"].asString()));
+    return it == documents.end() ? nullptr : &it->second;
+}
+
+bool LanguageServer::handle(const JsonValue &message){
+    string_view method = message["method"].asString();
+    const JsonValue &id = message["id"];
+    const JsonValue &params = message["params"];
+    bool request = !id.isNull();
+
+    if (method == "exit") return false;
+    if (shutdown && request){
+        fail(id, LSP_INVALID_REQUEST, "The server is shutting down");
+        return true;
+    }
+
+    if (method == "initialize"){
+        reply(id, "{\"capabilities\":{\"textDocumentSync\":{\"openClose\":true,\"change\":2},\"definitionProvider\":true,\"referencesProvider\":true,\"hoverProvider\":true},"
+                  "\"serverInfo\":{\"name\":\"Assembler\",\"version\":" + jsonEscape(ASSEMBLER_VERSION) + "}}");
+    }
+    else if (method == "shutdown"){
+        shutdown = true;
+        reply(id, "null");
+    }
+    else if (method == "textDocument/didOpen"){
+        string uri(params["textDocument"]["uri"].asString());
+        LspDocument &document = documents[uri];
+        document.open(string(params["textDocument"]["text"].asString()));
+        publish(uri, &document);
+    }
+    else if (method == "textDocument/didChange"){
+        LspDocument *document = find(params);
+        if (!document) return true;
+
+        auto start = chrono::steady_clock::now();
+        DocumentStats work;
+        for (const JsonValue &change: params["contentChanges"].items){
+            const JsonValue &range = change["range"];
+            if (range.isNull()) document->open(string(change["text"].asString()));
+            else document->edit(positionOf(range["start"]), positionOf(range["end"]), change["text"].asString());
+            work.scanned += document->lastChange().scanned;
+            work.encoded += document->lastChange().encoded;
+        }
+        publish(string(params["textDocument"]["uri"].asString()), document);
+
+        chrono::duration<double, milli> took = chrono::steady_clock::now() - start;
+        if (verbose) log << "Changed " << params["textDocument"]["uri"].asString() << ": " << work.scanned << (work.scanned == 1 ? " line" : " lines") << " scanned, "
+                         << work.encoded << (work.encoded == 1 ? " statement" : " statements") << " encoded in " << fixed << setprecision(3) << took.count() << " ms." << defaultfloat << endl;
+    }
+    else if (method == "textDocument/didClose"){
+        string uri(params["textDocument"]["uri"].asString());
+        documents.erase(uri);
+        publish(uri, nullptr);
+    }
+    else if (method == "textDocument/definition"){
+        LspDocument *document = find(params);
+        DocumentRange range;
+        if (document && document->definition(positionOf(params["position"]), range)) reply(id, locationJson(string(params["textDocument"]["uri"].asString()), range));
+        else reply(id, "null");
+    }
+    else if (method == "textDocument/references"){
+        LspDocument *document = find(params);
+        string result = "[";
+        if (document){
+            for (const DocumentRange &range: document->references(positionOf(params["position"]), params["context"]["includeDeclaration"].asBool())){
+                result += (result.size() > 1 ? "," : "") + locationJson(string(params["textDocument"]["uri"].asString()), range);
+            }
+        }
+        reply(id, result + ']');
+    }
+    else if (method == "textDocument/hover"){
+        LspDocument *document = find(params);
+        DocumentRange range;
+        string contents = document ? document->hover(positionOf(params["position"]), range) : string();
+        if (contents.empty()) reply(id, "null");
+        else reply(id, "{\"contents\":{\"kind\":\"markdown\",\"value\":" + jsonEscape(contents) + "},\"range\":" + rangeJson(range) + '}');
+    }
+    else if (request) fail(id, LSP_METHOD_NOT_FOUND, "Unknown method " + string(method));
+    return true;
+}
+
+int runLanguageServer(istream &in, ostream &out, ostream &log, bool verbose){
+    LanguageServer server(out, log, verbose);
+    string body;
+
+    while (readMessage(in, body)){
+        JsonValue message;
+        if (!parseJson(body, message) || message.type != JSON_OBJECT){
+            server.fail(JsonValue(), LSP_PARSE_ERROR, "Invalid JSON");
+            continue;
+        }
+        if (!server.handle(message)) break;
+    }
+    return server.stopped() ? 0 : 1;
+}
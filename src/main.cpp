@@ -37,13 +37,36 @@ extern "C" {                            // This ensure this particular code is c
 
 // Including the rest of the headers
 #include "assembler.h"    // Header file for the Assembler
+#include "source.h"
+#include "diagnostics.h"
+#include "emit.h"
+#include "thread_pool.h"
+#include "cache.h"
+#include "server.h"
+#include "watch.h"
+#include "lsp.h"
+#include "stream.h"
+#include "bounded.h"
+#include "stats.h"
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <cstddef> // For size_t
+#include <cstdlib>
+#include <filesystem>
 #include <fstream>
+#include <functional>
+#include <iomanip>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <sstream>
 #include <string>
-#include <filesystem>
-#include <algorithm>
+#include <string_view>
+#include <vector>
 
 #ifndef ASSEMBLER_VERSION
 #define ASSEMBLER_VERSION "dev"
@@ -59,71 +82,264 @@ extern "C" {                            // This ensure this particular code is c
 #define ASSEMBLY_CODE_ERROR  8
 
 using namespace std;
+namespace fs = std::filesystem;
 
 void usage(void);  // Function to tell what to pass is expected in command line arguement
 
+// Every allocation of the program, counted for --stats once it turns counting on (see stats.h)
+void *operator new(size_t size){
+    if (countingHeap()) countAllocation(size);
+    if (void *p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+// Options that only have a long form, or a long form along with their short one
+#define OPTION_MEMO 256
+#define OPTION_STATS 257
+#define OPTION_CACHE 258
+#define OPTION_CACHE_SIZE 259
+#define OPTION_CACHE_STATS 260
+#define OPTION_SERVE 261
+#define OPTION_WATCH 262
+#define OPTION_LSP 263
+#define OPTION_STREAM 264
+#define OPTION_LOW_MEMORY 265
+#define OPTION_COUNTERS 266
+#define OPTION_TRACE 267
+
+static const struct option LONG_OPTIONS[] = {
+    {"diagnostics", required_argument, nullptr, 'd'},
+    {"emit", required_argument, nullptr, 'e'},
+    {"manifest", required_argument, nullptr, 'm'},
+    {"jobs", required_argument, nullptr, 'j'},
+    {"output-dir", required_argument, nullptr, 'O'},
+    {"memo", no_argument, nullptr, OPTION_MEMO},
+    {"stats", optional_argument, nullptr, OPTION_STATS},
+    {"cache", required_argument, nullptr, OPTION_CACHE},
+    {"cache-size", required_argument, nullptr, OPTION_CACHE_SIZE},
+    {"cache-stats", no_argument, nullptr, OPTION_CACHE_STATS},
+    {"serve", required_argument, nullptr, OPTION_SERVE},
+    {"watch", no_argument, nullptr, OPTION_WATCH},
+    {"lsp", no_argument, nullptr, OPTION_LSP},
+    {"stream", no_argument, nullptr, OPTION_STREAM},
+    {"low-memory", no_argument, nullptr, OPTION_LOW_MEMORY},
+    {"counters", no_argument, nullptr, OPTION_COUNTERS},
+    {"trace", required_argument, nullptr, OPTION_TRACE},
+    {nullptr, 0, nullptr, 0}
+};
+
+// What the command line asked for, the same for every source file assembled
+struct Settings {
+    AssemblerOptions options;
+    int diagnostics = DIAGNOSTICS_TEXT;     // How errors are reported, see diagnostics.h
+    unsigned extra_images = 0;              // Images asked for with -e, as a mask of IMAGE_BIT()s
+    size_t jobs = 0;                        // -j, threads to use, 0 for one per hardware thread
+    bool batch = false;                     // In batch mode the files are spread over the threads, not the passes of one file
+    bool stats = false;                     // --stats, report the counters of the assembly once done
+    string stats_file;                      // --stats=<file>, where they are also written as JSON
+    bool to_stdout = false;                 // Whether a generated file is "-", the standard output
+    BuildCache *cache = nullptr;            // --cache, where clean assemblies are stored and looked up, if given
+};
+
+// One source file, and the files generated from it
+struct Unit {
+    string input = "asmcode.txt";           // Default input file
+    string output = "hexcode.txt";          // Default output file
+    string binary = "bin.txt";              // Default binary file
+    string formatted = "format.txt";        // Default format file for assembly
+    string image_files[IMAGE_FORMATS];      // Files of the images asked for with -e, empty for the default name
+    vector<Diagnostic> diagnostics;
+    AssemblerStats stats;
+    RunStats run;                           // Filled with --stats alone
+    int status = 0;                         // Exit status of this file alone
+};
+
+static int assembleUnit(Unit &unit, const Settings &settings, ostream &log);
+static int assembleSource(Unit &unit, const Settings &settings, AssemblerContext &ctx, ostream &log);
+static int writeFormat(Unit &unit, const Settings &settings, const AssemblerContext &ctx, bool labelling_error, RunStats *run, bool thread_cpu, string &formatted, ostream &log);
+static int writeImages(Unit &unit, const Settings &settings, const AssemblerContext &ctx, RunStats *run, bool thread_cpu, Images &images, ostream &log);
+static int writeOutputs(Unit &unit, const Settings &settings, const function<bool(int, const string &)> &put, ostream &log);
+static bool writeOutput(RunStats *run, bool thread_cpu, const string &path, string_view data, bool binary = false);
+static string cacheOptions(const Settings &settings);
+static unsigned cachedFiles(const Settings &settings);
+static int runBatch(vector<Unit> &units, const Settings &settings);
+static int runWatch(Unit &unit, const Settings &settings, ostream &log);
+static int runStream(Unit &unit, const Settings &settings, ostream &log);
+static int runLowMemory(Unit &unit, const Settings &settings, ostream &log);
+static bool readManifest(const string &path, vector<string> &inputs);
+static void listDirectory(const string &path, vector<string> &inputs);
+static string imageFile(const Unit &unit, int format);
+static bool isTextFile(const string &path);
+static bool isStandardStream(const string &path);
+static void printStats(ostream &log, const Settings &settings, const RunStats &run, const AssemblerStats &stats);
+static void printCacheStats(ostream &log, BuildCache &cache, uint64_t max_bytes);
+static bool parseSize(const char *s, uint64_t &size);
+
 int main(int argc, char **argv){
-    string input = "asmcode.txt";       // Default input file
-    string output = "hexcode.txt";      // Default output file
-    string binary = "bin.txt";          // Default binary file
-    string formatted = "format.txt";    // Default format file for assembly
-    string label = "";                  // Keeping label blank in case there is no label at line 0
-    string line;
-    size_t line_num = 0;                // Line number of the assembly code 
-    char c;         // Variable to store the command line argument
-    map<string, size_t> labels;
-
-    // Setting ERR to false;
-    ERR = false;
-    /*
-     * Flag to make checks
-     * 0th bit set. Make a binary file (default);
-     * 1st bit set. Only compile till the formatted file, will generate the format file
-     * 2nd bit set. Generate the format file. Set with flag -f
-    */
-    unsigned char flag = 0x01;
+    Unit single;                        // The file assembled when not in batch mode
+    Settings settings;
+    int c;          // Variable to store the command line argument
+    bool cmd_error = false;             // Whether there was an error in the command line arguments
+    vector<string> inputs;              // Every -i, in the order given
+    vector<string> manifests;           // Every -m, in the order given
+    string output_dir;                  // -O, where batch mode puts the generated files
+    bool named_outputs = false;         // Whether a single output file was named, which batch mode can't honour
+    BuildCache cache;
+    string cache_dir;                   // --cache
+    uint64_t cache_size = CACHE_DEFAULT_SIZE;
+    bool cache_stats = false;
+    string socket_path;                 // --serve
+    bool watch = false;                 // --watch
+    bool lsp = false;                   // --lsp
+    bool stream = false;                // --stream
+    bool low_memory = false;            // --low-memory
+    bool counters = false;              // --counters
+    string trace_file;                  // --trace
+
     // Using getopt to parse the command line arguments
-    while((c = getopt(argc, argv, ":i:o:b:f:cnhv")) != -1) {
+    while((c = getopt_long(argc, argv, ":i:o:b:f:d:e:m:j:O:cnhv", LONG_OPTIONS, nullptr)) != -1) {
         switch (c) {
             case 'i':
-                input = optarg;
-                if (input.find_last_of('.') == string::npos || input.substr(input.find_last_of('.') + 1) != "txt"){
+                inputs.push_back(optarg);
+                if (!isStandardStream(optarg) && !fs::is_directory(optarg) && !isTextFile(optarg)){
                     cout << "Error: Invalid input file. The input file should be a text file.\n";
-                    ERR = true;
+                    cmd_error = true;
                 }
                 break;
 
             case 'o':
-                output = optarg;
-                if (output.find_last_of('.') == string::npos || output.substr(output.find_last_of('.') + 1) != "txt"){
+                single.output = optarg;
+                named_outputs = true;
+                if (!isStandardStream(single.output) && !isTextFile(single.output)){
                     cout << "Error: Invalid output file. The output file should be a text file.\n";
-                    ERR = true;
+                    cmd_error = true;
                 }
                 break;
 
             case 'b':
-                binary = optarg;
-                if (binary.find_last_of('.') == string::npos || binary.substr(binary.find_last_of('.') + 1) != "txt"){
+                single.binary = optarg;
+                named_outputs = true;
+                if (!isStandardStream(single.binary) && !isTextFile(single.binary)){
                     cout << "Error: Invalid binary file. The binary file should be a text file.\n";
-                    ERR = true;
+                    cmd_error = true;
                 }
                 break;
 
             case 'f':
-                flag |= 0x04;
-                formatted = optarg;
-                if (formatted.find_last_of('.') == string::npos || formatted.substr(formatted.find_last_of('.') + 1) != "txt"){
-                    cout << "Error: Invalid format file. The format file " << formatted << " should be a text file.\n";
-                    ERR = true;
+                settings.options.format = true;
+                single.formatted = optarg;
+                if (!isStandardStream(single.formatted) && !isTextFile(single.formatted)){
+                    cout << "Error: Invalid format file. The format file " << single.formatted << " should be a text file.\n";
+                    cmd_error = true;
+                }
+                break;
+
+            case 'd':
+                if (string(optarg) == "text") settings.diagnostics = DIAGNOSTICS_TEXT;
+                else if (string(optarg) == "json") settings.diagnostics = DIAGNOSTICS_JSON;
+                else if (string(optarg) == "sarif") settings.diagnostics = DIAGNOSTICS_SARIF;
+                else {
+                    cout << "Error: Invalid diagnostics format " << optarg << ". Expected one of text, json or sarif.\n";
+                    cmd_error = true;
                 }
                 break;
 
+            case 'e': {
+                // <format> or <format>=<file>
+                string_view arg = optarg;
+                size_t equals = arg.find('=');
+                int image = imageFormat(arg.substr(0, equals));
+                if (image < 0){
+                    cout << "Error: Invalid image format " << arg.substr(0, equals) << ". Expected one of raw, ihex, memh, memb or rle.\n";
+                    cmd_error = true;
+                    break;
+                }
+                settings.extra_images |= IMAGE_BIT(image);
+                single.image_files[image] = (equals == string_view::npos) ? "" : string(arg.substr(equals + 1));
+                if (equals != string_view::npos) named_outputs = true;
+                break;
+            }
+
+            case 'm':
+                manifests.push_back(optarg);
+                break;
+
+            case 'j': {
+                char *end;
+                long n = strtol(optarg, &end, 10);
+                if (*end != '\0' || n < 1){
+                    cout << "Error: Invalid number of jobs " << optarg << ". It should be a positive number.\n";
+                    cmd_error = true;
+                }
+                else settings.jobs = n;
+                break;
+            }
+
+            case 'O':
+                output_dir = optarg;
+                break;
+
             case 'c':
-                flag |= 0x02;
+                settings.options.format_only = true;
                 break;
 
             case 'n':
-                flag &= 0xfe;         // Resetting bit 0;
+                settings.options.binary = false;
+                break;
+
+            case OPTION_MEMO:
+                settings.options.memo = true;
+                break;
+
+            case OPTION_STATS:
+                settings.stats = true;
+                if (optarg) settings.stats_file = optarg;
+                break;
+
+            case OPTION_CACHE:
+                cache_dir = optarg;
+                break;
+
+            case OPTION_CACHE_SIZE:
+                if (!parseSize(optarg, cache_size)){
+                    cout << "Error: Invalid cache size " << optarg << ". It should be a number of bytes, optionally followed by K, M or G.\n";
+                    cmd_error = true;
+                }
+                break;
+
+            case OPTION_CACHE_STATS:
+                cache_stats = true;
+                break;
+
+            case OPTION_SERVE:
+                socket_path = optarg;
+                break;
+
+            case OPTION_WATCH:
+                watch = true;
+                break;
+
+            case OPTION_LSP:
+                lsp = true;
+                break;
+
+            case OPTION_STREAM:
+                stream = true;
+                break;
+
+            case OPTION_LOW_MEMORY:
+                low_memory = true;
+                break;
+
+            case OPTION_COUNTERS:
+                settings.stats = true;
+                counters = true;
+                break;
+
+            case OPTION_TRACE:
+                trace_file = optarg;
                 break;
 
             case 'h':
@@ -136,7 +352,7 @@ int main(int argc, char **argv){
 
             case ':':
                 cout << "Unrecognized option: " << (char)optopt << endl;
-                ERR = true;
+                cmd_error = true;
                 break;
 
             case '?':
@@ -148,226 +364,877 @@ int main(int argc, char **argv){
                 return COMMAND_LINE_ERROR;
         }
     }
-    if (ERR) return COMMAND_LINE_ERROR; // If there was an error in the command line arguments, return error code
-    
-    // Checking whether we are able to open the input file
-    ifstream assembly_code(input);
-    if (!assembly_code.is_open()){
-        cout << "Error: File " << input << " was not found, or we were unable to open it.\n";
-        cout << "Check whether you have the file in the same directory, as well as the permission to read it" << endl;
-        return UNABLE_TO_OPEN_INPUT_FILE;
+    if (cmd_error) return COMMAND_LINE_ERROR; // If there was an error in the command line arguments, return error code
+    if (settings.stats) countHeap();
+    if (counters) startCounters();     // Before any thread is started, for them to be counted too
+    if (!trace_file.empty()) startTrace();
+
+    // At most one of the generated files can go to stdout
+    string to_stdout[] = {single.output, settings.options.binary ? single.binary : "", settings.options.format || settings.options.format_only ? single.formatted : ""};
+    int stdout_files = 0;
+    for (const string &path: to_stdout) stdout_files += isStandardStream(path);
+    for (int f = 0; f < IMAGE_FORMATS; f++) stdout_files += (settings.extra_images & IMAGE_BIT(f)) && isStandardStream(single.image_files[f]);
+    if (stdout_files > 1){
+        cout << "Error: Only one of the generated files can be written to the standard output (-).\n";
+        return COMMAND_LINE_ERROR;
     }
-    
-    
-    // Checking whether we are able to open the format file
-    ofstream format_file(formatted);
-    if (!format_file.is_open()){
-        cout << "Error: File " << formatted << " was not found, or we were unable to open it.\n";
-        cout << "Check whether you have the file in the same directory, as well as the permission to write to it" << endl;
-        return UNABLE_TO_OPEN_OUTPUT_FILE;
+    settings.to_stdout = stdout_files == 1;
+
+    // With a machine readable format stdout only carries the diagnostics, everything else goes to stderr.
+    // So does everything when stdout carries a generated file.
+    ostream &log = (settings.diagnostics == DIAGNOSTICS_TEXT && !settings.to_stdout) ? cout : cerr;
+
+    // The spans of --trace are written once the run is over, whichever way it ends
+    struct TraceWriter {
+        const string &path;
+        ostream &log;
+        ~TraceWriter(){
+            if (path.empty()) return;
+            ostringstream json;
+            writeTrace(json);
+            if (!writeFile(path, json.str())) log << "Error: Unable to write the trace to " << path << "." << endl;
+        }
+    } trace_writer{trace_file, log};
+
+    // Language server, stdout carries the protocol alone
+    if (lsp) return runLanguageServer(cin, cout, cerr, settings.stats);
+
+    // Daemon mode, the sources come from the requests
+    if (!socket_path.empty()){
+        ServerOptions server;
+        server.options = settings.options;
+        server.workers = settings.jobs;
+        return serve(socket_path, server, log);
     }
 
-    
+    if (!cache_dir.empty()){
+        if (!cache.open(cache_dir, cache_size)){
+            log << "Error: Unable to create the cache directory " << cache_dir << "." << endl;
+            return COMMAND_LINE_ERROR;
+        }
+        settings.cache = &cache;
+    }
+    else if (cache_stats){
+        log << "Error: --cache-stats needs a cache, given with --cache." << endl;
+        return COMMAND_LINE_ERROR;
+    }
 
-    // First pass
-    // Formatting Assembly code
-    // This parse does not check whether the line is valid instruction or not.
-    // It checks just two things:
-    // 1. If the line is blank, skip it, don't include it in the formatted assembly code
-    // 2. If a label is encountered, check it, record it along with its line number, and replace it with an NOP statement
-    //
-    // **NOTE**
-    // Since the labels will be replaced with the hexadecimal value of their locations in JMP statements, their line numbering starts from 0.
-    while(getline(assembly_code, line)){      
-        line = sanitizeLine(line);
-        
-        // The line should be now completely uppercase, stripped of leading and trailing whitespaces and tabs, and comments removed.
-        if (!line.size()) continue;
-        else if (line.find(':') != string::npos){
-            c = isValidLabel(line);         // Reusing 'c' here since the return type is uint8_t which is typically an unsigned char
-            
-            if (c) {
-                format_file << "Error: Invalid Label at line " << ++line_num << ".\n";
-                ERR = true;
-            }
+    // Batch mode: several inputs, a directory, a manifest or an output directory
+    bool batch = inputs.size() > 1 || !manifests.empty() || !output_dir.empty();
+    for (const string &input: inputs) batch = batch || fs::is_directory(input);
 
-            switch (c){
-                case 0:
-                    if (isLabelRecorded(line, labels)){
-                        format_file << "Error: Already duplicate label: " << strip(line.substr(0, line.size() - 1)) << ", at line number " << ++line_num << ".\n";
-                        format_file << "Label already defined at: " << labels[strip(line.substr(0, line.size() - 1))] + 1 << ".\n";
-                        ERR = true;
-                        continue;
-                    }
-                    line = sanitizeLine(line.substr(0, line.size() - 1));
-                    labels[line] = line_num;
-                    format_file << line << ":\n";
-                    break;
-                
-                case 1:
-                    format_file << "Empty labels are invalid\n";
-                    continue;
+    if (!batch){
+        if (!inputs.empty()) single.input = inputs[0];
+        if (watch && isStandardStream(single.input)){
+            log << "Error: --watch follows a file, it can't read the standard input." << endl;
+            return COMMAND_LINE_ERROR;
+        }
+        if (watch + stream + low_memory > 1){
+            log << "Error: Only one of --watch, --stream and --low-memory can be used at a time." << endl;
+            return COMMAND_LINE_ERROR;
+        }
+        if (watch) return runWatch(single, settings, log);
+        PhaseTimer total(settings.stats ? &single.run.total : nullptr);
+        if (stream) single.status = runStream(single, settings, log);
+        else if (low_memory) single.status = runLowMemory(single, settings, log);
+        else single.status = assembleUnit(single, settings, log);
+        total.stop();
+        if (settings.stats) printStats(log, settings, single.run, single.stats);
+        if (cache_stats) printCacheStats(log, cache, cache_size);
+
+        // Machine readable diagnostics go to stdout, unless it carries a generated file. Text diagnostics have already been written into the files.
+        ostream &report = settings.to_stdout ? cerr : cout;
+        if (single.status == 0 || single.status == ASSEMBLY_CODE_ERROR){
+            if (settings.diagnostics == DIAGNOSTICS_JSON) writeDiagnosticsJson(report, single.input, single.diagnostics);
+            else if (settings.diagnostics == DIAGNOSTICS_SARIF) writeDiagnosticsSarif(report, single.input, single.diagnostics);
+            report << flush;
+        }
+        return single.status;
+    }
+
+    if (watch || stream || low_memory){
+        log << "Error: " << (watch ? "--watch" : stream ? "--stream" : "--low-memory") << " follows a single input, it can't be used with several inputs." << endl;
+        return COMMAND_LINE_ERROR;
+    }
+    if (find(inputs.begin(), inputs.end(), STANDARD_STREAM) != inputs.end()){
+        log << "Error: The standard input (-) can't be assembled along with other inputs." << endl;
+        return COMMAND_LINE_ERROR;
+    }
+    if (named_outputs){
+        log << "Error: -o, -b and -e <format>=<file> name the files of a single input, they can't be used with several inputs.\n";
+        log << "Use -O to choose the directory the generated files go to." << endl;
+        return COMMAND_LINE_ERROR;
+    }
+
+    // Gathering the inputs, directories are expanded and manifests read in the order given
+    vector<string> files;
+    for (const string &input: inputs){
+        if (fs::is_directory(input)) listDirectory(input, files);
+        else files.push_back(input);
+    }
+    for (const string &manifest: manifests){
+        if (!readManifest(manifest, files)){
+            log << "Error: File " << manifest << " was not found, or we were unable to open it.\n";
+            log << "Check whether you have the file in the same directory, as well as the permission to read it" << endl;
+            return UNABLE_TO_OPEN_INPUT_FILE;
+        }
+    }
+    if (files.empty()){
+        log << "Error: No assembly source files were found." << endl;
+        return INVALID_INPUT_FILE;
+    }
 
-                case 2:
-                    format_file << "Label ended with a semi-colon\n";
-                    continue;
+    if (!output_dir.empty()){
+        error_code ec;
+        fs::create_directories(output_dir, ec);
+        if (!fs::is_directory(output_dir)){
+            log << "Error: Unable to create the output directory " << output_dir << "." << endl;
+            return UNABLE_TO_OPEN_OUTPUT_FILE;
+        }
+    }
 
-                case 3:
-                    format_file << "Label does not end with a colon\n";
-                    continue;
+    // Every input gets its own set of files: <name>_hex.txt, <name>_bin.txt and <name>_format.txt,
+    // next to it or in the output directory
+    vector<Unit> units(files.size());
+    for (size_t i = 0; i < files.size(); i++){
+        fs::path in(files[i]);
+        fs::path dir = output_dir.empty() ? in.parent_path() : fs::path(output_dir);
+        string stem = in.stem().string();
 
-                case 4:
-                    format_file << "Label: " << strip(line.substr(0, line.size() - 1)) << " is a valid OPCode, which is a reserved name\n";
-                    continue;
+        units[i].input = files[i];
+        units[i].output = (dir / (stem + "_hex.txt")).string();
+        units[i].binary = (dir / (stem + "_bin.txt")).string();
+        units[i].formatted = (dir / (stem + "_format.txt")).string();
+    }
 
-                case 5:
-                    format_file << "Label: " << strip(line.substr(0, line.size() - 1)) << " is not a valid label name\n";
-                    continue;
+    // Inputs of the same name sent to the same directory would be written over each other, from two threads at once
+    map<string, size_t> written;
+    for (size_t i = 0; i < units.size(); i++){
+        error_code ec;
+        fs::path output = fs::weakly_canonical(units[i].output, ec);
+        if (ec) output = fs::path(units[i].output).lexically_normal();
 
-                default:
-                    format_file << "Unknown Label Error\n";
-            }
+        auto [first, inserted] = written.emplace(output.string(), i);
+        if (!inserted){
+            log << "Error: " << units[first->second].input << " and " << units[i].input << " would both be assembled into " << units[i].output << ".\n";
+            log << "Rename one of them, or assemble them in separate runs with different output directories." << endl;
+            return COMMAND_LINE_ERROR;
         }
-        else if (line.find(';') == string::npos) format_file << strip(line) << '\n';
-        else{
-            line = strip(line.substr(0, line.find_first_of(';')));
-            if (!line.size()) continue;                           // Skip the line with only a semi-colon present;
-            format_file << line << ";\n";
+    }
+
+    settings.batch = true;
+    int status = runBatch(units, settings);
+    if (cache_stats) printCacheStats(log, cache, cache_size);
+    return status;
+}
+
+// Assembles one source file, collecting its diagnostics into the unit
+// Each thread reuses one context, so a long batch doesn't keep allocating and freeing its tables.
+static int assembleUnit(Unit &unit, const Settings &settings, ostream &log){
+    TraceSpan span("assemble", "file", unit.input);
+    thread_local AssemblerContext ctx;
+    ctx.clear();
+    ctx.options = settings.options;
+
+    int status = assembleSource(unit, settings, ctx, log);
+    if (settings.stats) unit.run.errors += ctx.diagnostics.size();
+    unit.diagnostics = std::move(ctx.diagnostics);
+    unit.stats = ctx.stats;
+    return status;
+}
+
+// Source lines, statements and labels of an assembly past its first pass, for --stats
+static void countLines(RunStats &run, const AssemblerContext &ctx, string_view source){
+    run.source_lines += count(source.begin(), source.end(), '\n') + (!source.empty() && source.back() != '\n');
+    run.statements += count_if(ctx.lines.begin(), ctx.lines.end(), [](const SourceLine &line){ return line.kind != LINE_LABEL; });
+    run.labels += ctx.labels.size();
+}
+
+static int assembleSource(Unit &unit, const Settings &settings, AssemblerContext &ctx, ostream &log){
+    SourceFile source;                  // Memory mapped assembly code
+    RunStats *run = settings.stats ? &unit.run : nullptr;      // Only timed and counted with --stats
+    bool thread_cpu = settings.batch;                          // In batch mode the other threads assemble other files
+
+    // Checking whether we are able to open the input file
+    PhaseTimer reading(run, PHASE_READ, thread_cpu);
+    bool opened = source.open(unit.input);
+    reading.stop();
+    if (!opened){
+        log << "Error: File " << unit.input << " was not found, or we were unable to open it.\n";
+        log << "Check whether you have the file in the same directory, as well as the permission to read it" << endl;
+        return UNABLE_TO_OPEN_INPUT_FILE;
+    }
+    if (run) run->bytes_read += source.text().size();
+
+    // A source assembled cleanly before with the same options has its files taken from the cache
+    CacheKey key;
+    if (settings.cache){
+        key = cacheKey(source.text(), cacheOptions(settings));
+        if (settings.cache->lookup(key, cachedFiles(settings))){
+            auto put = [&](int file, const string &path){
+                PhaseTimer writing(run, PHASE_WRITE, thread_cpu);
+                return settings.cache->materialize(key, file, path);
+            };
+            if ((!ctx.options.format && !ctx.options.format_only) || put(CACHE_FORMAT_FILE, unit.formatted)){
+                if (ctx.options.format_only) return 0;
+                ostringstream cached_log;
+                int status = writeOutputs(unit, settings, put, cached_log);
+                if (status == 0){
+                    log << cached_log.str() << flush;
+                    return 0;
+                }
+            }
+            // The entry went away under us, assembling as if it was never there
         }
-        line_num++;
     }
-    
-    // flushing the formatted file
-    format_file << flush;
 
-    format_file.close();
-    assembly_code.close();
-    
+    // A source large enough to be split is assembled on all the threads, with the same result as on one.
+    // -j 1 keeps it whole, on this thread.
+    unique_ptr<ThreadPool> pool;
+    if (!settings.batch && settings.jobs != 1 && source.text().size() >= 2 * CHUNK_MIN_BYTES) pool.reset(new ThreadPool(settings.jobs));
 
-    // At this point, all the assembly code should be formatted neatly in our intermediate text file.
-    // There will be no spaces, all labels would be recorded and stored in a map to their expected line number.
+    // First pass, formats the code into a table of lines and records the labels
+    PhaseTimer labelling(run, PHASE_FIRST_PASS, thread_cpu);
+    firstPass(ctx, source.text(), pool.get());
+    labelling.stop();
+    if (run) countLines(*run, ctx, source.text());
+
+    // At this point, all the assembly code should be formatted neatly in our line table.
+    // There will be no spaces, all labels would be recorded in the symbol table along with their expected line number.
     // Now we check if we hit any error, if yes, we don't begin the second parsing
+    string formatted;
+    int status = writeFormat(unit, settings, ctx, ctx.error, run, thread_cpu, formatted, log);
+    if (status != 0) return status;
+
+    Images images;
+    if (!ctx.options.format_only){
+        // Second pass, encodes the line table
+        PhaseTimer encoding(run, PHASE_SECOND_PASS, thread_cpu);
+        secondPass(ctx, pool.get());
+        encoding.stop();
+        status = writeImages(unit, settings, ctx, run, thread_cpu, images, log);
+    }
+
+    if (status == 0 && settings.cache){
+        PhaseTimer writing(run, PHASE_WRITE, thread_cpu);
+        string_view data[CACHE_FILES];
+        for (int f = 0; f < IMAGE_FORMATS; f++) data[f] = images.buffers[f];
+        data[CACHE_FORMAT_FILE] = formatted;
+        settings.cache->store(key, cachedFiles(settings), data);
+    }
+    return status;
+}
+
+// Writes the format file of an assembly past its first pass when asked for (-f or -c), or when labelling failed so the errors can be seen.
+// Returns ASSEMBLY_CODE_ERROR if it did, the statements being left unencoded.
+static int writeFormat(Unit &unit, const Settings &settings, const AssemblerContext &ctx, bool labelling_error, RunStats *run, bool thread_cpu, string &formatted, ostream &log){
+    int diagnostics = settings.diagnostics;
+
+    if ((labelling_error && diagnostics == DIAGNOSTICS_TEXT) || ctx.options.format || ctx.options.format_only){
+        PhaseTimer emitting(run, PHASE_EMIT, thread_cpu);
+        formatted = emitFormat(ctx, labelling_error && diagnostics == DIAGNOSTICS_TEXT);
+        emitting.stop();
+        if (!writeOutput(run, thread_cpu, unit.formatted, formatted)){
+            log << "Error: File " << unit.formatted << " was not found, or we were unable to open it.\n";
+            log << "Check whether you have the file in the same directory, as well as the permission to write to it" << endl;
+            return UNABLE_TO_OPEN_OUTPUT_FILE;
+        }
+    }
 
-    if (ERR) {
-        cout << "Found Errors in labelling.\n";
-        if (!(flag & 0x02)) cout << "Not converting to hex_code. See file: " << formatted << " for errors.\n";
-        cout << "Exiting..." << endl;
+    if (labelling_error) {
+        log << "Found Errors in labelling.\n";
+        if (!ctx.options.format_only && diagnostics == DIAGNOSTICS_TEXT) log << "Not converting to hex_code. See file: " << unit.formatted << " for errors.\n";
+        log << "Exiting..." << endl;
         return ASSEMBLY_CODE_ERROR;
     }
+    return 0;
+}
 
-    if (flag & 0x02) return 0;
+// Emits the images of an assembly past its second pass and writes them, the hex file alone if it had errors
+static int writeImages(Unit &unit, const Settings &settings, const AssemblerContext &ctx, RunStats *run, bool thread_cpu, Images &images, ostream &log){
+    int diagnostics = settings.diagnostics;
 
-    // If no errors were found, we open formatted file in read mode, and hex file in write mode.
-    
-    ifstream format_read(formatted);
-    if (!format_read.is_open()){
-        cout << "Error: File " << formatted << " was not found, or we were unable to open it.\n";
-        cout << "Check whether you have the file in the same directory, as well as the permission to read it" << endl;
-        return UNABLE_TO_OPEN_INPUT_FILE;
+    // All the images are emitted from the encoded words in one sweep. The binary is only wanted after a clean assembly.
+    unsigned image_formats = IMAGE_BIT(IMAGE_HEX);
+    if (!ctx.error && ctx.options.binary) image_formats |= IMAGE_BIT(IMAGE_BINARY);
+    if (!ctx.error) image_formats |= settings.extra_images;
+    PhaseTimer emitting(run, PHASE_EMIT, thread_cpu);
+    emitImages(ctx, image_formats, diagnostics == DIAGNOSTICS_TEXT, images);
+    emitting.stop();
+
+    if (ctx.error){
+        // With text diagnostics the hex file is written even if there were errors, with the errors in place of the lines they were found at.
+        // Otherwise a failed assembly leaves no hex file behind.
+        if (diagnostics == DIAGNOSTICS_TEXT && !writeOutput(run, thread_cpu, unit.output, images.buffers[IMAGE_HEX])){
+            log << "Error: File " << unit.output << " was not found, or we were unable to open it.\n";
+            log << "Check whether you have the file in the same directory, as well as the permission to write to it" << endl;
+            return UNABLE_TO_OPEN_OUTPUT_FILE;
+        }
+
+        if (diagnostics == DIAGNOSTICS_TEXT) log << "Error: Errors were found in the assembly code. Check the output file for more details." << endl;
+        else log << "Error: Errors were found in the assembly code." << endl;
+        if (!ctx.options.format) log << "If your source code had blank lines and labels, generate the formatted file and check against that file." << endl;
+        if (ctx.options.binary) log << "Error: Failed to generate binary code." << endl;
+        return ASSEMBLY_CODE_ERROR;
     }
-    
-    
-    // Checking whether we are able to open the format file
-    ofstream hexfile(output);
-    if (!hexfile.is_open()){
-        cout << "Error: File " << output << " was not found, or we were unable to open it.\n";
-        cout << "Check whether you have the file in the same directory, as well as the permission to write to it" << endl;
+
+    auto put = [&](int file, const string &path){ return writeOutput(run, thread_cpu, path, images.buffers[file], imageIsBinary(file)); };
+    return writeOutputs(unit, settings, put, log);
+}
+
+// writeFile(), timed and counted in `run` if given
+static bool writeOutput(RunStats *run, bool thread_cpu, const string &path, string_view data, bool binary){
+    PhaseTimer writing(run, PHASE_WRITE, thread_cpu);
+    TraceSpan span("write", "io", path);
+    bool written = writeFile(path, data, binary);
+    if (run && written) run->bytes_written += data.size();
+    return written;
+}
+
+// Writes the files of a clean assembly, `put` places file `file` (see cache.h) at `path`
+static int writeOutputs(Unit &unit, const Settings &settings, const function<bool(int, const string &)> &put, ostream &log){
+    if (!put(IMAGE_HEX, unit.output)){
+        log << "Error: File " << unit.output << " was not found, or we were unable to open it.\n";
+        log << "Check whether you have the file in the same directory, as well as the permission to write to it" << endl;
         return UNABLE_TO_OPEN_OUTPUT_FILE;
     }
     
-    // Resetting the line number
-    line_num = 0;
+    log << "Hex code generated successfully. Check the output file: " << unit.output << endl;
+
+    // Images asked for with -e, named after the output file unless given a name
+    for (int f = 0; f < IMAGE_FORMATS; f++){
+        if (!(settings.extra_images & IMAGE_BIT(f))) continue;
+        if (unit.image_files[f].empty()) unit.image_files[f] = imageFile(unit, f);
+        if (!put(f, unit.image_files[f])){
+            log << "Error: File " << unit.image_files[f] << " was not found, or we were unable to open it.\n";
+            log << "Check whether you have the file in the same directory, as well as the permission to write to it" << endl;
+            return UNABLE_TO_OPEN_OUTPUT_FILE;
+        }
+        log << "Image " << imageName(f) << " generated successfully. Check the file: " << unit.image_files[f] << endl;
+    }
+
+    // Binary code generation
+
+    // Condition to check whether the user specified not to generate binary code
+    if (!settings.options.binary){
+        log << "Specifically told not to generate binary code. Exiting the program." << endl;
+        return 0;
+    }
     
-    // Putting the header for logisim
-    hexfile << "v2.0 raw\n";
-
-    while(getline(format_read,line)){
-        
-        line_num++;
-        
-        // Convert assembly code to hex
-        // and write to hexfile
-        
-        if (!isValidLabel(line)){                        // If the line is a valid label, the function returns a 0
-            label = line.substr(0, line.size() - 1);
-            hexfile << "0000000\n";
-            continue;
+    // The binary is derived from the same encoded words that went into the hex file
+    if (!put(IMAGE_BINARY, unit.binary)){
+        log << "Error: File " << unit.output << " was not found, or we were unable to open it.\n";
+        log << "Check whether you have the file in the same directory, as well as the permission to write to it" << endl;
+        return UNABLE_TO_OPEN_BINARY_FILE;
+    }
+    
+    return 0;
+}
+
+// Options that shape the files of a clean assembly, part of its cache key.
+// The diagnostics format is left out, a clean assembly writes the same files whichever it is.
+static string cacheOptions(const Settings &settings){
+    return "binary=" + to_string(settings.options.binary) + " format=" + to_string(settings.options.format) +
+           " format_only=" + to_string(settings.options.format_only) + " images=" + to_string(settings.extra_images);
+}
+
+// Files a clean assembly generates, as a mask of CACHE_FILE_BIT()s
+static unsigned cachedFiles(const Settings &settings){
+    unsigned files = 0;
+    if (settings.options.format || settings.options.format_only) files |= CACHE_FILE_BIT(CACHE_FORMAT_FILE);
+    if (settings.options.format_only) return files;
+    files |= CACHE_FILE_BIT(IMAGE_HEX) | settings.extra_images;
+    if (settings.options.binary) files |= CACHE_FILE_BIT(IMAGE_BINARY);
+    return files;
+}
+
+// Assembles every unit on a work-stealing pool. The log of each file is printed in the order of the inputs,
+// as soon as the files before it are done, and so are the machine readable diagnostics at the end.
+// Returns 0 if every file was assembled, otherwise the status of the first one that failed.
+static int runBatch(vector<Unit> &units, const Settings &settings){
+    ostream &log = (settings.diagnostics == DIAGNOSTICS_TEXT) ? cout : cerr;
+    vector<string> logs(units.size());
+    vector<bool> finished(units.size(), false);
+    size_t next_report = 0;
+    mutex report_mutex;
+
+    RunStats run;
+    PhaseTimer total(settings.stats ? &run.total : nullptr);
+    ThreadPool pool(settings.jobs);
+    pool.run(units.size(), [&](size_t i){
+        ostringstream unit_log;
+        units[i].status = assembleUnit(units[i], settings, unit_log);
+
+        lock_guard<mutex> lock(report_mutex);
+        logs[i] = unit_log.str();
+        finished[i] = true;
+        while (next_report < units.size() && finished[next_report]){
+            log << "[" << next_report + 1 << "/" << units.size() << "] " << units[next_report].input << '\n' << logs[next_report];
+            string().swap(logs[next_report]);
+            next_report++;
+        }
+        log << flush;
+    });
+
+    int status = 0;
+    size_t failed = 0;
+    vector<FileDiagnostics> reports;
+    AssemblerStats stats;
+    for (Unit &unit: units){
+        stats += unit.stats;
+        run += unit.run;
+        if (unit.status != 0){
+            failed++;
+            if (status == 0) status = unit.status;
         }
+        if (unit.status == 0 || unit.status == ASSEMBLY_CODE_ERROR) reports.push_back({unit.input, std::move(unit.diagnostics)});
+    }
+
+    if (settings.diagnostics == DIAGNOSTICS_JSON) writeDiagnosticsJson(cout, reports);
+    else if (settings.diagnostics == DIAGNOSTICS_SARIF) writeDiagnosticsSarif(cout, reports);
+    cout << flush;
+
+    log << "Assembled " << units.size() - failed << " of " << units.size() << " files on " << pool.size() << (pool.size() == 1 ? " thread." : " threads.");
+    if (failed) log << " " << failed << " failed.";
+    log << endl;
+    total.stop();
+    if (settings.stats) printStats(log, settings, run, stats);
+    return status;
+}
+
+// Counters of --stats, added up over every file in batch mode, also written as JSON to the file of --stats=<file>
+static void printStats(ostream &log, const Settings &settings, const RunStats &run, const AssemblerStats &stats){
+    printRunStats(log, run, stats);
+    if (settings.stats_file.empty()) return;
+
+    ostringstream json;
+    writeRunStatsJson(json, run, stats);
+    if (!writeFile(settings.stats_file, json.str())) log << "Error: Unable to write the statistics to " << settings.stats_file << "." << endl;
+}
+
+// Assembles the unit, then again every time its source is saved, until interrupted.
+// A clean edit is reassembled incrementally (see watch.h), and its words patched in place in the image files
+// that have them at fixed offsets. Anything else is written in full from the assembler's context.
+static int runWatch(Unit &unit, const Settings &settings, ostream &log){
+    FileWatcher watcher;
+    IncrementalAssembler assembler(settings.options);
+    bool current = false;                   // Whether the files on disk were written from the assembler's words
+
+    if (settings.options.format_only){
+        log << "Error: --watch assembles the source, it can't be used with -c." << endl;
+        return COMMAND_LINE_ERROR;
+    }
+    if (!watcher.open(unit.input)){
+        log << "Error: Unable to watch " << unit.input << " for changes." << endl;
+        return UNABLE_TO_OPEN_INPUT_FILE;
+    }
+
+    // Files that can't be patched are emitted again in full, so are the format file and the images on a change of size
+    unsigned formats = IMAGE_BIT(IMAGE_HEX) | settings.extra_images;
+    if (settings.options.binary) formats |= IMAGE_BIT(IMAGE_BINARY);
+    for (int f = 0; f < IMAGE_FORMATS; f++){
+        if ((settings.extra_images & IMAGE_BIT(f)) && unit.image_files[f].empty()) unit.image_files[f] = imageFile(unit, f);
+    }
+    auto fileOf = [&](int f){ return f == IMAGE_HEX ? unit.output : f == IMAGE_BINARY ? unit.binary : unit.image_files[f]; };
 
-        else if (count(line.begin(), line.end(), ';') == 0){
-            if (!label.empty()) hexfile << "In block: " << label << "\n";
-            hexfile << "Error: Missing semicolon at line " << line_num << "\n";
-            ERR = true;
+    do {
+        // Read rather than mapped, as an editor may cut the file short while it is being copied
+        string text;
+        if (!readBlocks(unit.input, [&](string_view block){ text.append(block); return true; })){
+            log << "Error: File " << unit.input << " was not found, or we were unable to open it." << endl;
+            current = false;
             continue;
         }
 
-        line = line.substr(0, line.find_first_of(';'));
+        auto start = chrono::steady_clock::now();
+        WatchUpdate update = assembler.update(std::move(text));
+        const AssemblerContext &ctx = assembler.context();
 
-        if (line.size() < 3){
-            if (!label.empty()) hexfile << "In block: " << label << "\n";
-            hexfile << "Error: Invalid line at line " << line_num << "\n";
-            ERR = true;
+        // Written in full from the same text the assembler holds, which later changes are patched against
+        if (!update.incremental || ctx.error || !current){
+            string formatted;
+            Images images;
+            int status = writeFormat(unit, settings, ctx, update.labelling_error, nullptr, false, formatted, log);
+            if (status == 0) status = writeImages(unit, settings, ctx, nullptr, false, images, log);
+            current = status == 0;
             continue;
         }
-        parse(line_num, line, label, labels, hexfile);
+
+        // Whatever isn't patched is written again from the words
+        unsigned rewrite = 0;
+        for (int f = 0; f < IMAGE_FORMATS; f++){
+            if (!(formats & IMAGE_BIT(f))) continue;
+            if (update.resized || !patchImage(fileOf(f), f, ctx.words, update.changed)) rewrite |= IMAGE_BIT(f);
+        }
+
+        Images images;
+        if (rewrite) emitImages(ctx, rewrite, false, images);
+        for (int f = 0; f < IMAGE_FORMATS; f++){
+            if ((rewrite & IMAGE_BIT(f)) && !writeFile(fileOf(f), images.buffers[f], imageIsBinary(f))) current = false;
+        }
+        if (settings.options.format && update.lines && !writeFile(unit.formatted, emitFormat(ctx, false))) current = false;
+
+        chrono::duration<double, milli> took = chrono::steady_clock::now() - start;
+        log << "Reassembled " << unit.input << ": " << update.lines << (update.lines == 1 ? " line" : " lines") << " changed, ";
+        if (update.resized) log << ctx.words.size() << " words written";
+        else log << update.changed.size() << (update.changed.size() == 1 ? " word" : " words") << " patched";
+        log << " in " << fixed << setprecision(3) << took.count() << " ms." << defaultfloat << endl;
+        if (!current) log << "Error: Unable to update the generated files, they will be written in full on the next change." << endl;
+    } while (watcher.wait());
+
+    log << "Error: Stopped watching " << unit.input << "." << endl;
+    return UNABLE_TO_OPEN_INPUT_FILE;
+}
+
+// Assembles the input as it is read, writing each word to the images as soon as it is final (see stream.h).
+// There is no format file, and the errors are only reported once the input ends.
+static int runStream(Unit &unit, const Settings &settings, ostream &log){
+    if (settings.options.format || settings.options.format_only){
+        log << "Error: --stream writes no format file, it can't be used with -f or -c." << endl;
+        return COMMAND_LINE_ERROR;
+    }
+    if (settings.cache){
+        log << "Error: --stream can't be used with --cache, the source is not known in full until it is assembled." << endl;
+        return COMMAND_LINE_ERROR;
     }
-    hexfile << flush;
 
-    format_read.close();
-    hexfile.close();
+    unsigned formats = IMAGE_BIT(IMAGE_HEX) | settings.extra_images;
+    if (settings.options.binary) formats |= IMAGE_BIT(IMAGE_BINARY);
+    for (int f = 0; f < IMAGE_FORMATS; f++){
+        if ((settings.extra_images & IMAGE_BIT(f)) && unit.image_files[f].empty()) unit.image_files[f] = imageFile(unit, f);
+    }
+    auto fileOf = [&](int f){ return f == IMAGE_HEX ? unit.output : f == IMAGE_BINARY ? unit.binary : unit.image_files[f]; };
 
-    if (!(flag & 0x04)) filesystem::remove(formatted);
+    // The images are created once the input could be read, so a missing input leaves the old ones be
+    ImageStream images[IMAGE_FORMATS];
+    bool opened = false, written = true;
+    string failed_file;
+    auto put = [&](const vector<Word> &words){
+        for (int f = 0; f < IMAGE_FORMATS && written; f++){
+            if (!(formats & IMAGE_BIT(f))) continue;
+            if (!opened && !images[f].open(fileOf(f), f)){
+                failed_file = fileOf(f);
+                written = false;
+                break;
+            }
+            for (Word w: words) written = images[f].put(w) && written;
+            written = images[f].flush() && written;
+            if (!written) failed_file = fileOf(f);
+        }
+        opened = true;
+        return written;
+    };
 
-    if (ERR){
-        cout << "Error: Errors were found in the assembly code. Check the output file for more details." << endl;
-        if (!(flag & 0x04)) cout << "If your source code had blank lines and labels, generate the formatted file and check against that file." << endl;
-        if (flag & 0x01) cout << "Error: Failed to generate binary code." << endl;
-        return ASSEMBLY_CODE_ERROR;
+    TraceSpan span("stream", "assembly", unit.input);
+    StreamAssembler assembler(settings.options);
+    vector<Word> ready;
+    uint64_t bytes_read = 0;
+    bool read = readBlocks(unit.input, [&](string_view block){
+        bytes_read += block.size();
+        ready.clear();
+        assembler.feed(block, ready);
+        return put(ready);
+    });
+    if (!read){
+        log << "Error: File " << unit.input << " was not found, or we were unable to open it.\n";
+        log << "Check whether you have the file in the same directory, as well as the permission to read it" << endl;
+        return UNABLE_TO_OPEN_INPUT_FILE;
     }
-    
-    cout << "Hex code generated successfully. Check the output file: " << output << endl;
 
-    // Binary code generation
+    ready.clear();
+    assembler.finish(ready);
+    put(ready);
+    for (int f = 0; f < IMAGE_FORMATS && written; f++){
+        if ((formats & IMAGE_BIT(f)) && !images[f].close()){
+            failed_file = fileOf(f);
+            written = false;
+        }
+    }
+    if (!written){
+        log << "Error: File " << failed_file << " was not found, or we were unable to open it.\n";
+        log << "Check whether you have the file in the same directory, as well as the permission to write to it" << endl;
+        return failed_file == unit.binary ? UNABLE_TO_OPEN_BINARY_FILE : UNABLE_TO_OPEN_OUTPUT_FILE;
+    }
 
-    // Condition to check whether the user specified not to generate binary code
-    if (!(flag & 0x01)){
-        cout << "Specifically told not to generate binary code. Exiting the program." << endl;
-        return 0;
+    unit.diagnostics = assembler.diagnostics();
+    if (settings.stats){
+        const StreamStats &stats = assembler.stats();
+        unit.run.source_lines = stats.source_lines;
+        unit.run.statements = stats.statements;
+        unit.run.labels = stats.labels;
+        unit.run.errors = unit.diagnostics.size();
+        unit.run.bytes_read = bytes_read;
+        for (int f = 0; f < IMAGE_FORMATS; f++) unit.run.bytes_written += images[f].written();
+        log << "Streamed " << stats.source_lines << " source lines into " << stats.words << " words, holding at most " << stats.peak_held << " of them at a time." << endl;
     }
-    
-    // Checking whether we are able to open the input file
-    ifstream hexfile_read(output);
-    if (!hexfile_read.is_open()){
-        cout << "Error: File " << output << " was not found, or we were unable to open it.\n";
-        cout << "Check whether you have the file in the same directory, as well as the permission to read it" << endl;
+
+    if (assembler.error()){
+        if (settings.diagnostics == DIAGNOSTICS_TEXT){
+            for (const Diagnostic &d: unit.diagnostics) log << renderText(d);
+        }
+        log << "Error: Errors were found in the assembly code. The generated files stop at the first one." << endl;
+        return ASSEMBLY_CODE_ERROR;
+    }
+    log << "Hex code generated successfully. Check the output file: " << unit.output << endl;
+    return 0;
+}
+
+// Assembles the input in memory that doesn't grow with it, beyond its labels (see bounded.h). The input is read twice,
+// so it has to be a file. There is no format file, labelling errors go to the log instead.
+static int runLowMemory(Unit &unit, const Settings &settings, ostream &log){
+    if (settings.options.format || settings.options.format_only){
+        log << "Error: --low-memory writes no format file, it can't be used with -f or -c." << endl;
+        return COMMAND_LINE_ERROR;
+    }
+    if (settings.cache){
+        log << "Error: --low-memory can't be used with --cache, the source is never held in full." << endl;
+        return COMMAND_LINE_ERROR;
+    }
+    if (isStandardStream(unit.input)){
+        log << "Error: --low-memory reads the input twice, it can't read the standard input." << endl;
+        return COMMAND_LINE_ERROR;
+    }
+
+    BoundedAssembler assembler(settings.options);
+    RunStats *run = settings.stats ? &unit.run : nullptr;
+    PhaseTimer labelling(run, PHASE_FIRST_PASS);
+    bool labelled = assembler.labelPass(unit.input);
+    labelling.stop();
+    if (!labelled){
+        log << "Error: File " << unit.input << " was not found, or we were unable to open it.\n";
+        log << "Check whether you have the file in the same directory, as well as the permission to read it" << endl;
         return UNABLE_TO_OPEN_INPUT_FILE;
     }
+    const vector<LineIndexEntry> &index = assembler.lineIndex();
+    BoundedStats &stats = assembler.stats();
+    uint64_t bytes_read = stats.bytes;
+    atomic<uint64_t> bytes_written(0);
+    size_t errors = assembler.diagnostics().size();
 
-    
-    // Checking whether we are able to open the output file
-    ofstream binaryfile(binary);
-    if (!binaryfile.is_open()){
-        cout << "Error: File " << output << " was not found, or we were unable to open it.\n";
-        cout << "Check whether you have the file in the same directory, as well as the permission to write to it" << endl;
-        return UNABLE_TO_OPEN_BINARY_FILE;
+    auto report = [&](){
+        if (!run) return;
+        run->source_lines = stats.source_lines;
+        run->labels = assembler.labels().size();
+        run->statements = stats.words - min(stats.words, size_t(run->labels));
+        run->errors = errors;
+        run->bytes_read = bytes_read;
+        run->bytes_written = bytes_written;
+        log << "Low memory: " << stats.source_lines << " source lines (" << fixed << setprecision(1) << stats.bytes / double(1 << 20) << " MiB) read twice, "
+            << assembler.labels().size() << " labels, " << index.size() << " line index entries, second pass in " << stats.parts << (stats.parts == 1 ? " part." : " parts.")
+            << defaultfloat << endl;
+    };
+
+    if (assembler.error()){
+        unit.diagnostics = assembler.diagnostics();
+        log << "Found Errors in labelling.\n";
+        if (settings.diagnostics == DIAGNOSTICS_TEXT){
+            for (const Diagnostic &d: unit.diagnostics) log << renderText(d);
+        }
+        log << "Exiting..." << endl;
+        report();
+        return ASSEMBLY_CODE_ERROR;
     }
-    
-    string hex_line;
 
-    getline(hexfile_read, hex_line); // Read the first line and skip it
-    while (getline(hexfile_read, hex_line)){
-        binaryfile << hex_line[0];
-        for(uint8_t i = 1; i < 7; i++){
-            binaryfile << hexBinConversion(hex_line[i]);
+    unsigned formats = IMAGE_BIT(IMAGE_HEX) | settings.extra_images;
+    if (settings.options.binary) formats |= IMAGE_BIT(IMAGE_BINARY);
+    for (int f = 0; f < IMAGE_FORMATS; f++){
+        if ((settings.extra_images & IMAGE_BIT(f)) && unit.image_files[f].empty()) unit.image_files[f] = imageFile(unit, f);
+    }
+    auto fileOf = [&](int f){ return f == IMAGE_HEX ? unit.output : f == IMAGE_BINARY ? unit.binary : unit.image_files[f]; };
+
+    // The images are written next to their files, and only moved in place once complete, so a failed assembly leaves the old ones be
+    auto partOf = [&](int f){ return isStandardStream(fileOf(f)) ? fileOf(f) : fileOf(f) + ".part"; };
+    auto discard = [&](){
+        error_code ec;
+        for (int f = 0; f < IMAGE_FORMATS; f++){
+            if ((formats & IMAGE_BIT(f)) && !isStandardStream(fileOf(f))) fs::remove(partOf(f), ec);
         }
-        binaryfile << '\n';
+    };
+
+    // A large source is encoded in parts side by side when each word has a fixed place in every image. Should
+    // there be an error, the source is encoded again on one thread, for the errors to be placed in the hex image.
+    bool parallel = settings.jobs != 1 && index.size() > 1;
+    for (int f = 0; f < IMAGE_FORMATS; f++){
+        if (formats & IMAGE_BIT(f)) parallel = parallel && imageIsPatchable(f) && !isStandardStream(fileOf(f));
     }
-    binaryfile << flush;
 
-    hexfile_read.close();
-    binaryfile.close();
-    
-    return 0;
+    bool written = true, clean = false;
+    PhaseTimer encoding(run, PHASE_SECOND_PASS);
+    if (parallel){
+        ThreadPool pool(settings.jobs);
+        stats.parts = min(pool.size() * CHUNKS_PER_THREAD, index.size());
+        for (int f = 0; f < IMAGE_FORMATS && written; f++){
+            ImageStream image;
+            if (formats & IMAGE_BIT(f)) written = image.open(partOf(f), f) && image.close();
+        }
+
+        atomic<bool> failed(false), unwritten(!written);
+        if (written) pool.run(stats.parts, [&](size_t p){
+            size_t from = index.size() * p / stats.parts, to = index.size() * (p + 1) / stats.parts - 1;
+            ImageStream images[IMAGE_FORMATS];
+            bool ok = true;
+            for (int f = 0; f < IMAGE_FORMATS; f++){
+                if (formats & IMAGE_BIT(f)) ok = images[f].openAt(partOf(f), f, index[from].line) && ok;
+            }
+            bool read = ok && assembler.encodePass(unit.input, from, to, [&](Word w){
+                for (int f = 0; f < IMAGE_FORMATS; f++) if (formats & IMAGE_BIT(f)) images[f].put(w);
+            }, [&](Diagnostic &){
+                failed = true;
+                return false;
+            });
+            for (int f = 0; f < IMAGE_FORMATS; f++){
+                if (formats & IMAGE_BIT(f)) ok = images[f].close() && ok;
+                bytes_written += images[f].written();
+            }
+            if (!read) failed = true;
+            if (!ok) unwritten = true;
+        });
+        written = !unwritten;
+        clean = written && !failed;
+        bytes_read += stats.bytes;
+    }
+
+    bool error = false;
+    if (written && !clean){
+        stats.parts = 1;
+        ImageStream images[IMAGE_FORMATS];
+        for (int f = 0; f < IMAGE_FORMATS; f++){
+            if (formats & IMAGE_BIT(f)) written = images[f].open(partOf(f), f) && written;
+        }
+        bool read = written && assembler.encodePass(unit.input, 0, index.size() - 1, [&](Word w){
+            for (int f = 0; f < IMAGE_FORMATS; f++) if (formats & IMAGE_BIT(f)) images[f].put(w);
+        }, [&](Diagnostic &d){
+            if (settings.diagnostics == DIAGNOSTICS_TEXT) images[IMAGE_HEX].putDiagnostic(d);
+            else unit.diagnostics.push_back(std::move(d));
+            error = true;
+            errors++;
+            return true;
+        });
+        for (int f = 0; f < IMAGE_FORMATS; f++){
+            if (formats & IMAGE_BIT(f)) written = images[f].close() && written;
+            bytes_written += images[f].written();
+        }
+        bytes_read += stats.bytes;
+        if (!read){
+            discard();
+            log << "Error: File " << unit.input << " was not found, or we were unable to open it.\n";
+            log << "Check whether you have the file in the same directory, as well as the permission to read it" << endl;
+            return UNABLE_TO_OPEN_INPUT_FILE;
+        }
+    }
+    encoding.stop();
+    if (!written){
+        discard();
+        log << "Error: Unable to write the generated files next to " << unit.output << ".\n";
+        log << "Check whether you have the permission to write to that directory" << endl;
+        return UNABLE_TO_OPEN_OUTPUT_FILE;
+    }
+    report();
+
+    auto put = [&](int f, const string &path){
+        if (isStandardStream(path)) return true;
+        PhaseTimer writing(run, PHASE_WRITE);
+        TraceSpan span("write", "io", path);
+        error_code ec;
+        fs::rename(partOf(f), path, ec);
+        return !ec;
+    };
+    if (error){
+        // As without --low-memory, only the hex file is kept, and only if it has the errors in it
+        if (settings.diagnostics == DIAGNOSTICS_TEXT) put(IMAGE_HEX, unit.output);
+        discard();
+        if (settings.diagnostics == DIAGNOSTICS_TEXT) log << "Error: Errors were found in the assembly code. Check the output file for more details." << endl;
+        else log << "Error: Errors were found in the assembly code." << endl;
+        if (settings.options.binary) log << "Error: Failed to generate binary code." << endl;
+        return ASSEMBLY_CODE_ERROR;
+    }
+    int status = writeOutputs(unit, settings, put, log);
+    discard();
+    return status;
+}
+
+// A manifest lists one source file per line. Blank lines and lines starting with '#' are skipped,
+// and relative paths are taken from the directory of the manifest.
+static bool readManifest(const string &path, vector<string> &inputs){
+    ifstream manifest(path);
+    if (!manifest.is_open()) return false;
+
+    fs::path dir = fs::path(path).parent_path();
+    string line;
+    while (getline(manifest, line)){
+        string_view entry = strip(line);
+        if (!entry.empty() && entry.back() == '\r') entry = strip(entry.substr(0, entry.size() - 1));
+        if (entry.empty() || entry[0] == '#') continue;
+
+        fs::path file(entry);
+        inputs.push_back(file.is_relative() ? (dir / file).string() : file.string());
+    }
+    return true;
+}
+
+// Adds the text files of a directory, sorted by name. Files this program generates are left out,
+// so running over the same directory twice doesn't assemble its own output.
+static void listDirectory(const string &path, vector<string> &inputs){
+    static const string_view GENERATED[] = {"_hex.txt", "_bin.txt", "_format.txt"};
+    vector<string> found;
+    error_code ec;
+
+    for (const fs::directory_entry &entry: fs::directory_iterator(path, ec)){
+        if (!entry.is_regular_file()) continue;
+        string name = entry.path().filename().string();
+        if (!isTextFile(name)) continue;
+
+        bool generated = false;
+        for (string_view suffix: GENERATED) generated = generated || (name.size() > suffix.size() && name.ends_with(suffix));
+        if (!generated) found.push_back(entry.path().string());
+    }
+    sort(found.begin(), found.end());
+    inputs.insert(inputs.end(), found.begin(), found.end());
+}
+
+// Counters of the build cache over this run, and what it holds now
+static void printCacheStats(ostream &log, BuildCache &cache, uint64_t max_bytes){
+    CacheStats stats = cache.stats();
+    auto mib = [](uint64_t bytes){ return bytes / double(1 << 20); };
+
+    log << fixed << setprecision(1);
+    log << "Build cache: " << stats.hits << " of " << stats.lookups << " lookups hit";
+    if (stats.lookups) log << " (" << 100.0 * stats.hits / stats.lookups << "%)";
+    log << ", " << stats.stores << " stored, " << stats.evictions << " evicted (" << mib(stats.evicted_bytes) << " MiB).\n";
+    log << "Build cache holds " << stats.entries << " entries, " << mib(stats.bytes) << " MiB of " << mib(max_bytes) << " MiB." << defaultfloat << endl;
+}
+
+// A number of bytes, optionally followed by K, M or G (powers of 1024)
+static bool parseSize(const char *s, uint64_t &size){
+    if (*s < '0' || *s > '9') return false;
+    char *end;
+    unsigned long long n = strtoull(s, &end, 10);
+
+    int shift = 0;
+    switch (upperChar(*end)){
+        case '\0': break;
+        case 'K': shift = 10; end++; break;
+        case 'M': shift = 20; end++; break;
+        case 'G': shift = 30; end++; break;
+        default: return false;
+    }
+    if (*end != '\0' || n > (UINT64_MAX >> shift)) return false;
+    size = uint64_t(n) << shift;
+    return true;
+}
+
+// Default name of an image asked for with -e, that of the output file with the image's extension
+static string imageFile(const Unit &unit, int format){
+    const string &output = isStandardStream(unit.output) ? Unit().output : unit.output;
+    return output.substr(0, output.find_last_of('.')) + imageExtension(format);
+}
+
+static bool isStandardStream(const string &path){
+    return path == STANDARD_STREAM;
+}
+
+static bool isTextFile(const string &path){
+    return path.find_last_of('.') != string::npos && path.substr(path.find_last_of('.') + 1) == "txt";
 }
 
 // function to print use of command line arguement.
@@ -375,15 +1242,35 @@ void usage(void) {
     cout << "Usage: ./Assembler <options> ...\n";
     cout << "Options being:\n";
     cout << "  -i <input_file> : Input file containing assembly code (default: asmcode.txt)\n";
+    cout << "      Can be repeated, or be a directory, in which case each file is assembled on its own (batch mode)\n";
     cout << "  -o <output_file> : Output file to write hex code (default: hexcode.txt)\n";
     cout << "  -b <binary_file> : Output file to write binary code (default: bin.txt)\n";
     cout << "  -f <format_file> : Format file to write formatted code (default: format.txt)\n";
     cout << "  -n : Tells to not generate binary code\n";
+    cout << "  -e, --emit <format>[=<file>] : Also generates an image in another format: raw (little endian binary), ihex (Intel HEX),\n";
+    cout << "      memh / memb (Verilog $readmemh / $readmemb) or rle (Logisim run-length). Can be repeated. The file is named after the output file by default\n";
+    cout << "  -m, --manifest <file> : Assembles every source file listed in <file>, one per line (batch mode)\n";
+    cout << "  -O, --output-dir <dir> : Directory the files of batch mode are written to (default: next to each input)\n";
+    cout << "  -j, --jobs <n> : Number of threads, for batch mode or a large source (default: one per hardware thread)\n";
+    cout << "  --memo : Remembers the encoding of each distinct statement, so repeated statements are only checked once\n";
+    cout << "  --stats[=<file>] : Reports the time of each phase of the assembly once done, the lines, labels and errors gone through,\n";
+    cout << "      bytes read and written, heap allocations, peak memory and the hit rate of --memo. Also written as JSON to <file> if given\n";
+    cout << "  --counters : Adds the cycles, instructions, IPC, branch and cache misses of each phase to --stats, where the CPU counters can be read\n";
+    cout << "  --trace <file> : Records a timeline of the work of every thread, written to <file> as a Chrome trace to open in Perfetto\n";
+    cout << "  --cache <dir> : Stores the files of each clean assembly in <dir>, and takes them from there when the same source is assembled again\n";
+    cout << "  --cache-size <size> : Size the cache is kept under, removing the entries used the longest ago (default: 256M)\n";
+    cout << "  --cache-stats : Reports the hits of the cache, and what it holds, once done\n";
+    cout << "  --serve <socket> : Runs as a daemon answering assemble requests on the Unix domain socket <socket>, with -j workers\n";
+    cout << "  --lsp : Runs as a language server on stdin / stdout, for editors to show errors as you type, go to label definitions and more\n";
+    cout << "  --watch : Assembles the input again every time it is saved, only going over the lines that changed\n";
+    cout << "  --stream : Assembles the input as it is read, writing each word as soon as it is known. Writes no format file\n";
+    cout << "  --low-memory : Assembles the input in memory that doesn't grow with its size, beyond its labels, reading it twice. Writes no format file\n";
+    cout << "  -d, --diagnostics <format> : How errors are reported: text (default, written into the format / hex file), json or sarif (written to stdout)\n";
     cout << "  -h : Show this help message. It will override the execution of the program and only show this message\n";
     cout << "\n\nKindly Note:-\n";
     cout << "  1. All the files should be in the same directory as this executable.\n";
     cout << "  2. If not in the same directory, the path specified should be valid.\n";
-    cout << "  3. All the I/O files should be a text files.\n";
+    cout << "  3. All the I/O files should be a text files. \"-\" stands for stdin as the input, or stdout as one of the outputs.\n";
     cout << "  4. The input file should contain assembly code in the specified format.\n";
     cout << "  5. The output file will be overwritten if it already exists.\n";
     cout << "  6. The binary file will be overwritten if it already exists.\n";
@@ -0,0 +1,37 @@
+#include "memo.h"
+
+using namespace std;
+
+bool StatementMemo::find(string_view statement, const SymbolTable &labels, Word &word, bool &patched) const{
+    SymbolId key = keys.find(statement);
+    if (key == NO_SYMBOL) return false;
+
+    const Entry &entry = entries[keys.address(key)];
+    word = entry.word;
+    patched = entry.label_length;
+    if (!patched) return true;
+
+    // The key is the statement as first written, the label is taken from it
+    SymbolId label = labels.find(keys.name(key).substr(entry.label_offset, entry.label_length));
+    if (label == NO_SYMBOL || labels.address(label) > 255) return false;
+    word |= labels.address(label);
+    return true;
+}
+
+void StatementMemo::insertPlain(string_view statement, Word word){
+    insert(statement, {word, 0, 0});
+}
+
+void StatementMemo::insertTemplate(string_view statement, string_view label, Word word){
+    insert(statement, {word & ~Word(0xff), uint32_t(label.data() - statement.data()), uint32_t(label.size())});
+}
+
+void StatementMemo::insert(string_view statement, const Entry &entry){
+    if (entries.size() >= MEMO_MAX_ENTRIES) clear();
+    if (keys.insert(statement, entries.size()).second) entries.push_back(entry);
+}
+
+void StatementMemo::clear(){
+    keys.clear();
+    entries.clear();
+}
@@ -0,0 +1,212 @@
+#include "scan.h"
+#include "ascii.h"
+#include <atomic>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+static const size_t BLOCK = 64;
+
+static uint64_t classifyScalar(const char *p){
+    uint64_t mask = 0;
+    for (size_t i = 0; i < BLOCK; i++){
+        char c = p[i];
+        if (c == '\n' || c == '/' || c == ':' || c == ';') mask |= uint64_t(1) << i;
+    }
+    return mask;
+}
+
+static void upperScalar(char *dst, const char *src, size_t n){
+    for (size_t i = 0; i < n; i++) dst[i] = upperChar(src[i]);
+}
+
+#ifdef SCAN_X86
+__attribute__((target("sse2")))
+static uint64_t classifySse2(const char *p){
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i slash = _mm_set1_epi8('/');
+    const __m128i colon = _mm_set1_epi8(':');
+    const __m128i semicolon = _mm_set1_epi8(';');
+    uint64_t mask = 0;
+
+    for (size_t i = 0; i < BLOCK; i += 16){
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, newline), _mm_cmpeq_epi8(v, slash)),
+                                   _mm_or_si128(_mm_cmpeq_epi8(v, colon), _mm_cmpeq_epi8(v, semicolon)));
+        mask |= uint64_t(uint16_t(_mm_movemask_epi8(hit))) << i;
+    }
+    return mask;
+}
+
+__attribute__((target("avx2")))
+static uint64_t classifyAvx2(const char *p){
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i slash = _mm256_set1_epi8('/');
+    const __m256i colon = _mm256_set1_epi8(':');
+    const __m256i semicolon = _mm256_set1_epi8(';');
+    uint64_t mask = 0;
+
+    for (size_t i = 0; i < BLOCK; i += 32){
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+        __m256i hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, newline), _mm256_cmpeq_epi8(v, slash)),
+                                      _mm256_or_si256(_mm256_cmpeq_epi8(v, colon), _mm256_cmpeq_epi8(v, semicolon)));
+        mask |= uint64_t(uint32_t(_mm256_movemask_epi8(hit))) << i;
+    }
+    return mask;
+}
+
+// 'a' to 'z' lose their 0x20 bit. The signed compares leave bytes above 0x7f alone, as they are negative.
+__attribute__((target("sse2")))
+static void upperSse2(char *dst, const char *src, size_t n){
+    const __m128i before_a = _mm_set1_epi8('a' - 1);
+    const __m128i after_z = _mm_set1_epi8('z' + 1);
+    const __m128i bit = _mm_set1_epi8(0x20);
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16){
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(v, before_a), _mm_cmplt_epi8(v, after_z));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_xor_si128(v, _mm_and_si128(lower, bit)));
+    }
+    upperScalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void upperAvx2(char *dst, const char *src, size_t n){
+    const __m256i before_a = _mm256_set1_epi8('a' - 1);
+    const __m256i after_z = _mm256_set1_epi8('z' + 1);
+    const __m256i bit = _mm256_set1_epi8(0x20);
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32){
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(v, before_a), _mm256_cmpgt_epi8(after_z, v));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_xor_si256(v, _mm256_and_si256(lower, bit)));
+    }
+    upperSse2(dst + i, src + i, n - i);
+}
+#endif
+
+struct ScanKernel {
+    const char *name;
+    uint64_t (*classify)(const char *p);
+    void (*upper)(char *dst, const char *src, size_t n);
+};
+
+// Indexed by the kernel
+static const ScanKernel KERNELS[SCAN_KERNELS] = {
+    {"scalar", classifyScalar, upperScalar},
+#ifdef SCAN_X86
+    {"sse2", classifySse2, upperSse2},
+    {"avx2", classifyAvx2, upperAvx2}
+#else
+    {"sse2", nullptr, nullptr},
+    {"avx2", nullptr, nullptr}
+#endif
+};
+
+static bool kernelSupported(int kernel){
+    if (kernel == SCAN_SCALAR) return true;
+#ifdef SCAN_X86
+    if (kernel == SCAN_SSE2) return __builtin_cpu_supports("sse2");
+    if (kernel == SCAN_AVX2) return __builtin_cpu_supports("avx2");
+#endif
+    return false;
+}
+
+int bestScanKernel(){
+    static const int best = kernelSupported(SCAN_AVX2) ? SCAN_AVX2 : kernelSupported(SCAN_SSE2) ? SCAN_SSE2 : SCAN_SCALAR;
+    return best;
+}
+
+static atomic<int> selected(-1);        // -1 until chosen, then the kernel in use
+
+int scanKernel(){
+    int kernel = selected.load(memory_order_relaxed);
+    if (kernel < 0){
+        kernel = bestScanKernel();
+        selected.store(kernel, memory_order_relaxed);
+    }
+    return kernel;
+}
+
+bool selectScanKernel(int kernel){
+    if (kernel < 0 || kernel >= SCAN_KERNELS || !kernelSupported(kernel)) return false;
+    selected.store(kernel, memory_order_relaxed);
+    return true;
+}
+
+const char *scanKernelName(int kernel){
+    return (kernel >= 0 && kernel < SCAN_KERNELS) ? KERNELS[kernel].name : "unknown";
+}
+
+void upperInto(char *dst, const char *src, size_t n){
+    KERNELS[scanKernel()].upper(dst, src, n);
+}
+
+LineScanner::LineScanner(string_view text) : text(text), classify(KERNELS[scanKernel()].classify){
+    load(0);
+}
+
+void LineScanner::load(size_t start){
+    block = start;
+    if (start + BLOCK <= text.size()){
+        events = classify(text.data() + start);
+        return;
+    }
+
+    // The last, partial block is classified from a copy padded with spaces
+    char tail[BLOCK];
+    size_t n = (start < text.size()) ? text.size() - start : 0;
+    memcpy(tail, text.data() + start, n);
+    memset(tail + n, ' ', BLOCK - n);
+    events = classify(tail);
+}
+
+bool LineScanner::next(ScannedLine &line){
+    if (pos >= text.size()) return false;
+
+    line.comment = SCAN_NONE;
+    line.colon = SCAN_NONE;
+    line.semicolon = SCAN_NONE;
+
+    while (true){
+        while (events == 0){
+            if (block + BLOCK >= text.size()){
+                // No newline till the end, the rest of the text is the last line
+                line.text = text.substr(pos);
+                pos = text.size();
+                return true;
+            }
+            load(block + BLOCK);
+        }
+
+        size_t at = block + __builtin_ctzll(events);
+        uint32_t offset = at - pos;
+        events &= events - 1;
+
+        switch (text[at]){
+            case '\n':
+                line.text = text.substr(pos, at - pos);
+                pos = at + 1;
+                return true;
+
+            case '/':
+                if (line.comment == SCAN_NONE && at + 1 < text.size() && text[at + 1] == '/') line.comment = offset;
+                break;
+
+            case ':':
+                if (line.comment == SCAN_NONE && line.colon == SCAN_NONE) line.colon = offset;
+                break;
+
+            case ';':
+                if (line.comment == SCAN_NONE && line.semicolon == SCAN_NONE) line.semicolon = offset;
+                break;
+        }
+    }
+}
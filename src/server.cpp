@@ -0,0 +1,518 @@
+#include "server.h"
+#include "ascii.h"
+#include "diagnostics.h"
+#include "source.h"
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// Latency histogram
+void LatencyHistogram::record(uint64_t microseconds){
+    size_t bucket = 0;
+    while (bucket + 1 < LATENCY_BUCKETS && (uint64_t(1) << bucket) <= microseconds) bucket++;
+
+    buckets[bucket].fetch_add(1, memory_order_relaxed);
+    total.fetch_add(1, memory_order_relaxed);
+    sum.fetch_add(microseconds, memory_order_relaxed);
+    uint64_t seen = longest.load(memory_order_relaxed);
+    while (seen < microseconds && !longest.compare_exchange_weak(seen, microseconds, memory_order_relaxed));
+}
+
+uint64_t LatencyHistogram::percentile(double p) const{
+    uint64_t n = total.load(memory_order_relaxed);
+    if (!n) return 0;
+
+    uint64_t rank = uint64_t(p / 100 * n + 0.5), seen = 0;
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++){
+        seen += buckets[i].load(memory_order_relaxed);
+        if (seen >= max<uint64_t>(rank, 1)) return uint64_t(1) << i;
+    }
+    return uint64_t(1) << (LATENCY_BUCKETS - 1);
+}
+
+void LatencyHistogram::writeJson(ostream &out) const{
+    uint64_t n = total.load(memory_order_relaxed);
+    out << "{\"count\":" << n << ",\"sum_us\":" << sum.load(memory_order_relaxed) << ",\"max_us\":" << longest.load(memory_order_relaxed)
+        << ",\"p50_us\":" << percentile(50) << ",\"p90_us\":" << percentile(90) << ",\"p99_us\":" << percentile(99) << ",\"buckets\":[";
+
+    // Only the buckets up to the last one used, each with its upper bound
+    size_t last = 0;
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++) if (buckets[i].load(memory_order_relaxed)) last = i + 1;
+    for (size_t i = 0; i < last; i++){
+        if (i) out << ',';
+        out << "{\"le_us\":" << (uint64_t(1) << i) << ",\"count\":" << buckets[i].load(memory_order_relaxed) << '}';
+    }
+    out << "]}";
+}
+
+
+#ifndef _WIN32
+
+static atomic<bool> stopping{false};
+
+static void onSignal(int){
+    stopping = true;
+}
+
+// Source-Length of a request, false if it isn't a number of at most SERVER_MAX_SOURCE bytes
+static bool sourceLength(string_view value, uint64_t &length){
+    if (value.empty() || value.size() > 20) return false;
+    string digits(value);
+    char *end;
+    length = strtoull(digits.c_str(), &end, 10);
+    return *end == '\0' && digits[0] >= '0' && digits[0] <= '9' && length <= SERVER_MAX_SOURCE;
+}
+
+// One client. The main thread reads what it sends, a worker answers one complete request at a time.
+// Only one of them has it at a time, handing it over through the RequestQueue.
+class Connection {
+public:
+    explicit Connection(int fd) : active(chrono::steady_clock::now()), fd(fd){}
+    ~Connection(){ ::close(fd); }
+    Connection(const Connection &) = delete;
+    Connection &operator=(const Connection &) = delete;
+
+    int socket() const { return fd; }
+
+    // Takes in whatever was sent so far, without waiting. Sets `closed` once the client is done sending.
+    // Returns false if the connection failed.
+    bool receive(){
+        char chunk[64 * 1024];
+        for (;;){
+            ssize_t n = ::recv(fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+            if (n > 0){
+                buffer.append(chunk, n);
+                active = chrono::steady_clock::now();
+                continue;
+            }
+            if (n == 0){
+                closed = true;
+                return true;
+            }
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+    }
+
+    // Whether a whole request is in: its command, its headers and the source they announce.
+    // `too_long` is set when the command and headers run past SERVER_MAX_HEADERS.
+    bool complete(bool &too_long) const{
+        size_t at = pos;
+        uint64_t length = 0;
+        bool command = false;
+        too_long = false;
+        for (;;){
+            size_t end = buffer.find('\n', at);
+            if (end == string::npos || end - pos > SERVER_MAX_HEADERS){
+                too_long = (end == string::npos ? buffer.size() : end) - pos > SERVER_MAX_HEADERS;
+                return false;
+            }
+            string_view line = string_view(buffer).substr(at, end - at);
+            if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+            at = end + 1;
+
+            if (!command) command = !line.empty();              // Blank lines before the command are skipped
+            else if (line.empty()) return buffer.size() - at >= length;
+            else {
+                size_t colon = line.find(':');
+                uint64_t n;
+                if (colon != string_view::npos && equalsIgnoreCase(strip(line.substr(0, colon)), "Source-Length") && sourceLength(strip(line.substr(colon + 1)), n)) length = n;
+            }
+        }
+    }
+
+    // Reading a complete request, see complete()
+    bool readLine(string &line){
+        size_t end = buffer.find('\n', pos);
+        if (end == string::npos) return false;
+        line.assign(buffer, pos, end - pos);
+        pos = end + 1;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        return true;
+    }
+
+    bool read(size_t n, string &out){
+        if (buffer.size() - pos < n) return false;
+        out.assign(buffer, pos, n);
+        pos += n;
+        return true;
+    }
+
+    // Drops the requests already read
+    void consume(){
+        buffer.erase(0, pos);
+        pos = 0;
+    }
+
+    // Blocks for at most SERVER_SEND_SECONDS at a time, should the client not read its answers
+    bool write(string_view data){
+        while (!data.empty()){
+            ssize_t written = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+            if (written < 0){
+                if (errno == EINTR) continue;
+                return false;
+            }
+            data.remove_prefix(written);
+        }
+        return true;
+    }
+
+    chrono::steady_clock::time_point active;    // Last time something was sent or answered
+    chrono::steady_clock::time_point ready;     // When the request being answered was complete
+    bool busy = false;                  // With a worker
+    bool closed = false;                // The client sent all it will
+    bool broken = false;                // To be closed, the connection failed
+
+private:
+    int fd;
+    string buffer;
+    size_t pos = 0;
+};
+
+// Connections holding a complete request, for the workers, and those they answered, for the main thread.
+// The main thread is woken through a pipe, as it waits in poll().
+class RequestQueue {
+public:
+    explicit RequestQueue(int wake) : wake(wake){}
+
+    void push(Connection *connection){
+        lock_guard<std::mutex> lock(mutex);
+        ready.push_back(connection);
+        not_empty.notify_one();
+    }
+
+    // nullptr once closed and drained
+    Connection *pop(){
+        unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [&]{ return !ready.empty() || stopped; });
+        if (ready.empty()) return nullptr;
+        Connection *connection = ready.front();
+        ready.pop_front();
+        return connection;
+    }
+
+    void done(Connection *connection){
+        {
+            lock_guard<std::mutex> lock(mutex);
+            answered.push_back(connection);
+        }
+        char byte = 0;
+        while (::write(wake, &byte, 1) < 0 && errno == EINTR);
+    }
+
+    vector<Connection *> takeAnswered(){
+        lock_guard<std::mutex> lock(mutex);
+        vector<Connection *> out(answered.begin(), answered.end());
+        answered.clear();
+        return out;
+    }
+
+    void close(){
+        lock_guard<std::mutex> lock(mutex);
+        stopped = true;
+        not_empty.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    condition_variable not_empty;
+    deque<Connection *> ready;
+    deque<Connection *> answered;
+    int wake;
+    bool stopped = false;
+};
+
+struct ServerState {
+    ServerOptions options;
+    LatencyHistogram latency;
+    atomic<uint64_t> requests{0};
+    atomic<uint64_t> failed{0};         // Requests answered with ERROR
+    atomic<uint64_t> connections{0};
+    chrono::steady_clock::time_point started = chrono::steady_clock::now();
+};
+
+static bool isOn(string_view value){
+    return equalsIgnoreCase(value, "on") || equalsIgnoreCase(value, "true") || value == "1";
+}
+
+static string errorBody(string_view message){
+    return "{\"message\":" + jsonEscape(message) + "}";
+}
+
+// Runs one ASSEMBLE request on the worker's context. Returns false if the request itself was wrong.
+static bool assembleRequest(Connection &connection, const vector<pair<string, string>> &headers, ServerState &state, AssemblerContext &ctx, string &body){
+    string path, name, directory, source_text;
+    bool has_source = false;
+
+    ctx.clear();
+    ctx.options = state.options.options;
+    for (const auto &[header, value]: headers){
+        if (equalsIgnoreCase(header, "Path")) path = value;
+        else if (equalsIgnoreCase(header, "File")) name = value;
+        else if (equalsIgnoreCase(header, "Memo")) ctx.options.memo = isOn(value);
+        else if (equalsIgnoreCase(header, "Format-Only")) ctx.options.format_only = isOn(value);
+        else if (equalsIgnoreCase(header, "Directory")) directory = value;
+        else if (equalsIgnoreCase(header, "Source-Length")){
+            uint64_t n;
+            if (!sourceLength(value, n)){
+                body = errorBody("Invalid Source-Length " + value + ".");
+                return false;
+            }
+            if (!connection.read(n, source_text)){
+                body = errorBody("The connection closed before the whole source was sent.");
+                return false;
+            }
+            has_source = true;
+        }
+    }
+
+    SourceFile file;
+    string_view source = source_text;
+    if (!has_source){
+        if (path.empty()){
+            body = errorBody("ASSEMBLE needs either a Path or a Source-Length header.");
+            return false;
+        }
+        if (fs::path(path).is_relative()){
+            if (directory.empty() || fs::path(directory).is_relative()){
+                body = errorBody("Path " + path + " is relative, it needs the absolute Directory it is relative to.");
+                return false;
+            }
+            path = (fs::path(directory) / path).string();
+        }
+        if (!file.open(path)){
+            body = errorBody("File " + path + " was not found, or we were unable to open it.");
+            return false;
+        }
+        source = file.text();
+    }
+    if (name.empty()) name = has_source ? "<source>" : path;
+
+    TraceSpan span("assemble", "file", name);
+    firstPass(ctx, source);
+    if (!ctx.error && !ctx.options.format_only) secondPass(ctx);
+
+    ostringstream out;
+    out << "{\"error\":" << (ctx.error ? "true" : "false") << ",\"words\":[";
+    for (size_t i = 0; i < ctx.words.size(); i++){
+        char word[WORD_HEX_DIGITS + 3] = {'"'};
+        for (unsigned d = 0; d < WORD_HEX_DIGITS; d++) word[1 + d] = HEX_DIGITS[wordNibble(ctx.words[i], d)];
+        word[WORD_HEX_DIGITS + 1] = '"';
+        if (i) out << ',';
+        out.write(word, WORD_HEX_DIGITS + 2);
+    }
+    out << "],\"symbols\":[";
+    for (SymbolId id = 0; id < ctx.labels.size(); id++){
+        if (id) out << ',';
+        out << "{\"name\":" << jsonEscape(upperCopy(ctx.labels.name(id))) << ",\"address\":" << ctx.labels.address(id) << '}';
+    }
+    out << "],\"report\":";
+    writeDiagnosticsJson(out, name, ctx.diagnostics);
+    out << '}';
+    body = out.str();
+    return true;
+}
+
+static string statsBody(ServerState &state){
+    ostringstream out;
+    chrono::duration<double> uptime = chrono::steady_clock::now() - state.started;
+    out << "{\"uptime_s\":" << uptime.count() << ",\"workers\":" << state.options.workers
+        << ",\"connections\":" << state.connections << ",\"requests\":" << state.requests << ",\"failed\":" << state.failed << ",\"latency\":";
+    state.latency.writeJson(out);
+    out << '}';
+    return out.str();
+}
+
+// Answers the one complete request at the front of the connection
+static void answer(Connection &connection, ServerState &state, AssemblerContext &ctx){
+    TraceSpan span("request", "server");
+    string command, line, body;
+    vector<pair<string, string>> headers;
+
+    while (connection.readLine(command) && command.empty());
+    while (connection.readLine(line) && !line.empty()){
+        size_t colon = line.find(':');
+        if (colon == string::npos) continue;
+        headers.push_back({string(strip(string_view(line).substr(0, colon))), string(strip(string_view(line).substr(colon + 1)))});
+    }
+
+    bool ok;
+    if (equalsIgnoreCase(command, "ASSEMBLE")) ok = assembleRequest(connection, headers, state, ctx, body);
+    else if (equalsIgnoreCase(command, "STATS")){
+        body = statsBody(state);
+        ok = true;
+    }
+    else {
+        body = errorBody("Unknown command " + command + ". Expected ASSEMBLE or STATS.");
+        ok = false;
+    }
+    connection.consume();
+
+    state.requests++;
+    if (!ok) state.failed++;
+    bool sent = connection.write((ok ? "OK " : "ERROR ") + to_string(body.size()) + "\n") && connection.write(body);
+    state.latency.record(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - connection.ready).count());
+    if (!sent) connection.broken = true;
+}
+
+int serve(const string &path, const ServerOptions &options, ostream &log){
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)){
+        log << "Error: The socket path " << path << " is too long." << endl;
+        return 1;
+    }
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0){
+        log << "Error: Unable to create a socket." << endl;
+        return 1;
+    }
+
+    // A socket left behind by a daemon that is gone is replaced, one still being served is not
+    struct stat st;
+    if (::stat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)){
+        int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        bool live = probe >= 0 && ::connect(probe, (sockaddr *)&address, sizeof(address)) == 0;
+        if (probe >= 0) ::close(probe);
+        if (!live) ::unlink(path.c_str());
+    }
+    int wake[2];
+    if (::bind(listener, (sockaddr *)&address, sizeof(address)) != 0 || ::listen(listener, SOMAXCONN) != 0 || ::pipe(wake) != 0){
+        log << "Error: Unable to listen on " << path << ", it may be in use." << endl;
+        ::close(listener);
+        return 1;
+    }
+    ::fcntl(wake[0], F_SETFL, O_NONBLOCK);
+
+    ServerState state;
+    state.options = options;
+    if (!state.options.workers) state.options.workers = max(1u, thread::hardware_concurrency());
+
+    stopping = false;
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    signal(SIGPIPE, SIG_IGN);
+
+    RequestQueue queue(wake[1]);
+    vector<thread> workers;
+    for (size_t i = 0; i < state.options.workers; i++){
+        workers.emplace_back([&]{
+            AssemblerContext ctx;       // Kept warm across the requests this worker serves
+            for (Connection *connection; (connection = queue.pop());){
+                answer(*connection, state, ctx);
+                queue.done(connection);
+            }
+        });
+    }
+    log << "Serving on " << path << " with " << workers.size() << (workers.size() == 1 ? " worker." : " workers.") << endl;
+
+    vector<unique_ptr<Connection>> connections;
+    vector<pollfd> polled;
+    vector<Connection *> watched;               // Of polled, past the pipe and the listener
+    while (!stopping){
+        auto now = chrono::steady_clock::now();
+        for (Connection *connection: queue.takeAnswered()){
+            connection->busy = false;
+            connection->active = now;
+        }
+
+        // Complete requests go to the workers. The connections that are done, failed or were left idle are closed.
+        for (size_t i = 0; i < connections.size(); ){
+            Connection &connection = *connections[i];
+            bool too_long = false;
+            if (connection.busy || (!connection.broken && connection.complete(too_long))){
+                if (!connection.busy){
+                    connection.busy = true;
+                    connection.ready = now;
+                    queue.push(&connection);
+                }
+                i++;
+                continue;
+            }
+            if (connection.broken || connection.closed || too_long || now - connection.active > chrono::seconds(SERVER_IDLE_SECONDS)){
+                connections[i] = std::move(connections.back());
+                connections.pop_back();
+                continue;
+            }
+            i++;
+        }
+
+        polled.assign({{wake[0], POLLIN, 0}});
+        if (connections.size() < SERVER_MAX_CONNECTIONS) polled.push_back({listener, POLLIN, 0});
+        size_t first = polled.size();
+        watched.clear();
+        for (const unique_ptr<Connection> &connection: connections){
+            if (connection->busy) continue;
+            polled.push_back({connection->socket(), POLLIN, 0});
+            watched.push_back(connection.get());
+        }
+
+        int ready = ::poll(polled.data(), polled.size(), 200);
+        if (ready < 0 && errno != EINTR) break;
+        if (ready <= 0) continue;
+
+        char drain[64];
+        if (polled[0].revents) while (::read(wake[0], drain, sizeof(drain)) > 0);
+        if (first > 1 && polled[1].revents){
+            int fd = ::accept(listener, nullptr, nullptr);
+            if (fd >= 0){
+                timeval timeout = {SERVER_SEND_SECONDS, 0};
+                ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                connections.push_back(make_unique<Connection>(fd));
+                state.connections++;
+            }
+        }
+        for (size_t i = 0; i < watched.size(); i++){
+            if (polled[first + i].revents && !watched[i]->receive()) watched[i]->broken = true;
+        }
+    }
+
+    ::close(listener);
+    ::unlink(path.c_str());
+    queue.close();
+    for (thread &worker: workers) worker.join();
+    connections.clear();
+    ::close(wake[0]);
+    ::close(wake[1]);
+
+    log << "Served " << state.requests << " requests on " << state.connections << " connections. Latency: ";
+    state.latency.writeJson(log);
+    log << endl;
+    return 0;
+}
+
+#else
+
+int serve(const string &, const ServerOptions &, ostream &log){
+    log << "Error: --serve needs Unix domain sockets, which this build does not have." << endl;
+    return 1;
+}
+
+#endif
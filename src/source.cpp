@@ -0,0 +1,132 @@
+#include "source.h"
+#include "trace.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+SourceFile::~SourceFile(){
+    close();
+}
+
+bool SourceFile::open(const string &path){
+    TraceSpan span("read", "io", path);
+    close();
+
+    // A pipe can't be mapped, so the standard input is read in full
+    if (path == STANDARD_STREAM){
+        bool read = readBlocks(path, [&](string_view block){
+            buffer.append(block);
+            return true;
+        });
+        data = buffer.data();
+        size = buffer.size();
+        return read;
+    }
+
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)){
+        ::close(fd);
+        return false;
+    }
+
+    // An empty file can't be mapped, but is still a valid (empty) source
+    if (st.st_size > 0){
+        void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED){
+            ::close(fd);
+            return false;
+        }
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        data = static_cast<const char *>(map);
+        size = st.st_size;
+        mapped = true;
+    }
+    ::close(fd);                // The mapping stays valid after the descriptor is closed
+    return true;
+#else
+    ifstream file(path, ios::binary);
+    if (!file.is_open()) return false;
+    buffer.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+#endif
+}
+
+void SourceFile::close(){
+#ifndef _WIN32
+    if (mapped) munmap(const_cast<char *>(data), size);
+#endif
+    mapped = false;
+    data = nullptr;
+    size = 0;
+    buffer.clear();
+}
+
+bool readBlocks(const string &path, const function<bool(string_view)> &consume, uint64_t offset, uint64_t length){
+    unique_ptr<char[]> block(new char[SOURCE_BLOCK_SIZE]);
+    bool from_stdin = path == STANDARD_STREAM;
+    if (from_stdin && offset) return false;
+#ifndef _WIN32
+    // read() hands over whatever a pipe holds, so a block is consumed as soon as it comes in
+    int fd = from_stdin ? STDIN_FILENO : ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    if (offset && ::lseek(fd, off_t(offset), SEEK_SET) != off_t(offset)){
+        ::close(fd);
+        return false;
+    }
+
+    bool ok = true;
+    while (length){
+        ssize_t n = ::read(fd, block.get(), size_t(min<uint64_t>(length, SOURCE_BLOCK_SIZE)));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0){
+            ok = n == 0;
+            break;
+        }
+        length -= n;
+        if (!consume(string_view(block.get(), n))) break;
+    }
+    if (!from_stdin) ::close(fd);
+    return ok;
+#else
+    ifstream file;
+    istream *in = &cin;
+    if (!from_stdin){
+        file.open(path, ios::binary);
+        if (!file.is_open() || !file.seekg(offset)) return false;
+        in = &file;
+    }
+    while (*in && length){
+        in->read(block.get(), streamsize(min<uint64_t>(length, SOURCE_BLOCK_SIZE)));
+        length -= in->gcount();
+        if (in->gcount() > 0 && !consume(string_view(block.get(), in->gcount()))) break;
+    }
+    return !in->bad();
+#endif
+}
+
+bool nextLine(string_view text, size_t &pos, string_view &line){
+    if (pos >= text.size()) return false;
+    size_t end = text.find('\n', pos);
+    if (end == string_view::npos) end = text.size();
+    line = text.substr(pos, end - pos);
+    pos = end + 1;
+    return true;
+}
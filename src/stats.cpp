@@ -0,0 +1,242 @@
+#include "stats.h"
+#include "diagnostics.h"
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static const char *PHASE_NAMES[PHASES] = {"read", "first pass", "second pass", "emit", "write"};
+static const char *PHASE_KEYS[PHASES] = {"read", "first_pass", "second_pass", "emit", "write"};
+static const char *COUNTER_KEYS[COUNTERS] = {"cycles", "instructions", "branch_misses", "cache_misses"};
+
+atomic<bool> heap_counting(false);
+static atomic<uint64_t> heap_allocations(0);
+static atomic<uint64_t> heap_bytes(0);
+
+// Opened once by startCounters(), before any other thread is started, and only read after
+static int counter_fds[COUNTERS] = {-1, -1, -1, -1};
+static bool counting_hardware = false;
+static string counters_error;
+
+RunStats &RunStats::operator+=(const RunStats &other){
+    for (int p = 0; p < PHASES; p++) phases[p] += other.phases[p];
+    total += other.total;
+    source_lines += other.source_lines;
+    statements += other.statements;
+    labels += other.labels;
+    errors += other.errors;
+    bytes_read += other.bytes_read;
+    bytes_written += other.bytes_written;
+    return *this;
+}
+
+// The counters are of the whole process, so a phase timed on one thread among others doing the same gets none
+PhaseTimer::PhaseTimer(PhaseTime *time, bool thread_cpu) : time(time), thread_cpu(thread_cpu){
+    if (!time) return;
+    if (counting_hardware && !thread_cpu) readCounters(counters);
+    wall = wallTime();
+    cpu = cpuTime(thread_cpu);
+}
+
+void PhaseTimer::stop(){
+    if (!time) return;
+    time->wall += wallTime() - wall;
+    time->cpu += cpuTime(thread_cpu) - cpu;
+    time->runs++;
+    if (counting_hardware && !thread_cpu){
+        uint64_t now[COUNTERS];
+        readCounters(now);
+        for (int c = 0; c < COUNTERS; c++) time->counters[c] += now[c] - counters[c];
+    }
+    time = nullptr;
+}
+
+void countHeap(){
+    heap_counting.store(true, memory_order_relaxed);
+}
+
+void countAllocation(size_t size){
+    heap_allocations.fetch_add(1, memory_order_relaxed);
+    heap_bytes.fetch_add(size, memory_order_relaxed);
+}
+
+HeapStats heapStats(){
+    HeapStats heap;
+    heap.allocations = heap_allocations.load(memory_order_relaxed);
+    heap.bytes = heap_bytes.load(memory_order_relaxed);
+    return heap;
+}
+
+double wallTime(){
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double cpuTime(bool thread){
+#ifndef _WIN32
+    struct timespec now;
+    if (clock_gettime(thread ? CLOCK_THREAD_CPUTIME_ID : CLOCK_PROCESS_CPUTIME_ID, &now) != 0) return 0;
+    return now.tv_sec + now.tv_nsec / 1e9;
+#else
+    (void)thread;
+    return double(clock()) / CLOCKS_PER_SEC;           // Of the process, whichever thread asks
+#endif
+}
+
+size_t peakMemory(){
+#if defined(__APPLE__)
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? size_t(usage.ru_maxrss) : 0;            // Bytes on macOS
+#elif !defined(_WIN32)
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? size_t(usage.ru_maxrss) * 1024 : 0;     // Kilobytes elsewhere
+#else
+    return 0;
+#endif
+}
+
+bool startCounters(){
+#ifdef __linux__
+    static const uint64_t EVENTS[COUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES};
+
+    for (int c = 0; c < COUNTERS; c++){
+        if (counter_fds[c] >= 0) continue;
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = EVENTS[c];
+        attr.inherit = 1;                   // The threads started from here on are counted too
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        counter_fds[c] = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+        if (counter_fds[c] < 0 && counters_error.empty()) counters_error = string("perf_event_open: ") + strerror(errno);
+        counting_hardware = counting_hardware || counter_fds[c] >= 0;
+    }
+#else
+    counters_error = "hardware counters are only read on Linux";
+#endif
+    return counting_hardware;
+}
+
+bool countingHardware(){
+    return counting_hardware;
+}
+
+bool counterAvailable(int counter){
+    return counter_fds[counter] >= 0;
+}
+
+const string &countersError(){
+    return counters_error;
+}
+
+void readCounters(uint64_t values[COUNTERS]){
+    for (int c = 0; c < COUNTERS; c++){
+        values[c] = 0;
+#ifdef __linux__
+        uint64_t read_values[3];            // Count, time enabled, time running
+        if (counter_fds[c] < 0 || read(counter_fds[c], read_values, sizeof(read_values)) != sizeof(read_values) || !read_values[2]) continue;
+        values[c] = (read_values[1] == read_values[2]) ? read_values[0] : uint64_t(double(read_values[0]) * read_values[1] / read_values[2]);
+#endif
+    }
+}
+
+static void printCounters(ostream &log, const RunStats &stats);
+
+static double mib(uint64_t bytes){
+    return bytes / double(1 << 20);
+}
+
+void printRunStats(ostream &log, const RunStats &stats, const AssemblerStats &memo){
+    HeapStats heap = heapStats();
+
+    log << fixed << setprecision(3);
+    log << "Phase            Wall ms      CPU ms\n";
+    for (int p = 0; p < PHASES; p++){
+        if (!stats.phases[p].runs) continue;
+        log << left << setw(12) << PHASE_NAMES[p] << right << setw(12) << stats.phases[p].wall * 1e3 << setw(12) << stats.phases[p].cpu * 1e3 << '\n';
+    }
+    log << left << setw(12) << "total" << right << setw(12) << stats.total.wall * 1e3 << setw(12) << stats.total.cpu * 1e3 << '\n';
+
+    log << setprecision(1);
+    log << "Processed " << stats.source_lines << " source lines: " << stats.statements << " statements, " << stats.labels << " labels, "
+        << stats.errors << (stats.errors == 1 ? " error.\n" : " errors.\n");
+    log << "Read " << stats.bytes_read << " bytes, wrote " << stats.bytes_written << " bytes.\n";
+    log << "Heap: " << heap.allocations << " allocations, " << heap.bytes << " bytes. Peak memory: " << mib(peakMemory()) << " MiB.\n";
+
+    log << "Statement memo: ";
+    if (!memo.memo_lookups) log << "not used.";
+    else log << memo.memo_hits << " of " << memo.memo_lookups << " statements hit (" << 100.0 * memo.memo_hits / memo.memo_lookups << "%), "
+             << memo.memo_patched << " of them patched with a label address.";
+    log << defaultfloat << endl;
+
+    if (countingHardware()) printCounters(log, stats);
+    else if (!countersError().empty()) log << "Hardware counters: not available (" << countersError() << ")." << endl;
+}
+
+// Per phase, with the misses per thousand lines of source. Phases timed per thread have none.
+static void printCounters(ostream &log, const RunStats &stats){
+    double klines = stats.source_lines / 1e3;
+    auto row = [&](const char *name, const PhaseTime &t){
+        log << left << setw(12) << name << right;
+        for (int c = COUNTER_CYCLES; c <= COUNTER_INSTRUCTIONS; c++){
+            if (counterAvailable(c)) log << setw(15) << t.counters[c];
+            else log << setw(15) << "-";
+        }
+        if (counterAvailable(COUNTER_CYCLES) && counterAvailable(COUNTER_INSTRUCTIONS) && t.counters[COUNTER_CYCLES])
+            log << setw(7) << setprecision(2) << double(t.counters[COUNTER_INSTRUCTIONS]) / t.counters[COUNTER_CYCLES];
+        else log << setw(7) << "-";
+        for (int c = COUNTER_BRANCH_MISSES; c <= COUNTER_CACHE_MISSES; c++){
+            if (counterAvailable(c) && klines > 0) log << setw(18) << setprecision(1) << t.counters[c] / klines;
+            else log << setw(18) << "-";
+        }
+        log << '\n';
+    };
+
+    log << fixed << "Phase                Cycles   Instructions    IPC    Br. miss/kline  Cache miss/kline\n";
+    for (int p = 0; p < PHASES; p++){
+        if (stats.phases[p].runs && (stats.phases[p].counters[COUNTER_CYCLES] || stats.phases[p].counters[COUNTER_INSTRUCTIONS])) row(PHASE_NAMES[p], stats.phases[p]);
+    }
+    row("total", stats.total);
+    if (!countersError().empty()) log << "Some hardware counters are not available (" << countersError() << ")." << '\n';
+    log << defaultfloat << flush;
+}
+
+void writeRunStatsJson(ostream &out, const RunStats &stats, const AssemblerStats &memo){
+    HeapStats heap = heapStats();
+    auto time = [&](const PhaseTime &t){
+        out << "{\"wall\":" << t.wall << ",\"cpu\":" << t.cpu << ",\"runs\":" << t.runs;
+        for (int c = 0; c < COUNTERS; c++) if (counterAvailable(c)) out << ",\"" << COUNTER_KEYS[c] << "\":" << t.counters[c];
+        out << '}';
+    };
+
+    out << setprecision(9) << "{\"phases\":{";
+    for (int p = 0; p < PHASES; p++){
+        out << (p ? ",\"" : "\"") << PHASE_KEYS[p] << "\":";
+        time(stats.phases[p]);
+    }
+    out << "},\"total\":";
+    time(stats.total);
+    out << ",\"source_lines\":" << stats.source_lines << ",\"statements\":" << stats.statements << ",\"labels\":" << stats.labels
+        << ",\"errors\":" << stats.errors << ",\"bytes_read\":" << stats.bytes_read << ",\"bytes_written\":" << stats.bytes_written
+        << ",\"heap\":{\"allocations\":" << heap.allocations << ",\"bytes\":" << heap.bytes << "},\"peak_memory\":" << peakMemory()
+        << ",\"memo\":{\"lookups\":" << memo.memo_lookups << ",\"hits\":" << memo.memo_hits << ",\"patched\":" << memo.memo_patched << '}';
+    if (countingHardware() || !countersError().empty())
+        out << ",\"hardware_counters\":{\"enabled\":" << (countingHardware() ? "true" : "false") << ",\"error\":" << jsonEscape(countersError()) << '}';
+    out << '}' << defaultfloat << endl;
+}
@@ -0,0 +1,167 @@
+#include "stream.h"
+#include <algorithm>
+
+using namespace std;
+
+// States of a pending line
+#define PENDING_READY 0         // Final, waiting behind a line that isn't
+#define PENDING_HELD 1          // Waiting for a label to be defined, or the source to end
+#define PENDING_FAILED 2        // Has errors, the words stop there
+
+StreamAssembler::StreamAssembler(const AssemblerOptions &options){
+    ctx.options = options;
+    scratch.options = options;
+}
+
+void StreamAssembler::feed(string_view data, vector<Word> &ready){
+    size_t end = data.rfind('\n');
+    if (end == string_view::npos){
+        partial.append(data);
+        return;
+    }
+
+    // Only whole lines are scanned, the start of the next one is kept until its end comes in
+    if (partial.empty()) scan(data.substr(0, end + 1));
+    else {
+        partial.append(data.substr(0, end + 1));
+        scan(partial);
+    }
+    partial.assign(data.substr(end + 1));
+    release(ready);
+}
+
+void StreamAssembler::finish(vector<Word> &ready){
+    if (!partial.empty()) scan(partial);
+    partial.clear();
+
+    // Whatever is still held waits for a label that was never defined, which makes its dataline hex
+    for (auto &[entry, held]: holds) encode(entry, held.line_num, held.line, held.block, true);
+    holds.clear();
+    waiting.clear();
+    waiters.clear();
+    release(ready);
+
+    // Encoding errors don't count once labelling failed, as the second pass would not have run
+    if (labelling_failed) errors.erase(remove_if(errors.begin(), errors.end(), [](const Diagnostic &d){ return d.code > LABEL_DUPLICATE; }), errors.end());
+    stable_sort(errors.begin(), errors.end(), [](const Diagnostic &a, const Diagnostic &b){ return a.source_line < b.source_line; });
+
+    // An encoding error stands at the words written before it, the lines with errors having none
+    if (!labelling_failed){
+        size_t lines_failed = 0, last = SIZE_MAX;
+        for (Diagnostic &d: errors){
+            size_t line = d.position;
+            d.position -= lines_failed;
+            if (line != last) lines_failed++;
+            last = line;
+        }
+    }
+}
+
+// Takes a batch of whole lines (the last one may have no newline once the source ended) through the first pass,
+// then its labels and statements in the order of their lines
+void StreamAssembler::scan(string_view batch){
+    uint32_t base = source_lines;
+    source_lines += count(batch.begin(), batch.end(), '\n') + (batch.back() != '\n');
+    counters.source_lines = source_lines;
+
+    scanBatch(scratch, batch, base, [&](const SourceLine &line){
+        if (line.kind == LINE_LABEL) defineLabel(line);
+        else statement(line);
+    }, [&](Diagnostic &d){ labelError(std::move(d)); });
+}
+
+void StreamAssembler::defineLabel(const SourceLine &line){
+    auto [recorded, inserted] = ctx.labels.insert(line.text, address);
+
+    if (!inserted){
+        vector<Diagnostic> duplicate;
+        reportDuplicate(duplicate, address + 1, formatted, line, ctx.labels.address(recorded) + 1);
+        labelError(std::move(duplicate[0]));
+        return;
+    }
+
+    address++;
+    formatted++;
+    counters.labels++;
+    block = line.text;
+    queue.emplace_back().state = PENDING_READY;
+
+    // The statements held on this label can be encoded now
+    SymbolId id = waiting.find(line.text);
+    if (id == NO_SYMBOL) return;
+    for (size_t entry: waiters[waiting.address(id)]){
+        auto held = holds.find(entry);
+        encode(entry, held->second.line_num, held->second.line, held->second.block, false);
+        holds.erase(held);
+    }
+    waiters[waiting.address(id)].clear();
+}
+
+// A bad or duplicate label still takes an address, though not a line of the formatted code
+void StreamAssembler::labelError(Diagnostic d){
+    d.line = address + 1;
+    d.position = formatted;
+    address++;
+    errors.push_back(std::move(d));
+    queue.emplace_back().state = PENDING_FAILED;
+    labelling_failed = failed = true;
+}
+
+void StreamAssembler::statement(const SourceLine &line){
+    address++;
+    formatted++;
+    counters.statements++;
+    queue.emplace_back().state = PENDING_READY;
+
+    // Encoding errors won't be reported once labelling failed, nor will any more words be written
+    if (!labelling_failed) encode(queue_base + queue.size() - 1, formatted, line, block, false);
+}
+
+// Encodes the statement of queue entry `entry`, holding it if its dataline could be a label that isn't
+// defined yet, unless `last` is set. Returns whether it is final.
+bool StreamAssembler::encode(size_t entry, size_t line_num, const SourceLine &line, string_view block_label, bool last){
+    Pending &pending = queue[entry - queue_base];
+    string_view dataline;
+    run.diagnostics.clear();
+    bool ok = encodeSourceLine(ctx, run, line_num, line, block_label, pending.word, &dataline);
+
+    // Only a statement encoded for the first time can be held, the others were waiting on the label just defined
+    if (!last && !dataline.empty() && ctx.labels.find(dataline) == NO_SYMBOL){
+        auto [id, inserted] = waiting.insert(dataline, waiters.size());
+        if (inserted) waiters.emplace_back();
+        waiters[waiting.address(id)].push_back(entry);
+
+        Held &held = holds[entry];
+        held.line_num = line_num;
+        held.text.assign(line.text);
+        held.line = line;
+        held.line.text = held.text;
+        held.block = block_label;
+        pending.state = PENDING_HELD;
+        return false;
+    }
+
+    pending.state = ok ? PENDING_READY : PENDING_FAILED;
+    if (!ok){
+        failed = true;
+        for (Diagnostic &d: run.diagnostics){
+            d.position = line_num - 1;
+            errors.push_back(std::move(d));
+        }
+    }
+    return true;
+}
+
+// Hands out the words at the front of the queue that are final, up to the first error
+void StreamAssembler::release(vector<Word> &ready){
+    while (!queue.empty() && queue.front().state != PENDING_HELD){
+        if (queue.front().state == PENDING_FAILED) stopped = true;
+        if (!stopped){
+            ready.push_back(queue.front().word);
+            counters.words++;
+        }
+        queue.pop_front();
+        queue_base++;
+    }
+    counters.peak_held = max(counters.peak_held, queue.size());
+}
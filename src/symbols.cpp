@@ -0,0 +1,92 @@
+#include "symbols.h"
+#include "ascii.h"
+#include <cstring>
+
+using namespace std;
+
+static const size_t INITIAL_SLOTS = 64;
+
+Arena::Arena(size_t block_size) : block_size(block_size){}
+
+char *Arena::allocate(size_t size){
+    // Moving on to the next block that fits, making one if there is none
+    while (current < blocks.size() && offset + size > blocks[current].size){
+        current++;
+        offset = 0;
+    }
+    if (current == blocks.size()){
+        size_t n = max(block_size, size);
+        blocks.push_back({unique_ptr<char[]>(new char[n]), n});
+    }
+
+    char *p = blocks[current].data.get() + offset;
+    offset += size;
+    bytes += size;
+    return p;
+}
+
+string_view Arena::copy(string_view s){
+    if (s.empty()) return string_view();
+    char *p = allocate(s.size());
+    memcpy(p, s.data(), s.size());
+    return string_view(p, s.size());
+}
+
+void Arena::reset(){
+    current = 0;
+    offset = 0;
+    bytes = 0;
+}
+
+// FNV-1a over the uppercased name, as names are case-insensitive
+static uint32_t symbolHash(string_view name){
+    uint32_t h = 2166136261u;
+    for (char c: name) h = (h ^ (unsigned char)upperChar(c)) * 16777619u;
+    return h ^ (h >> 15);
+}
+
+SymbolTable::SymbolTable() : slots(INITIAL_SLOTS, Slot{0, NO_SYMBOL}){}
+
+size_t SymbolTable::slotOf(string_view name, uint32_t hash) const{
+    size_t mask = slots.size() - 1;
+    size_t i = hash & mask;
+    while (slots[i].id != NO_SYMBOL && (slots[i].hash != hash || !equalsIgnoreCase(names[slots[i].id], name))) i = (i + 1) & mask;
+    return i;
+}
+
+SymbolId SymbolTable::find(string_view name) const{
+    return slots[slotOf(name, symbolHash(name))].id;
+}
+
+pair<SymbolId, bool> SymbolTable::insert(string_view name, size_t address){
+    uint32_t hash = symbolHash(name);
+    size_t i = slotOf(name, hash);
+    if (slots[i].id != NO_SYMBOL) return {slots[i].id, false};
+
+    SymbolId id = names.size();
+    names.push_back(arena.copy(name));
+    addresses.push_back(address);
+    slots[i] = {hash, id};
+    if (2 * names.size() > slots.size()) grow();
+    return {id, true};
+}
+
+void SymbolTable::grow(){
+    vector<Slot> old(slots.size() * 2, Slot{0, NO_SYMBOL});
+    old.swap(slots);
+
+    size_t mask = slots.size() - 1;
+    for (const Slot &s: old){
+        if (s.id == NO_SYMBOL) continue;
+        size_t i = s.hash & mask;
+        while (slots[i].id != NO_SYMBOL) i = (i + 1) & mask;
+        slots[i] = s;
+    }
+}
+
+void SymbolTable::clear(){
+    arena.reset();
+    names.clear();
+    addresses.clear();
+    for (Slot &s: slots) s = Slot{0, NO_SYMBOL};
+}
@@ -0,0 +1,99 @@
+#include "thread_pool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(size_t threads){
+    if (threads == 0) threads = thread::hardware_concurrency();
+    if (threads == 0) threads = 1;
+
+    queues.reset(new Queue[threads]);
+    workers.reserve(threads);
+    for (size_t i = 0; i < threads; i++) workers.emplace_back(&ThreadPool::work, this, i);
+}
+
+ThreadPool::~ThreadPool(){
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    start.notify_all();
+    for (thread &t: workers) t.join();
+}
+
+void ThreadPool::run(size_t count, const function<void(size_t)> &fn){
+    if (count == 0) return;
+
+    // A worker that only woke up after the previous run was over may still be looking for work
+    unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this]{ return active == 0; });
+
+    for (size_t i = 0; i < count; i++){
+        Queue &q = queues[i % workers.size()];
+        lock_guard<std::mutex> queue_lock(q.mutex);
+        q.items.push_back(i);
+    }
+    task = &fn;
+    pending = count;
+    failure = nullptr;
+    generation++;
+    start.notify_all();
+
+    // Waiting for the workers to go idle as well, so none of them is still holding `fn` once we return
+    done.wait(lock, [this]{ return pending == 0 && active == 0; });
+    task = nullptr;
+    if (failure) rethrow_exception(failure);
+}
+
+// Own deque from the back, everyone else's from the front
+bool ThreadPool::take(size_t id, size_t &item){
+    for (size_t n = 0; n < workers.size(); n++){
+        Queue &q = queues[(id + n) % workers.size()];
+        lock_guard<std::mutex> lock(q.mutex);
+        if (q.items.empty()) continue;
+        if (n == 0){
+            item = q.items.back();
+            q.items.pop_back();
+        }
+        else {
+            item = q.items.front();
+            q.items.pop_front();
+        }
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::work(size_t id){
+    size_t seen = 0;
+
+    while (true){
+        const function<void(size_t)> *fn;
+        {
+            unique_lock<std::mutex> lock(mutex);
+            start.wait(lock, [&]{ return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+            fn = task;
+            active++;
+        }
+
+        size_t item;
+        size_t finished = 0;
+        exception_ptr error;
+        while (take(id, item)){
+            try {
+                (*fn)(item);
+            }
+            catch (...) {
+                if (!error) error = current_exception();
+            }
+            finished++;
+        }
+
+        lock_guard<std::mutex> lock(mutex);
+        if (error && !failure) failure = error;
+        pending -= finished;
+        active--;
+        if (pending == 0 && active == 0) done.notify_all();
+    }
+}
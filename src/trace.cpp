@@ -0,0 +1,135 @@
+#include "trace.h"
+#include "diagnostics.h"
+#include <chrono>
+#include <iomanip>
+#include <string>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+using namespace std;
+
+struct TraceRecord {
+    const char *name;
+    const char *category;
+    const char *key;
+    int64_t value;
+    string file;
+    int64_t start;                      // Nanoseconds since startTrace()
+    int64_t end;
+};
+
+// Filled by its thread alone, read by writeTrace() up to `used`
+struct TraceBlock {
+    TraceRecord spans[TRACE_BLOCK_SPANS];
+    atomic<size_t> used{0};
+    atomic<TraceBlock *> next{nullptr};
+};
+
+struct TraceBuffer {
+    int64_t thread;
+    bool main = false;
+    TraceBlock first;
+    TraceBlock *last = &first;          // Only touched by the thread of the buffer
+    TraceBuffer *next = nullptr;        // Set before the buffer is linked, never changed after
+};
+
+atomic<bool> trace_on(false);
+static atomic<TraceBuffer *> buffers(nullptr);
+static chrono::steady_clock::time_point origin;     // Set before tracing is turned on
+
+static int64_t now(){
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - origin).count();
+}
+
+// The ID the system knows the thread by where it has one, so it matches what a profiler shows
+static int64_t threadId(){
+#ifdef __linux__
+    return syscall(SYS_gettid);
+#else
+    static atomic<int64_t> threads(1);
+    return threads++;
+#endif
+}
+
+static TraceBuffer &localBuffer(){
+    thread_local TraceBuffer *buffer = nullptr;
+    if (buffer) return *buffer;
+
+    buffer = new TraceBuffer();
+    buffer->thread = threadId();
+    buffer->next = buffers.load(memory_order_relaxed);
+    while (!buffers.compare_exchange_weak(buffer->next, buffer, memory_order_release, memory_order_relaxed));
+    return *buffer;
+}
+
+void startTrace(){
+    if (tracing()) return;
+    origin = chrono::steady_clock::now();
+    localBuffer().main = true;
+    trace_on.store(true, memory_order_relaxed);
+}
+
+void TraceSpan::begin(){
+    start = now();
+}
+
+void TraceSpan::record(){
+    int64_t finish = now();
+    TraceBuffer &buffer = localBuffer();
+    TraceBlock *block = buffer.last;
+    size_t used = block->used.load(memory_order_relaxed);
+    if (used == TRACE_BLOCK_SPANS){
+        TraceBlock *fresh = new TraceBlock();
+        block->next.store(fresh, memory_order_release);
+        buffer.last = block = fresh;
+        used = 0;
+    }
+
+    TraceRecord &span = block->spans[used];
+    span.name = name;
+    span.category = category;
+    span.key = key;
+    span.value = value;
+    span.file.assign(file);
+    span.start = start;
+    span.end = finish;
+    block->used.store(used + 1, memory_order_release);
+    start = -1;
+}
+
+// Complete events ("X") carry their duration, so a span is one event. Times are in microseconds.
+void writeTrace(ostream &out){
+#ifndef _WIN32
+    long pid = ::getpid();
+#else
+    long pid = 0;
+#endif
+    size_t threads = 0;
+
+    out << fixed << setprecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":0,\"args\":{\"name\":\"Assembler\"}}";
+    for (TraceBuffer *buffer = buffers.load(memory_order_acquire); buffer; buffer = buffer->next){
+        string thread = buffer->main ? "main" : "thread " + to_string(++threads);
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << buffer->thread << ",\"args\":{\"name\":\"" << thread << "\"}}";
+        out << ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << buffer->thread << ",\"args\":{\"sort_index\":" << (buffer->main ? 0 : 1) << "}}";
+
+        for (TraceBlock *block = &buffer->first; block; block = block->next.load(memory_order_acquire)){
+            size_t used = block->used.load(memory_order_acquire);
+            for (size_t i = 0; i < used; i++){
+                const TraceRecord &span = block->spans[i];
+                out << ",\n{\"name\":\"" << span.name << "\",\"cat\":\"" << span.category << "\",\"ph\":\"X\",\"ts\":" << span.start / 1e3
+                    << ",\"dur\":" << (span.end - span.start) / 1e3 << ",\"pid\":" << pid << ",\"tid\":" << buffer->thread;
+                if (span.key) out << ",\"args\":{\"" << span.key << "\":" << span.value << '}';
+                else if (!span.file.empty()) out << ",\"args\":{\"file\":" << jsonEscape(span.file) << '}';
+                out << '}';
+            }
+        }
+    }
+    out << "]}" << defaultfloat << endl;
+}
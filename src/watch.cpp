@@ -0,0 +1,268 @@
+#include "watch.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+#ifdef __linux__
+#include <cerrno>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Offset of each line of `text`, followed by the size of `text`. Lines are split the way nextLine() does.
+static void lineStarts(string_view text, vector<size_t> &starts){
+    starts.clear();
+    for (size_t pos = 0; pos < text.size();){
+        starts.push_back(pos);
+        size_t end = text.find('\n', pos);
+        pos = (end == string_view::npos) ? text.size() : end + 1;
+    }
+    starts.push_back(text.size());
+}
+
+IncrementalAssembler::IncrementalAssembler(const AssemblerOptions &options){
+    ctx.options = options;
+}
+
+// Length of the common prefix of `a` and `b`, and of their common suffix of at most `limit` bytes.
+// Whole blocks are compared with memcmp() first, as most of the source is usually the same.
+static constexpr size_t COMPARE_BLOCK = 4096;
+
+static size_t commonPrefix(string_view a, string_view b){
+    size_t n = min(a.size(), b.size()), i = 0;
+    while (i + COMPARE_BLOCK <= n && memcmp(a.data() + i, b.data() + i, COMPARE_BLOCK) == 0) i += COMPARE_BLOCK;
+    while (i < n && a[i] == b[i]) i++;
+    return i;
+}
+
+static size_t commonSuffix(string_view a, string_view b, size_t limit){
+    const char *x = a.data() + a.size(), *y = b.data() + b.size();
+    size_t i = 0;
+    while (i + COMPARE_BLOCK <= limit && memcmp(x - i - COMPARE_BLOCK, y - i - COMPARE_BLOCK, COMPARE_BLOCK) == 0) i += COMPARE_BLOCK;
+    while (i < limit && x[-1 - ptrdiff_t(i)] == y[-1 - ptrdiff_t(i)]) i++;
+    return i;
+}
+
+WatchUpdate IncrementalAssembler::update(string source){
+    WatchUpdate result;
+
+    // Nothing to build on at first, or after an error
+    if (starts.empty() || ctx.error || !splice(result, source)){
+        text = std::move(source);
+        lineStarts(text, starts);
+        rebuild(result);
+    }
+    return result;
+}
+
+// Assembles the whole source, keeping the datalines of its statements
+void IncrementalAssembler::rebuild(WatchUpdate &result){
+    string_view label;
+
+    result = WatchUpdate();
+    result.lines = starts.size() - 1;
+    ctx.clear();
+    datalines.clear();
+    firstPass(ctx, text);
+    result.labelling_error = ctx.error;
+    if (ctx.error) return;
+
+    // As in secondPass(), a statement in error has no word, and its errors are placed at the word it would have had
+    size_t failed = 0;
+    run.diagnostics.clear();
+    ctx.words.resize(ctx.lines.size());
+    datalines.resize(ctx.lines.size());
+    for (size_t i = 0; i < ctx.lines.size(); i++){
+        if (ctx.lines[i].kind == LINE_LABEL) label = ctx.lines[i].text;
+        size_t reported = run.diagnostics.size();
+        Word word;
+        if (encodeLine(ctx, run, i, label, word, &datalines[i])){
+            ctx.words[i - failed] = word;
+            continue;
+        }
+        for (size_t d = reported; d < run.diagnostics.size(); d++) run.diagnostics[d].position = i - failed;
+        failed++;
+    }
+
+    if (failed){
+        ctx.words.resize(ctx.lines.size() - failed);
+        ctx.error = true;
+        for (Diagnostic &d: run.diagnostics) ctx.diagnostics.push_back(std::move(d));
+    }
+}
+
+// Edits `text` into `source` in place, going over the lines between the first and last that differ.
+// Returns false if it can't be done incrementally, leaving the rest to rebuild().
+bool IncrementalAssembler::splice(WatchUpdate &result, const string &source){
+    size_t head = commonPrefix(text, source);
+    size_t tail = commonSuffix(text, source, min(text.size(), source.size()) - head);
+    ptrdiff_t shift = ptrdiff_t(source.size()) - ptrdiff_t(text.size());
+
+    result.incremental = true;
+    if (head == text.size() && shift == 0) return true;
+
+    // The lines that differ: from the one holding the first byte that differs, the last line going on if it had no newline,
+    // up to the first one starting in the common suffix. A line starting right where the suffix does is only kept if it starts a line in the new source too.
+    size_t old_lines = starts.size() - 1, cut = text.size() - tail;
+    bool aligned = cut + shift == 0 || source[cut + shift - 1] == '\n';
+    size_t first = upper_bound(starts.begin(), starts.end() - (text.empty() || text.back() == '\n' ? 0 : 1), head) - starts.begin() - 1;
+    size_t last = (aligned ? lower_bound(starts.begin() + first, starts.end() - 1, cut) : upper_bound(starts.begin() + first, starts.end() - 1, cut)) - starts.begin();
+    size_t from = starts[first], to = starts[last];
+
+    // Lines of the formatted code that came from them, source lines being counted from 1
+    auto lineOf = [&](size_t source_line){
+        return size_t(lower_bound(ctx.lines.begin(), ctx.lines.end(), source_line, [](const SourceLine &l, size_t n){ return l.source_line < n; }) - ctx.lines.begin());
+    };
+    size_t begin = lineOf(first + 1), end = lineOf(last + 1);
+    bool labels_changed = false;
+    for (size_t i = begin; i < end; i++) labels_changed = labels_changed || ctx.lines[i].kind == LINE_LABEL;
+
+    // Editing the text in place keeps the views before the change valid, unless it has to grow
+    const char *old_base = text.data();
+    text.replace(from, to - from, source, from, to + shift - from);
+    const char *new_base = text.data();
+
+    // Line starts of the new lines, those after them moved along
+    vector<size_t> region;
+    for (size_t pos = from; pos < size_t(to + shift);){
+        region.push_back(pos);
+        const char *nl = (const char *)memchr(text.data() + pos, '\n', to + shift - pos);
+        pos = nl ? nl - text.data() + 1 : to + shift;
+    }
+    starts.erase(starts.begin() + first, starts.begin() + last);
+    starts.insert(starts.begin() + first, region.begin(), region.end());
+    if (shift) for (size_t i = first + region.size(); i < starts.size(); i++) starts[i] += shift;
+    ptrdiff_t line_shift = ptrdiff_t(starts.size() - 1) - ptrdiff_t(old_lines);
+
+    AssemblerContext scratch;
+    scratch.options = ctx.options;
+    firstPass(scratch, string_view(text).substr(from, to + shift - from));
+    if (scratch.error) return false;
+    labels_changed = labels_changed || scratch.labels.size();
+
+    // The views of the lines kept are moved with the text
+    auto rebase = [&](string_view v, ptrdiff_t by){ return v.empty() ? v : string_view(new_base + (v.data() - old_base) + by, v.size()); };
+    for (size_t i = (new_base == old_base) ? end : 0; i < ctx.lines.size(); i++){
+        if (i == begin && i < end) i = end;
+        if (i >= ctx.lines.size()) break;
+
+        ptrdiff_t by = (i < begin) ? 0 : shift;
+        if (new_base == old_base && by == 0) break;
+        ctx.lines[i].text = rebase(ctx.lines[i].text, by);
+        datalines[i] = rebase(datalines[i], by);
+    }
+    if (line_shift) for (size_t i = end; i < ctx.lines.size(); i++) ctx.lines[i].source_line += line_shift;
+
+    // Swapping the lines that differ for the new ones
+    size_t count = scratch.lines.size();
+    vector<Word> old_words(ctx.words.begin() + begin, ctx.words.begin() + end);
+    for (SourceLine &line: scratch.lines) line.source_line += first;
+    if (count != end - begin){
+        ctx.lines.erase(ctx.lines.begin() + begin, ctx.lines.begin() + end);
+        ctx.lines.insert(ctx.lines.begin() + begin, scratch.lines.begin(), scratch.lines.end());
+        ctx.words.erase(ctx.words.begin() + begin, ctx.words.begin() + end);
+        ctx.words.insert(ctx.words.begin() + begin, count, 0);
+        datalines.erase(datalines.begin() + begin, datalines.begin() + end);
+        datalines.insert(datalines.begin() + begin, count, string_view());
+    }
+    else copy(scratch.lines.begin(), scratch.lines.end(), ctx.lines.begin() + begin);
+
+    result.resized = count != end - begin;
+    result.lines = max(last - first, region.size());
+
+    // A label that was added, removed or moved is dirty, and so are the statements referring to it
+    SymbolTable dirty;
+    if ((labels_changed || result.resized) && !relabel(dirty)) return false;
+
+    run.diagnostics.clear();
+    for (size_t i = begin; i < begin + count; i++){
+        if (!encodeLine(ctx, run, i, string_view(), ctx.words[i], &datalines[i])) return false;
+        if (!result.resized && ctx.words[i] != old_words[i - begin]) result.changed.push_back(i);
+    }
+
+    if (!dirty.size()) return true;
+    for (size_t i = 0; i < ctx.lines.size(); i++){
+        if (i == begin) i += count;
+        if (i >= ctx.lines.size()) break;
+        if (datalines[i].empty() || dirty.find(datalines[i]) == NO_SYMBOL) continue;
+
+        // A label that was and still is defined only moved, its new address goes in place of the old one
+        Word word = ctx.words[i];
+        SymbolId was = spare.find(datalines[i]), now = ctx.labels.find(datalines[i]);
+        if (was != NO_SYMBOL && now != NO_SYMBOL){
+            if (ctx.labels.address(now) > 255) return false;
+            ctx.words[i] = (word & ~Word(0xff)) | ctx.labels.address(now);
+        }
+        else if (!encodeLine(ctx, run, i, string_view(), ctx.words[i], &datalines[i])) return false;
+        if (!result.resized && ctx.words[i] != word) result.changed.push_back(i);
+    }
+    sort(result.changed.begin(), result.changed.end());
+    return true;
+}
+
+// Records the labels of the line table afresh, the previous ones going to `spare`. Labels that
+// are new, gone or at another address are added to `dirty`. Returns false if a label is defined twice.
+bool IncrementalAssembler::relabel(SymbolTable &dirty){
+    swap(spare, ctx.labels);
+    ctx.labels.clear();
+    for (size_t i = 0; i < ctx.lines.size(); i++){
+        if (ctx.lines[i].kind == LINE_LABEL && !ctx.labels.insert(ctx.lines[i].text, i).second) return false;
+    }
+
+    for (SymbolId id = 0; id < ctx.labels.size(); id++){
+        SymbolId was = spare.find(ctx.labels.name(id));
+        if (was == NO_SYMBOL || spare.address(was) != ctx.labels.address(id)) dirty.insert(ctx.labels.name(id), 0);
+    }
+    for (SymbolId id = 0; id < spare.size(); id++){
+        if (ctx.labels.find(spare.name(id)) == NO_SYMBOL) dirty.insert(spare.name(id), 0);
+    }
+    return true;
+}
+
+
+// File watcher
+FileWatcher::~FileWatcher(){
+#ifdef __linux__
+    if (fd >= 0) ::close(fd);
+#endif
+}
+
+bool FileWatcher::open(const string &path){
+#ifdef __linux__
+    // The directory is watched rather than the file, as editors often save by moving a new file in its place
+    filesystem::path file(path);
+    filesystem::path dir = file.has_parent_path() ? file.parent_path() : filesystem::path(".");
+    name = file.filename().string();
+
+    fd = ::inotify_init1(IN_CLOEXEC);
+    if (fd < 0) return false;
+    return ::inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) >= 0;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+bool FileWatcher::wait(){
+#ifdef __linux__
+    alignas(inotify_event) char buffer[4096];
+    for (;;){
+        ssize_t n = ::read(fd, buffer, sizeof(buffer));
+        if (n < 0){
+            if (errno == EINTR) continue;
+            return false;
+        }
+
+        bool found = false;
+        for (char *p = buffer; p < buffer + n; p += sizeof(inotify_event) + ((inotify_event *)p)->len){
+            const inotify_event *event = (const inotify_event *)p;
+            found = found || (event->len && name == event->name);
+        }
+        if (found) return true;
+    }
+#else
+    return false;
+#endif
+}
@@ -220,6 +220,489 @@ for input_file in "$INPUT_DIR"/input_*.txt; do
 
 done
 
+# Diagnostics
+# -d json and -d sarif write the errors of each input to stdout. The assembler is run from the input directory so the
+# reports name the inputs the same way wherever the repo is, and the version in SARIF is taken as dev whatever it was built as.
+echo -e "${BLU}Diagnostics:${RST}\n"
+ASSEMBLER_PATH=$(realpath "$ASSEMBLER")
+SCRATCH_DIR=$(realpath "$OUTPUT_DIR")/scratch
+mkdir -p "$SCRATCH_DIR"
+
+for format in json sarif; do
+    mkdir -p "$OUTPUT_DIR/$format"
+    for input_file in "$INPUT_DIR"/input_*.txt; do
+        name=$(basename $input_file .txt | sed 's/input_//')
+        exp_diag="$EXPECTED_DIR/$format/$name.$format"
+        out_diag="$OUTPUT_DIR/$format/$name.$format"
+        echo "${BLU}Input_file:${RST} $name, -d $format"
+
+        (cd "$INPUT_DIR" && "$ASSEMBLER_PATH" -i "$(basename $input_file)" -d $format -o "$SCRATCH_DIR/hex.txt" -b "$SCRATCH_DIR/bin.txt" -f "$SCRATCH_DIR/format.txt") 2> /dev/null \
+            | sed 's/"name":"Assembler","version":"[^"]*"/"name":"Assembler","version":"dev"/' > "$out_diag"
+        signal=${PIPESTATUS[0]}
+        if [[ $signal -ne 8 && $signal -ne 0 ]]; then
+            echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+            echo "The Assembler returned exit code $signal${RST}"
+            ((flag |= 0xc0))
+
+        elif ! diff -q "$exp_diag" "$out_diag" > /dev/null; then
+            echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+            echo "The $format reports do not match!!!${RST}"
+            diff "$exp_diag" "$out_diag"
+            ((flag |= 0xc0))
+        else
+            echo "✅ ${GRN} Test 🧪🧪 case passed successfully!!!${RST}"
+        fi
+        ((flag &= 0x80))
+    done
+    echo -e "\n"
+done
+
+# Images
+# Each -e format is emitted for every input. Only the inputs that assemble cleanly have images expected, the others must not write any.
+echo -e "${BLU}Images:${RST}\n"
+IMAGE_FORMATS="ihex raw memh memb rle"
+for format in $IMAGE_FORMATS; do
+    mkdir -p "$OUTPUT_DIR/$format"
+done
+
+for input_file in "$INPUT_DIR"/input_*.txt; do
+    name=$(basename $input_file .txt | sed 's/input_//')
+    echo "${BLU}Input_file:${RST} $name"
+
+    emits=()
+    for format in $IMAGE_FORMATS; do
+        rm -f "$OUTPUT_DIR/$format/$name.$format"
+        emits+=(-e "$format=$OUTPUT_DIR/$format/$name.$format")
+    done
+    "$ASSEMBLER" -i "$input_file" -o "$SCRATCH_DIR/hex.txt" -b "$SCRATCH_DIR/bin.txt" -f "$SCRATCH_DIR/format.txt" "${emits[@]}" > /dev/null 2>&1
+    signal=$?
+    if [[ $signal -ne 8 && $signal -ne 0 ]]; then
+        echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+        echo "The Assembler returned exit code $signal${RST}"
+        ((flag |= 0xc0))
+    fi
+
+    for format in $IMAGE_FORMATS; do
+        exp_image="$EXPECTED_DIR/$format/$name.$format"
+        out_image="$OUTPUT_DIR/$format/$name.$format"
+        if [[ ! -f "$exp_image" && -f "$out_image" ]]; then
+            echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+            echo "No $format image was expected, yet was generated!!!${RST}"
+            ((flag |= 0xc0))
+
+        elif [[ -f "$exp_image" ]] && ! cmp -s "$exp_image" "$out_image"; then
+            echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+            echo "The $format images do not match!!!${RST}"
+            ((flag |= 0xc0))
+        fi
+    done
+    if ! ((flag & 0x40)); then
+        echo "✅ ${GRN} Test 🧪🧪 case passed successfully!!!${RST}"
+    fi
+    ((flag &= 0x80))
+done
+echo -e "\n"
+
+# Batch mode
+# Several inputs in one run are spread over the threads, and each has to get the files it gets when assembled on its own.
+# Two inputs of the same name sent to one output directory would write over each other, and have to be refused.
+echo -e "${BLU}Batch Mode:${RST}\n"
+BATCH_DIR="$OUTPUT_DIR/batch"
+rm -rf "$BATCH_DIR"
+mkdir -p "$BATCH_DIR/first" "$BATCH_DIR/second"
+cp "$INPUT_DIR/input_io.txt" "$BATCH_DIR/first/program.txt"
+cp "$INPUT_DIR/input_bad_opcode.txt" "$BATCH_DIR/second/program.txt"
+
+echo "${BLU}Input_file:${RST} io and bad_opcode, next to each input"
+"$ASSEMBLER" -i "$BATCH_DIR/first/program.txt" -i "$BATCH_DIR/second/program.txt" -j 2 > /dev/null 2>&1
+signal=$?
+if [[ $signal -ne 8 ]]; then
+    echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+    echo "The Assembler returned exit code $signal, not 8${RST}"
+    ((flag |= 0xc0))
+fi
+for pair in "first io" "second bad_opcode"; do
+    set -- $pair
+    for kind in hex bin; do
+        normal="$OUTPUT_HEX/$2.txt"
+        [[ $kind == bin ]] && normal="$OUTPUT_BIN/$2.txt"
+        if [[ -f "$normal" || -f "$BATCH_DIR/$1/program_$kind.txt" ]] && ! cmp -s "$normal" "$BATCH_DIR/$1/program_$kind.txt"; then
+            echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+            echo "The $kind files of $2 do not match!!!${RST}"
+            ((flag |= 0xc0))
+        fi
+    done
+done
+if ! ((flag & 0x40)); then
+    echo "✅ ${GRN} Test 🧪🧪 case passed successfully!!!${RST}"
+fi
+((flag &= 0x80))
+
+echo "${BLU}Input_file:${RST} io and bad_opcode, into one output directory"
+"$ASSEMBLER" -i "$BATCH_DIR/first/program.txt" -i "$BATCH_DIR/second/program.txt" -O "$BATCH_DIR/together" -j 2 > /dev/null 2>&1
+signal=$?
+if [[ $signal -ne 7 ]]; then
+    echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+    echo "The Assembler returned exit code $signal, not 7, for two inputs written to the same files${RST}"
+    ((flag |= 0xc0))
+
+elif [[ -e "$BATCH_DIR/together/program_hex.txt" ]]; then
+    echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+    echo "Files were written for inputs that were refused!!!${RST}"
+    ((flag |= 0xc0))
+else
+    echo "✅ ${GRN} Test 🧪🧪 case passed successfully!!!${RST}"
+fi
+((flag &= 0x80))
+echo -e "\n"
+
+# Parallel passes
+# A source of 2 * CHUNK_MIN_BYTES or more is split into chunks assembled side by side (see assembler.h), which has to
+# give the very files -j 1 gives by assembling it in one piece. The inputs are doubled up until they are that large:
+# all the opcodes, which assemble cleanly, and every input together, with their errors and their labels defined again in each copy.
+echo -e "${BLU}Parallel Passes:${RST}\n"
+PARALLEL_DIR="$OUTPUT_DIR/parallel"
+mkdir -p "$PARALLEL_DIR"
+cp "$INPUT_DIR/input_all_opcodes.txt" "$PARALLEL_DIR/clean.txt"
+cat "$INPUT_DIR"/input_*.txt > "$PARALLEL_DIR/errors.txt"
+
+for name in clean errors; do
+    large="$PARALLEL_DIR/$name.txt"
+    while [[ $(wc -c < "$large") -lt $((2 * 1024 * 1024)) ]]; do
+        cat "$large" "$large" > "$large.tmp" && mv "$large.tmp" "$large"
+    done
+    echo "${BLU}Input_file:${RST} $name, $(wc -c < "$large") bytes"
+
+    for jobs in 1 4; do
+        rm -f "$PARALLEL_DIR/${name}_j$jobs"_*.txt
+        "$ASSEMBLER" -i "$large" -j $jobs -o "$PARALLEL_DIR/${name}_j${jobs}_hex.txt" -b "$PARALLEL_DIR/${name}_j${jobs}_bin.txt" -f "$PARALLEL_DIR/${name}_j${jobs}_format.txt" > /dev/null
+        signal=$?
+        if [[ $signal -ne 8 && $signal -ne 0 ]]; then
+            echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+            echo "The Assembler returned exit code $signal with -j $jobs${RST}"
+            ((flag |= 0xc0))
+        fi
+    done
+
+    for kind in hex bin format; do
+        if [[ -f "$PARALLEL_DIR/${name}_j1_$kind.txt" || -f "$PARALLEL_DIR/${name}_j4_$kind.txt" ]] && ! cmp -s "$PARALLEL_DIR/${name}_j1_$kind.txt" "$PARALLEL_DIR/${name}_j4_$kind.txt"; then
+            echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+            echo "The $kind files of -j 1 and -j 4 do not match!!!${RST}"
+            ((flag |= 0xc0))
+        fi
+    done
+    if ! ((flag & 0x40)); then
+        echo "✅ ${GRN} Test 🧪🧪 case passed successfully!!!${RST}"
+    fi
+    echo -e "\n"
+    ((flag &= 0x80))
+done
+
+# Build cache
+# Every input is assembled twice with a cache of its own. A clean input is stored by the first run and taken from the
+# cache by the second, which has to write the expected files all the same. An input with errors is never stored.
+# A cache kept under a byte has to evict what it just stored, and miss again.
+echo -e "${BLU}Build Cache:${RST}\n"
+CACHE_DIR="$OUTPUT_DIR/cache"
+OUTPUT_CACHE="$OUTPUT_DIR/cached"
+mkdir -p "$OUTPUT_CACHE"
+
+for input_file in "$INPUT_DIR"/input_*.txt; do
+    name=$(basename $input_file .txt | sed 's/input_//')
+    echo "${BLU}Input_file:${RST} $name"
+
+    if [[ -f "$EXPECTED_BIN/$name.txt" ]]; then
+        runs=("0 of 1 lookups hit.*1 stored" "1 of 1 lookups hit.*0 stored")
+    else
+        runs=("0 of 1 lookups hit.*0 stored" "0 of 1 lookups hit.*0 stored")
+    fi
+    rm -rf "$CACHE_DIR"
+    for run in "${runs[@]}"; do
+        rm -f "$OUTPUT_CACHE/$name"_*.txt
+        stats=$("$ASSEMBLER" -i "$input_file" -o "$OUTPUT_CACHE/${name}_hex.txt" -b "$OUTPUT_CACHE/${name}_bin.txt" -f "$OUTPUT_CACHE/${name}_format.txt" --cache "$CACHE_DIR" --cache-stats 2> /dev/null)
+        signal=$?
+        if [[ $signal -ne 8 && $signal -ne 0 ]]; then
+            echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+            echo "The Assembler returned exit code $signal${RST}"
+            ((flag |= 0xc0))
+
+        elif ! grep -q "Build cache: $run" <<< "$stats"; then
+            echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+            echo "Expected the cache to report \"$run\"${RST}"
+            grep "Build cache" <<< "$stats"
+            ((flag |= 0xc0))
+
+        elif ! diff -q "$EXPECTED_FORMAT/$name.txt" "$OUTPUT_CACHE/${name}_format.txt" > /dev/null; then
+            echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+            echo "Format files don't match!!!${RST}"
+            ((flag |= 0xc0))
+
+        elif [[ -f "$EXPECTED_BIN/$name.txt" ]] && ! (diff -q "$EXPECTED_HEX/$name.txt" "$OUTPUT_CACHE/${name}_hex.txt" && diff -q "$EXPECTED_BIN/$name.txt" "$OUTPUT_CACHE/${name}_bin.txt") > /dev/null; then
+            echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+            echo "Hex or binary files do not match!!!${RST}"
+            ((flag |= 0xc0))
+        fi
+    done
+    if ! ((flag & 0x40)); then
+        echo "✅ ${GRN} Test 🧪🧪 case passed successfully!!!${RST}"
+    fi
+    ((flag &= 0x80))
+done
+
+echo "${BLU}Input_file:${RST} labels, --cache-size 1"
+rm -rf "$CACHE_DIR"
+for run in 1 2; do
+    stats=$("$ASSEMBLER" -i "$INPUT_DIR/input_labels.txt" -o "$SCRATCH_DIR/hex.txt" -b "$SCRATCH_DIR/bin.txt" -f "$SCRATCH_DIR/format.txt" --cache "$CACHE_DIR" --cache-size 1 --cache-stats 2> /dev/null)
+    if ! grep -q "Build cache: 0 of 1 lookups hit.*1 stored, 1 evicted" <<< "$stats" || ! grep -q "Build cache holds 0 entries" <<< "$stats"; then
+        echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+        echo "Expected the cache to evict the entry it stored on run $run${RST}"
+        grep "Build cache" <<< "$stats"
+        ((flag |= 0xc0))
+    fi
+done
+if ! ((flag & 0x40)); then
+    echo "✅ ${GRN} Test 🧪🧪 case passed successfully!!!${RST}"
+fi
+((flag &= 0x80))
+echo -e "\n"
+
+# Daemon
+# Each request of tests/daemon is sent to one --serve daemon on a connection of its own, in turn, and must get the same
+# responses. The statistics depend on how long the requests took, so only the counts in them are compared.
+echo -e "${BLU}Daemon:${RST}\n"
+DAEMON_DIR="$(dirname "$INPUT_DIR")/daemon"
+OUTPUT_DAEMON="$OUTPUT_DIR/daemon"
+DAEMON_SOCKET="$OUTPUT_DAEMON/assembler.sock"
+mkdir -p "$OUTPUT_DAEMON"
+rm -f "$DAEMON_SOCKET"
+daemonSend(){
+    python3 -c 'import socket, sys
+s = socket.socket(socket.AF_UNIX); s.connect(sys.argv[1]); s.sendall(sys.stdin.buffer.read()); s.shutdown(socket.SHUT_WR)
+while (block := s.recv(65536)): sys.stdout.buffer.write(block)' "$DAEMON_SOCKET"
+}
+daemonResponses(){
+    sed -E -e 's/(OK|ERROR) [0-9]+$/\1 -/' -e 's/"uptime_s":[0-9.e+-]+/"uptime_s":-/' -e 's/"latency":\{.*\}\}/"latency":-}/' "$1"
+}
+
+"$ASSEMBLER" --serve "$DAEMON_SOCKET" -j 2 > "$OUTPUT_DAEMON/log.txt" 2>&1 &
+daemon=$!
+for ((i = 0; i < 200; i++)); do
+    [[ -S "$DAEMON_SOCKET" ]] && break
+    sleep 0.05
+done
+
+for request in "$DAEMON_DIR"/*.txt; do
+    [[ -f "$request" ]] || continue
+    name=$(basename $request .txt)
+    exp_daemon="$EXPECTED_DIR/daemon/$name.txt"
+    out_daemon="$OUTPUT_DAEMON/$name.txt"
+    echo "${BLU}Request:${RST} $name"
+
+    daemonSend < "$request" > "$out_daemon" 2> /dev/null
+    signal=$?
+    if [[ $signal -ne 0 ]]; then
+        echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+        echo "The daemon could not be reached on $DAEMON_SOCKET${RST}"
+        ((flag |= 0xc0))
+
+    elif ! diff -q <(daemonResponses "$exp_daemon") <(daemonResponses "$out_daemon") > /dev/null; then
+        echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+        echo "The responses do not match!!!${RST}"
+        diff <(daemonResponses "$exp_daemon") <(daemonResponses "$out_daemon")
+        ((flag |= 0xc0))
+    else
+        echo "✅ ${GRN} Test 🧪🧪 case passed successfully!!!${RST}"
+    fi
+    ((flag &= 0x80))
+done
+
+# SIGTERM has to stop the daemon cleanly, and take its socket with it
+echo "${BLU}Request:${RST} SIGTERM"
+kill -TERM $daemon 2> /dev/null
+wait $daemon
+signal=$?
+if [[ $signal -ne 0 ]]; then
+    echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+    echo "The Assembler returned exit code $signal${RST}"
+    ((flag |= 0xc0))
+
+elif [[ -e "$DAEMON_SOCKET" ]]; then
+    echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+    echo "The socket $DAEMON_SOCKET was left behind!!!${RST}"
+    ((flag |= 0xc0))
+else
+    echo "✅ ${GRN} Test 🧪🧪 case passed successfully!!!${RST}"
+fi
+((flag &= 0x80))
+echo -e "\n"
+
+# Watch mode
+# Each source of tests/watch is saved in turn over the one being watched, and the files --watch writes, patched or
+# written in full, have to become those of a fresh assembly of it. A save is only taken to be done once they have.
+echo -e "${BLU}Watch Mode:${RST}\n"
+WATCH_SOURCES="$(dirname "$INPUT_DIR")/watch"
+WATCH_DIR="$OUTPUT_DIR/watch"
+rm -rf "$WATCH_DIR"
+mkdir -p "$WATCH_DIR/fresh"
+watchFiles(){
+    printf -- '-o %s -b %s -f %s' "$1/hex.txt" "$1/bin.txt" "$1/format.txt"
+    for format in $IMAGE_FORMATS; do
+        printf -- ' -e %s' "$format=$1/image.$format"
+    done
+}
+
+watcher=""
+for source in "$WATCH_SOURCES"/*.txt; do
+    [[ -f "$source" ]] || continue
+    name=$(basename $source .txt)
+    echo "${BLU}Source:${RST} $name"
+
+    rm -f "$WATCH_DIR/fresh"/*
+    "$ASSEMBLER" -i "$source" $(watchFiles "$WATCH_DIR/fresh") > /dev/null 2>&1
+    if [[ -z "$watcher" ]]; then
+        cp "$source" "$WATCH_DIR/program.txt"
+        "$ASSEMBLER" -i "$WATCH_DIR/program.txt" --watch $(watchFiles "$WATCH_DIR") > "$WATCH_DIR/log.txt" 2>&1 &
+        watcher=$!
+    else
+        cp "$source" "$WATCH_DIR/saving.txt" && mv "$WATCH_DIR/saving.txt" "$WATCH_DIR/program.txt"
+    fi
+
+    # The files the fresh assembly left out, like the images after an error, are left as they were
+    for ((tries = 0; tries < 200; tries++)); do
+        differs=""
+        for file in "$WATCH_DIR/fresh"/*; do
+            cmp -s "$file" "$WATCH_DIR/$(basename $file)" || { differs=$(basename $file); break; }
+        done
+        [[ -z "$differs" ]] && break
+        sleep 0.05
+    done
+
+    if [[ -n "$differs" ]]; then
+        echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+        echo "The $differs of --watch does not match a fresh assembly!!!${RST}"
+        diff "$WATCH_DIR/fresh/$differs" "$WATCH_DIR/$differs"
+        ((flag |= 0xc0))
+    else
+        echo "✅ ${GRN} Test 🧪🧪 case passed successfully!!!${RST}"
+    fi
+    ((flag &= 0x80))
+done
+if [[ -n "$watcher" ]]; then
+    kill $watcher
+    wait $watcher 2> /dev/null
+fi
+echo -e "\n"
+
+# Language server
+# Each session of tests/lsp is a recorded exchange of an editor, which must get the same responses. The first response
+# answers initialize with the version of the assembler, so its length and the version aren't compared.
+echo -e "${BLU}Language Server:${RST}\n"
+LSP_DIR="$(dirname "$INPUT_DIR")/lsp"
+mkdir -p "$OUTPUT_DIR/lsp"
+lspResponses(){
+    sed -e '1s/Content-Length: [0-9]*/Content-Length: -/' -e 's/"name":"Assembler","version":"[^"]*"/"name":"Assembler","version":"dev"/' "$1"
+}
+
+for session in "$LSP_DIR"/*.txt; do
+    [[ -f "$session" ]] || continue
+    name=$(basename $session .txt)
+    exp_lsp="$EXPECTED_DIR/lsp/$name.txt"
+    out_lsp="$OUTPUT_DIR/lsp/$name.txt"
+    echo "${BLU}Session:${RST} $name"
+
+    "$ASSEMBLER" --lsp < "$session" > "$out_lsp" 2> /dev/null
+    signal=$?
+    if [[ $signal -ne 0 ]]; then
+        echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+        echo "The Assembler returned exit code $signal${RST}"
+        ((flag |= 0xc0))
+
+    elif ! diff -q <(lspResponses "$exp_lsp") <(lspResponses "$out_lsp") > /dev/null; then
+        echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+        echo "The responses do not match!!!${RST}"
+        diff <(lspResponses "$exp_lsp") <(lspResponses "$out_lsp")
+        ((flag |= 0xc0))
+    else
+        echo "✅ ${GRN} Test 🧪🧪 case passed successfully!!!${RST}"
+    fi
+    ((flag &= 0x80))
+done
+echo -e "\n"
+
+# Streaming
+# --stream writes each word as soon as it is known, and has to end with the hex and binary files of the test cases above.
+# It stops at the first error, so only the inputs that assemble cleanly are streamed.
+echo -e "${BLU}Streaming:${RST}\n"
+OUTPUT_STREAM="$OUTPUT_DIR/stream"
+mkdir -p "$OUTPUT_STREAM"
+
+for input_file in "$INPUT_DIR"/input_*.txt; do
+    name=$(basename $input_file .txt | sed 's/input_//')
+    [[ -f "$EXPECTED_BIN/$name.txt" ]] || continue
+    echo "${BLU}Input_file:${RST} $name"
+
+    rm -f "$OUTPUT_STREAM/$name"_*.txt
+    "$ASSEMBLER" -i "$input_file" --stream -o "$OUTPUT_STREAM/${name}_hex.txt" -b "$OUTPUT_STREAM/${name}_bin.txt" > /dev/null 2>&1
+    signal=$?
+    if [[ $signal -ne 0 ]]; then
+        echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+        echo "The Assembler returned exit code $signal${RST}"
+        ((flag |= 0xc0))
+
+    elif ! diff -q "$OUTPUT_HEX/$name.txt" "$OUTPUT_STREAM/${name}_hex.txt" > /dev/null; then
+        echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+        echo "Hex files do not match!!!${RST}"
+        diff "$OUTPUT_HEX/$name.txt" "$OUTPUT_STREAM/${name}_hex.txt"
+        ((flag |= 0xc0))
+
+    elif ! diff -q "$OUTPUT_BIN/$name.txt" "$OUTPUT_STREAM/${name}_bin.txt" > /dev/null; then
+        echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+        echo "Binary files do not match!!!${RST}"
+        diff "$OUTPUT_BIN/$name.txt" "$OUTPUT_STREAM/${name}_bin.txt"
+        ((flag |= 0xc0))
+    else
+        echo "✅ ${GRN} Test 🧪🧪 case passed successfully!!!${RST}"
+    fi
+    ((flag &= 0x80))
+done
+echo -e "\n"
+
+# Low memory
+# --low-memory reads the input twice instead of keeping it, and has to write the hex and binary files of the test cases
+# above, errors included, and none where they wrote none.
+echo -e "${BLU}Low Memory:${RST}\n"
+OUTPUT_LOW_MEMORY="$OUTPUT_DIR/low_memory"
+mkdir -p "$OUTPUT_LOW_MEMORY"
+
+for input_file in "$INPUT_DIR"/input_*.txt; do
+    name=$(basename $input_file .txt | sed 's/input_//')
+    echo "${BLU}Input_file:${RST} $name"
+
+    rm -f "$OUTPUT_LOW_MEMORY/$name"_*.txt
+    "$ASSEMBLER" -i "$input_file" --low-memory -o "$OUTPUT_LOW_MEMORY/${name}_hex.txt" -b "$OUTPUT_LOW_MEMORY/${name}_bin.txt" > /dev/null 2>&1
+    signal=$?
+    if [[ $signal -ne 8 && $signal -ne 0 ]]; then
+        echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+        echo "The Assembler returned exit code $signal${RST}"
+        ((flag |= 0xc0))
+    fi
+
+    for kind in hex bin; do
+        normal="$OUTPUT_HEX/$name.txt"
+        [[ $kind == bin ]] && normal="$OUTPUT_BIN/$name.txt"
+        if [[ -f "$normal" || -f "$OUTPUT_LOW_MEMORY/${name}_$kind.txt" ]] && ! cmp -s "$normal" "$OUTPUT_LOW_MEMORY/${name}_$kind.txt"; then
+            echo "❌ ${RED} Test 🧪🧪 case failed!!!"
+            echo "The $kind files do not match!!!${RST}"
+            ((flag |= 0xc0))
+        fi
+    done
+    if ! ((flag & 0x40)); then
+        echo "✅ ${GRN} Test 🧪🧪 case passed successfully!!!${RST}"
+    fi
+    ((flag &= 0x80))
+done
+echo -e "\n"
+
 if ((flag & 0x80)); then
     echo "❌❌❌❌ ${RED}Some cases Failed${RST} 🫠🫠🫠"
     exit 5